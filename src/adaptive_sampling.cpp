@@ -0,0 +1,82 @@
+#include "adaptive_sampling.h"
+
+#include <algorithm>
+#include <cmath>
+
+namespace halmet {
+
+namespace {
+
+// Weight of a new sample in the mean and deviation. Roughly the last four
+// samples count.
+const float kAlpha = 0.25;
+
+}  // namespace
+
+AdaptiveSampler::AdaptiveSampler(const String& name) {
+  if (!name.isEmpty()) {
+    AddProfilerStatistics(name + " sample interval", &interval_statistics_);
+    AddProfilerStatistics(name + " detection latency", &detection_latency_);
+  }
+  summary_start_ = millis();
+}
+
+unsigned int AdaptiveSampler::update(float value,
+                                     const AdaptiveSamplingParameters& params) {
+  uint32_t now = millis();
+  interval_statistics_.mark();
+  summary_samples_++;
+
+  if (!has_previous_) {
+    // Start fast and slow down once the signal proves stable
+    has_previous_ = true;
+    mean_ = value;
+    variance_ = 0;
+    active_ = false;
+    interval_ = params.min_interval;
+  } else {
+    uint32_t elapsed = now - previous_time_;
+    float rate = elapsed > 0 ? 1000 * fabsf(value - previous_) / elapsed : 0;
+    float delta = value - mean_;
+    mean_ += kAlpha * delta;
+    variance_ = (1 - kAlpha) * (variance_ + kAlpha * delta * delta);
+
+    bool active = rate > params.rate_threshold ||
+                  sqrtf(variance_) > params.deviation_threshold;
+    if (active) {
+      if (!active_) {
+        detection_latency_.add(elapsed);
+        summary_latency_.add(elapsed);
+      }
+      interval_ = params.min_interval;
+    } else {
+      interval_ = 2 * interval_;
+    }
+    active_ = active;
+  }
+  interval_ = std::max(params.min_interval,
+                       std::min(interval_, params.max_interval));
+
+  previous_ = value;
+  previous_time_ = now;
+  return interval_;
+}
+
+void AdaptiveSampler::reset() { has_previous_ = false; }
+
+void AdaptiveSampler::log_summary(const String& name,
+                                  unsigned int baseline_interval) {
+  uint32_t now = millis();
+  uint32_t elapsed = now - summary_start_;
+  debugD(
+      "%s: %u samples in %u s, %u at a fixed interval; detection latency "
+      "%.0f ms (%u detections), %u ms at a fixed interval",
+      name.c_str(), summary_samples_, elapsed / 1000,
+      baseline_interval > 0 ? elapsed / baseline_interval : 0,
+      summary_latency_.mean(), summary_latency_.count(), baseline_interval);
+  summary_start_ = now;
+  summary_samples_ = 0;
+  summary_latency_.reset();
+}
+
+}  // namespace halmet
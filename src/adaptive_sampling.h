@@ -0,0 +1,80 @@
+#ifndef HALMET_SRC_ADAPTIVE_SAMPLING_H_
+#define HALMET_SRC_ADAPTIVE_SAMPLING_H_
+
+#include "pipeline_profiler.h"
+#include "sensesp_base_app.h"
+
+namespace halmet {
+
+/// Configuration of an adaptive sample rate.
+struct AdaptiveSamplingParameters {
+  bool enabled = false;
+  unsigned int min_interval = 100;   // ms, while the signal is changing
+  unsigned int max_interval = 5000;  // ms, while the signal is stable
+  float rate_threshold = 0.1;        // Rate of change (units/s)
+  float deviation_threshold = 0.05;  // Standard deviation (units)
+};
+
+/**
+ * @brief Sample interval following the activity of a signal.
+ *
+ * After each sample, the rate of change since the previous sample and the
+ * exponentially weighted standard deviation of the recent samples are
+ * compared against their thresholds. If either is exceeded, the signal is
+ * active and the next sample is taken after the minimum interval.
+ * Otherwise the interval is doubled, up to the maximum interval. A stable
+ * signal is thus sampled slowly, and a change is followed at the fast rate
+ * from the first sample seeing it. The rate of change catches ramps; the
+ * deviation catches steps seen after a long interval, and noise.
+ *
+ * The sample intervals and the detection latency, i.e. the interval that
+ * preceded the sample detecting the activity, are collected for the
+ * profiler. A fixed read interval has a detection latency of that interval.
+ */
+class AdaptiveSampler {
+ public:
+  /// Register the statistics with the profiler, unless name is empty.
+  AdaptiveSampler(const String& name);
+
+  /// Account for a sample and return the interval until the next one (ms).
+  unsigned int update(float value, const AdaptiveSamplingParameters& params);
+
+  /// Forget the signal history, for example after a configuration change.
+  void reset();
+
+  /// Log the samples taken since the last call against the number and
+  /// latency of sampling at a fixed interval (ms).
+  void log_summary(const String& name, unsigned int baseline_interval);
+
+  /// Time between the samples (ms)
+  const IntervalStatistics& get_interval_statistics() const {
+    return interval_statistics_;
+  }
+
+  /// Time between the last quiet sample and the sample detecting activity
+  /// (ms)
+  const RunningStatistics& get_detection_latency_statistics() const {
+    return detection_latency_;
+  }
+
+ protected:
+  bool has_previous_ = false;
+  float previous_ = 0;
+  uint32_t previous_time_ = 0;
+  float mean_ = 0;      // Exponentially weighted
+  float variance_ = 0;  // Exponentially weighted
+  bool active_ = false;
+  unsigned int interval_ = 0;  // ms
+
+  IntervalStatistics interval_statistics_;
+  RunningStatistics detection_latency_;
+
+  // Samples since the last summary
+  uint32_t summary_start_ = 0;
+  uint32_t summary_samples_ = 0;
+  RunningStatistics summary_latency_;
+};
+
+}  // namespace halmet
+
+#endif  // HALMET_SRC_ADAPTIVE_SAMPLING_H_
@@ -0,0 +1,225 @@
+#include "ads1115_scanner.h"
+
+#include "flight_recorder.h"
+#include "sample_age.h"
+#include "trace_replay.h"
+
+namespace halmet {
+
+namespace {
+
+const uint16_t kMuxByChannel[] = {
+    ADS1X15_REG_CONFIG_MUX_SINGLE_0, ADS1X15_REG_CONFIG_MUX_SINGLE_1,
+    ADS1X15_REG_CONFIG_MUX_SINGLE_2, ADS1X15_REG_CONFIG_MUX_SINGLE_3};
+
+// Conversion time for a data rate setting, with a margin for the internal
+// oscillator tolerance (us)
+uint32_t ConversionTime(uint16_t data_rate) {
+  int samples_per_second;
+  switch (data_rate) {
+    case RATE_ADS1115_8SPS:
+      samples_per_second = 8;
+      break;
+    case RATE_ADS1115_16SPS:
+      samples_per_second = 16;
+      break;
+    case RATE_ADS1115_32SPS:
+      samples_per_second = 32;
+      break;
+    case RATE_ADS1115_64SPS:
+      samples_per_second = 64;
+      break;
+    case RATE_ADS1115_250SPS:
+      samples_per_second = 250;
+      break;
+    case RATE_ADS1115_475SPS:
+      samples_per_second = 475;
+      break;
+    case RATE_ADS1115_860SPS:
+      samples_per_second = 860;
+      break;
+    default:
+      samples_per_second = 128;
+  }
+  return 1100000 / samples_per_second;
+}
+
+}  // namespace
+
+ADS1115Scanner::ADS1115Scanner(TwoWire* i2c, adsGain_t gain,
+                               uint16_t data_rate)
+    : i2c_{i2c},
+      gain_{gain},
+      data_rate_{data_rate},
+      conversion_time_{ConversionTime(data_rate)} {
+  // Checking for finished conversions is cheap when none are running
+  sensesp::event_loop()->onRepeat(1, [this]() { this->poll(); });
+}
+
+int ADS1115Scanner::first_input(uint8_t address) {
+  if (address < 0x48 || address > 0x4b) {
+    return -1;
+  }
+  // 0x4b maps to the first block, 0x48-0x4a to the following ones
+  return kChannelsPerConverter * ((address + 1) % kMaxConverters);
+}
+
+int ADS1115Scanner::add_converter(uint8_t address) {
+  int first = first_input(address);
+  if (first < 0) {
+    debugE("ADS1115Scanner: Invalid converter address 0x%02x", address);
+    return -1;
+  }
+  Converter& converter = converters_[first / kChannelsPerConverter];
+  if (converter.present) {
+    debugE("ADS1115Scanner: Converter 0x%02x added twice", address);
+    return -1;
+  }
+  converter.ads1115.setGain(gain_);
+  converter.ads1115.setDataRate(data_rate_);
+  if (!converter.ads1115.begin(address, i2c_)) {
+    debugE("ADS1115Scanner: No converter at address 0x%02x, inputs %d-%d "
+           "unavailable",
+           address, first, first + kChannelsPerConverter - 1);
+    return -1;
+  }
+  converter.address = address;
+  converter.present = true;
+  return first;
+}
+
+void ADS1115Scanner::set_handler(int input,
+                                 std::function<void(int16_t)> handler) {
+  if (input < 0 || input >= kMaxInputs) {
+    return;
+  }
+  handlers_[input] = handler;
+}
+
+bool ADS1115Scanner::request(int input) {
+  if (!has_input(input)) {
+    return false;
+  }
+  int index = input / kChannelsPerConverter;
+  Converter& converter = converters_[index];
+  converter.queued |= 1 << (input % kChannelsPerConverter);
+  if (converter.active < 0) {
+    start_next(index);
+  }
+  return true;
+}
+
+float ADS1115Scanner::compute_volts(int input, int16_t code) {
+  return converters_[input / kChannelsPerConverter].ads1115.computeVolts(
+      code);
+}
+
+uint16_t ADS1115Scanner::mux(int input) {
+  return kMuxByChannel[input % kChannelsPerConverter];
+}
+
+bool ADS1115Scanner::acquire(int input,
+                             std::function<void(Adafruit_ADS1115*)> granted) {
+  if (!has_input(input)) {
+    return false;
+  }
+  int index = input / kChannelsPerConverter;
+  Converter& converter = converters_[index];
+  converter.granted = granted;
+  if (converter.active < 0 && !converter.acquired) {
+    start_next(index);
+  }
+  return true;
+}
+
+void ADS1115Scanner::release(int input) {
+  if (!has_input(input)) {
+    return;
+  }
+  int index = input / kChannelsPerConverter;
+  Converter& converter = converters_[index];
+  if (!converter.acquired) {
+    return;
+  }
+  converter.acquired = false;
+  converter.ads1115.setDataRate(data_rate_);
+  start_next(index);
+}
+
+void ADS1115Scanner::pause() { paused_ = true; }
+
+void ADS1115Scanner::resume() {
+  paused_ = false;
+  for (int index = 0; index < kMaxConverters; index++) {
+    if (converters_[index].present && converters_[index].active < 0) {
+      start_next(index);
+    }
+  }
+}
+
+void ADS1115Scanner::write_register(int input, uint8_t reg,
+                                    uint16_t value) {
+  if (!has_input(input)) {
+    return;
+  }
+  i2c_->beginTransmission(converters_[input / kChannelsPerConverter].address);
+  i2c_->write(reg);
+  i2c_->write(value >> 8);
+  i2c_->write(value & 0xff);
+  i2c_->endTransmission();
+}
+
+void ADS1115Scanner::start_next(int index) {
+  Converter& converter = converters_[index];
+  if (converter.acquired || paused_) {
+    return;
+  }
+  if (converter.granted) {
+    // Hand the converter over before starting any queued conversion
+    converter.acquired = true;
+    auto granted = converter.granted;
+    converter.granted = nullptr;
+    granted(&converter.ads1115);
+    return;
+  }
+  for (int channel = 0; channel < kChannelsPerConverter; channel++) {
+    if (converter.queued & (1 << channel)) {
+      converter.queued &= ~(1 << channel);
+      converter.active = channel;
+      converter.started = micros();
+      converter.ads1115.startADCReading(kMuxByChannel[channel],
+                                        /*continuous=*/false);
+      num_active_++;
+      return;
+    }
+  }
+}
+
+void ADS1115Scanner::poll() {
+  if (num_active_ == 0 || paused_) {
+    return;
+  }
+  uint32_t now = micros();
+  for (int index = 0; index < kMaxConverters; index++) {
+    Converter& converter = converters_[index];
+    if (converter.active < 0 || now - converter.started < conversion_time_) {
+      continue;
+    }
+    int input = kChannelsPerConverter * index + converter.active;
+    int16_t code = converter.ads1115.getLastConversionResults();
+    converter.active = -1;
+    num_active_--;
+
+    // Keep the converter busy while the result is being processed
+    start_next(index);
+
+    MarkSampleAcquired();
+    RecordSample(RecorderSource::kAnalog, input, code);
+    code = ReplaySample(RecorderSource::kAnalog, input, code);
+    if (handlers_[input]) {
+      handlers_[input](code);
+    }
+  }
+}
+
+}  // namespace halmet
@@ -0,0 +1,125 @@
+#ifndef HALMET_SRC_ADS1115_SCANNER_H_
+#define HALMET_SRC_ADS1115_SCANNER_H_
+
+#include <Adafruit_ADS1X15.h>
+
+#include <functional>
+
+#include "sensesp_base_app.h"
+
+namespace halmet {
+
+/**
+ * @brief Non-blocking conversion scheduler for up to four ADS1115
+ * converters sharing the I2C bus.
+ *
+ * Each I2C address has a fixed block of four inputs, whether or not a
+ * converter was found at it: 0x4b (the HALMET onboard converter) provides
+ * inputs 0-3, 0x48 4-7, 0x49 8-11 and 0x4a 12-15. A missing converter thus
+ * never shifts the inputs of the others. A conversion request only starts
+ * a single-shot conversion and returns; the result is read once the
+ * conversion time has passed and delivered to the input handler from the
+ * event loop. Each converter works through its own queue of requested
+ * inputs, so conversions on different converters run in parallel and only
+ * the short register accesses are serialized on the bus.
+ */
+class ADS1115Scanner {
+ public:
+  static const int kMaxConverters = 4;
+  static const int kChannelsPerConverter = 4;
+  static const int kMaxInputs = kMaxConverters * kChannelsPerConverter;
+
+  ADS1115Scanner(TwoWire* i2c, adsGain_t gain,
+                 uint16_t data_rate = RATE_ADS1115_128SPS);
+
+  /**
+   * @brief Add a converter at the given I2C address (0x48-0x4b).
+   *
+   * @return The number of the first input of the converter, or -1 if the
+   * converter could not be initialized. Its inputs stay reserved either
+   * way.
+   */
+  int add_converter(uint8_t address);
+
+  /// Number of the first input of the converter at the given address, or -1
+  /// if the address is not valid.
+  static int first_input(uint8_t address);
+
+  /// Set the function receiving the raw code of each conversion of an input.
+  void set_handler(int input, std::function<void(int16_t)> handler);
+
+  /// Request a conversion of the input. Requests for an input that is
+  /// already queued are merged. Fails if the converter of the input is
+  /// missing.
+  bool request(int input);
+
+  float compute_volts(int input, int16_t code);
+
+  /// Multiplexer setting of the config register for a single-ended input
+  static uint16_t mux(int input);
+
+  /**
+   * @brief Take exclusive use of the converter of an input, for example for
+   * a burst capture.
+   *
+   * Once the running conversion of the converter has finished, granted is
+   * called from the event loop with the converter, which may then be
+   * reconfigured and accessed from any task. Requests for the other inputs
+   * of the converter are queued until release() is called from the event
+   * loop. release() restores the data rate of the scanner. acquire() fails
+   * if the converter is missing.
+   */
+  bool acquire(int input, std::function<void(Adafruit_ADS1115*)> granted);
+  void release(int input);
+
+  /**
+   * @brief Suspend all bus transfers of the scanner, for example while a
+   * burst capture on an acquired converter needs the bus to itself.
+   *
+   * Requests are queued, and conversions that were running are read after
+   * resume(). Event loop only.
+   */
+  void pause();
+  void resume();
+  bool is_paused() const { return paused_; }
+
+  /// Write a register of the converter of an acquired input, for example
+  /// the comparator thresholds.
+  void write_register(int input, uint8_t reg, uint16_t value);
+
+  /// True if the converter of the input has been added and initialized.
+  bool has_input(int input) const {
+    return input >= 0 && input < kMaxInputs &&
+           converters_[input / kChannelsPerConverter].present;
+  }
+
+ protected:
+  struct Converter {
+    Adafruit_ADS1115 ads1115;
+    uint8_t address = 0;
+    bool present = false;
+    uint8_t queued = 0;  // Bitmask of the requested channels
+    int active = -1;     // Channel being converted
+    uint32_t started = 0;
+    bool acquired = false;
+    std::function<void(Adafruit_ADS1115*)> granted;  // Pending acquire()
+  };
+
+  void start_next(int converter);
+  void poll();
+
+  TwoWire* i2c_;
+  adsGain_t gain_;
+  uint16_t data_rate_;
+  uint32_t conversion_time_;  // us
+
+  Converter converters_[kMaxConverters];
+  int num_active_ = 0;
+  bool paused_ = false;
+
+  std::function<void(int16_t)> handlers_[kMaxInputs];
+};
+
+}  // namespace halmet
+
+#endif  // HALMET_SRC_ADS1115_SCANNER_H_
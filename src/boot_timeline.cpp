@@ -0,0 +1,29 @@
+#include "boot_timeline.h"
+
+#include <esp_timer.h>
+
+namespace halmet {
+
+namespace {
+
+int64_t previous_mark = 0;  // us
+bool first_n2k_message_sent = false;
+
+}  // namespace
+
+void BootTimelineMark(const char* event) {
+  // esp_timer starts counting at reset, before setup() is entered
+  int64_t now = esp_timer_get_time();
+  debugI("Boot timeline: %7.1f ms (+%6.1f ms) %s", now / 1000.,
+         (now - previous_mark) / 1000., event);
+  previous_mark = now;
+}
+
+void BootTimelineMarkFirstN2kMessage() {
+  if (!first_n2k_message_sent) {
+    first_n2k_message_sent = true;
+    BootTimelineMark("First NMEA 2000 message sent");
+  }
+}
+
+}  // namespace halmet
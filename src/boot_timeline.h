@@ -0,0 +1,21 @@
+#ifndef HALMET_SRC_BOOT_TIMELINE_H_
+#define HALMET_SRC_BOOT_TIMELINE_H_
+
+#include "sensesp_base_app.h"
+
+namespace halmet {
+
+/**
+ * @brief Log a boot timeline event.
+ *
+ * The time since reset and since the previous event are logged, so the
+ * duration of each startup stage can be read off the serial log.
+ */
+void BootTimelineMark(const char* event);
+
+/// Log the first transmitted NMEA 2000 message. Later calls are ignored.
+void BootTimelineMarkFirstN2kMessage();
+
+}  // namespace halmet
+
+#endif  // HALMET_SRC_BOOT_TIMELINE_H_
@@ -0,0 +1,232 @@
+#include "comparator_alarm.h"
+
+#include <driver/gpio.h>
+#include <esp_attr.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/timers.h>
+
+#include <algorithm>
+
+#include "pulse_counter.h"
+#include "sensesp/signalk/signalk_output.h"
+#include "sensesp/ui/config_item.h"
+#include "setup_arena.h"
+
+namespace halmet {
+
+namespace {
+
+// The comparator asserts after two consecutive conversions outside the
+// window, so a single noisy sample doesn't raise the alarm
+const uint16_t kComparatorConfig =
+    ADS1X15_REG_CONFIG_MODE_CONTIN | ADS1X15_REG_CONFIG_CMODE_WINDOW |
+    ADS1X15_REG_CONFIG_CPOL_ACTVLOW | ADS1X15_REG_CONFIG_CLAT_LATCH |
+    ADS1X15_REG_CONFIG_CQUE_2CONV;
+const uint16_t kDataRate = RATE_ADS1115_128SPS;
+
+// Interval for clearing the latch while the alarm is active and for
+// repeating the state
+const unsigned int kCheckInterval = 1000;  // ms
+
+}  // namespace
+
+ADS1115ComparatorAlarm::ADS1115ComparatorAlarm(
+    ADS1115Scanner* ads1115, int input, int alert_pin, float low_threshold,
+    float high_threshold, const String& config_path, float scale)
+    : sensesp::BoolSensor(config_path),
+      ads1115_{ads1115},
+      input_{input},
+      alert_pin_{alert_pin},
+      scale_{scale},
+      params_{{low_threshold, high_threshold}} {
+  load();
+  params_.update();
+
+  // The ALERT/RDY output is open-drain
+  InstallGpioInterruptService();
+  pinMode(alert_pin_, INPUT_PULLUP);
+  gpio_set_intr_type((gpio_num_t)alert_pin_, GPIO_INTR_NEGEDGE);
+  gpio_isr_handler_add((gpio_num_t)alert_pin_, isr, this);
+  gpio_intr_enable((gpio_num_t)alert_pin_);
+
+  if (!ads1115_->acquire(input_, [this](Adafruit_ADS1115* converter) {
+        this->start(converter);
+      })) {
+    debugE("Comparator alarm: ADS1115 input %d is not available", input_);
+  }
+
+  sensesp::event_loop()->onRepeat(kCheckInterval,
+                                  [this]() { this->check(); });
+}
+
+void IRAM_ATTR ADS1115ComparatorAlarm::isr(void* arg) {
+  auto alarm = static_cast<ADS1115ComparatorAlarm*>(arg);
+  if (alarm->triggered_) {
+    return;
+  }
+  alarm->triggered_ = true;
+  // The event loop can't be called from an interrupt handler. Hand the
+  // alarm to the FreeRTOS timer task, which queues it on the event loop.
+  BaseType_t woken = pdFALSE;
+  if (xTimerPendFunctionCallFromISR(schedule_poll, alarm, 0, &woken) !=
+      pdPASS) {
+    // The timer command queue is full; check() catches the low pin
+    alarm->triggered_ = false;
+  }
+  if (woken) {
+    portYIELD_FROM_ISR();
+  }
+}
+
+void ADS1115ComparatorAlarm::schedule_poll(void* arg, uint32_t) {
+  auto alarm = static_cast<ADS1115ComparatorAlarm*>(arg);
+  sensesp::event_loop()->onDelay(0, [alarm]() { alarm->poll(); });
+}
+
+void ADS1115ComparatorAlarm::start(Adafruit_ADS1115* converter) {
+  converter_ = converter;
+  write_thresholds();
+  ads1115_->write_register(
+      input_, ADS1X15_REG_POINTER_CONFIG,
+      kComparatorConfig | kDataRate | converter_->getGain() |
+          ADS1115Scanner::mux(input_));
+}
+
+void ADS1115ComparatorAlarm::write_thresholds() {
+  const Parameters& params = params_.get();
+  ads1115_->write_register(input_, ADS1X15_REG_POINTER_LOWTHRESH,
+                           to_code(params.low_threshold));
+  ads1115_->write_register(input_, ADS1X15_REG_POINTER_HITHRESH,
+                           to_code(params.high_threshold));
+}
+
+int16_t ADS1115ComparatorAlarm::to_code(float volts) {
+  float code = volts / scale_ / ads1115_->compute_volts(input_, 1);
+  return std::max(-32768.f, std::min(32767.f, code));
+}
+
+void ADS1115ComparatorAlarm::poll() {
+  if (!triggered_) {
+    return;
+  }
+  triggered_ = false;
+  if (!alarm_) {
+    debugI("Comparator alarm on input %d raised", input_);
+    alarm_ = true;
+    this->emit(true);
+  }
+}
+
+void ADS1115ComparatorAlarm::check() {
+  // The bus is reserved for a burst capture; check at the next interval
+  if (converter_ == nullptr || ads1115_->is_paused()) {
+    return;
+  }
+  if (params_.update()) {
+    write_thresholds();
+  }
+
+  if (!alarm_ && digitalRead(alert_pin_) == LOW) {
+    // The edge was missed, for example while the thresholds were changed
+    triggered_ = true;
+    poll();
+    return;
+  }
+
+  if (alarm_) {
+    // Reading the result clears the latch. If the value is still outside
+    // the window, the comparator asserts again after two conversions.
+    int16_t code = converter_->getLastConversionResults();
+    const Parameters& params = params_.get();
+    if (code >= to_code(params.low_threshold) &&
+        code <= to_code(params.high_threshold)) {
+      debugI("Comparator alarm on input %d cleared", input_);
+      alarm_ = false;
+    }
+  }
+  this->emit(alarm_);
+}
+
+bool ADS1115ComparatorAlarm::to_json(JsonObject& config) {
+  Parameters params = params_.get_latest();
+  config["low_threshold"] = params.low_threshold;
+  config["high_threshold"] = params.high_threshold;
+  return true;
+}
+
+bool ADS1115ComparatorAlarm::from_json(const JsonObject& config) {
+  if (!config["low_threshold"].is<float>() ||
+      !config["high_threshold"].is<float>()) {
+    return false;
+  }
+  Parameters params;
+  params.low_threshold = config["low_threshold"];
+  params.high_threshold = config["high_threshold"];
+  if (params.low_threshold >= params.high_threshold) {
+    return false;
+  }
+  params_.set(params);
+  return true;
+}
+
+const String ConfigSchema(const ADS1115ComparatorAlarm& obj) {
+  return R"###({
+    "type": "object",
+    "properties": {
+      "low_threshold": { "title": "Low threshold", "type": "number", "description": "Alarm when the input voltage falls below this (V). Set below the input range to disable." },
+      "high_threshold": { "title": "High threshold", "type": "number", "description": "Alarm when the input voltage rises above this (V). Set above the input range to disable." }
+    }
+  })###";
+}
+
+sensesp::BoolProducer* ConnectComparatorAlarm(ADS1115Scanner* ads1115,
+                                              int input, int alert_pin,
+                                              const String& name,
+                                              float low_threshold,
+                                              float high_threshold,
+                                              int sort_order) {
+  char config_path[80];
+  char config_title[80];
+  char config_description[80];
+
+  snprintf(config_path, sizeof(config_path), "/Alarm %s/Comparator",
+           name.c_str());
+  snprintf(config_title, sizeof(config_title), "Alarm %s Thresholds",
+           name.c_str());
+  snprintf(config_description, sizeof(config_description),
+           "Alarm %s ADS1115 comparator window", name.c_str());
+
+  auto alarm = ArenaNew<ADS1115ComparatorAlarm>(
+      ads1115, input, alert_pin, low_threshold, high_threshold, config_path);
+
+  sensesp::ConfigItem(alarm)
+      ->set_title(config_title)
+      ->set_description(config_description)
+      ->set_sort_order(sort_order);
+
+#ifdef ENABLE_SIGNALK
+  char sk_path[80];
+
+  snprintf(config_path, sizeof(config_path), "/Alarm %s/SK Path",
+           name.c_str());
+  snprintf(sk_path, sizeof(sk_path), "alarm.%s", name.c_str());
+  snprintf(config_title, sizeof(config_title), "Alarm %s Signal K Path",
+           name.c_str());
+  snprintf(config_description, sizeof(config_description),
+           "Alarm %s Signal K Path", name.c_str());
+
+  auto alarm_sk_output =
+      ArenaNew<sensesp::SKOutputBool>(sk_path, config_path);
+
+  sensesp::ConfigItem(alarm_sk_output)
+      ->set_title(config_title)
+      ->set_description(config_description)
+      ->set_sort_order(sort_order + 1);
+
+  alarm->connect_to(alarm_sk_output);
+#endif
+
+  return alarm;
+}
+
+}  // namespace halmet
@@ -0,0 +1,95 @@
+#ifndef HALMET_SRC_COMPARATOR_ALARM_H_
+#define HALMET_SRC_COMPARATOR_ALARM_H_
+
+#include "ads1115_scanner.h"
+#include "halmet_analog.h"
+#include "live_config.h"
+#include "sensesp/sensors/sensor.h"
+#include "sensesp_base_app.h"
+
+namespace halmet {
+
+/**
+ * @brief Threshold alarm on an analog input, detected by the window
+ * comparator of the ADS1115.
+ *
+ * Detecting a low battery voltage or a high bilge level by sampling the
+ * input and comparing in software costs a conversion per sample and reacts
+ * only at the next sample. Instead, the alarm takes over the converter of
+ * the input, lets it convert the input continuously and programs the
+ * thresholds into its latching window comparator. When a value outside the
+ * window is converted twice in a row, the converter pulls its ALERT/RDY pin
+ * low. The pin interrupt queues the alarm on the event loop, which raises
+ * it at its next iteration. Nothing is read from the converter or polled
+ * meanwhile.
+ *
+ * While the alarm is active, the latch is cleared once per check interval
+ * by reading the conversion result, and the alarm ends once the value is
+ * back inside the window. The state is emitted on every change and
+ * repeated at the check interval, so that inputs expiring without updates,
+ * such as the NMEA 2000 sender status inputs, remain valid.
+ *
+ * The converter has a single comparator, so it can only serve one alarm
+ * and none of its inputs can be sampled otherwise. On HALMET, all four
+ * analog inputs share one converter, so the alarms need a converter of
+ * their own, for example on an expansion board, with its ALERT/RDY pin
+ * connected to a GPIO. The thresholds apply to the voltage at the input
+ * terminal; a threshold outside the input range disables that side of the
+ * window.
+ */
+class ADS1115ComparatorAlarm : public sensesp::BoolSensor {
+ public:
+  ADS1115ComparatorAlarm(ADS1115Scanner* ads1115, int input, int alert_pin,
+                         float low_threshold, float high_threshold,
+                         const String& config_path = "",
+                         float scale = kVoltageDividerScale);
+
+  virtual bool to_json(JsonObject& config) override;
+  virtual bool from_json(const JsonObject& config) override;
+
+ protected:
+  struct Parameters {
+    float low_threshold;   // V
+    float high_threshold;  // V
+  };
+
+  static void isr(void* arg);
+  static void schedule_poll(void* arg, uint32_t);
+
+  void start(Adafruit_ADS1115* ads1115);
+  void write_thresholds();
+  int16_t to_code(float volts);
+  void poll();
+  void check();
+
+  ADS1115Scanner* ads1115_;
+  Adafruit_ADS1115* converter_ = nullptr;
+  int input_;
+  int alert_pin_;
+  float scale_;  // Input terminal volts per converter volt
+  LiveConfig<Parameters> params_;
+
+  // Set by the interrupt handler until the alarm has been queued
+  volatile bool triggered_ = false;
+  bool alarm_ = false;
+};
+
+const String ConfigSchema(const ADS1115ComparatorAlarm& obj);
+
+inline const bool ConfigRequiresRestart(const ADS1115ComparatorAlarm& obj) {
+  return false;
+}
+
+/**
+ * @brief Create a comparator alarm with a Signal K output at alarm.<name>.
+ */
+sensesp::BoolProducer* ConnectComparatorAlarm(ADS1115Scanner* ads1115,
+                                              int input, int alert_pin,
+                                              const String& name,
+                                              float low_threshold,
+                                              float high_threshold,
+                                              int sort_order);
+
+}  // namespace halmet
+
+#endif  // HALMET_SRC_COMPARATOR_ALARM_H_
@@ -0,0 +1,186 @@
+#include "deferred_log.h"
+
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+
+namespace halmet {
+
+namespace deferred_log {
+
+namespace {
+
+const size_t kBufferSize = HALMET_DEFERRED_LOG_SIZE;
+static_assert((kBufferSize & (kBufferSize - 1)) == 0,
+              "HALMET_DEFERRED_LOG_SIZE must be a power of two");
+
+// Formats on the core not running the event loop, whenever nothing else
+// needs it
+const UBaseType_t kTaskPriority = tskIDLE_PRIORITY;
+const BaseType_t kTaskCore = 0;
+const uint32_t kTaskStackSize = 3072;
+
+// Time to sleep when the buffer is empty
+const unsigned int kDrainInterval = 20;  // ms
+
+const size_t kMaxMessageLength = 160;
+
+const char kTag[] = "halmet";
+
+alignas(8) uint8_t buffer[kBufferSize];
+
+// Byte counts written and read since the start. Their difference is the
+// buffer fill level, their remainders modulo the size the positions.
+std::atomic<uint32_t> head{0};
+std::atomic<uint32_t> tail{0};
+std::atomic<uint32_t> dropped{0};
+
+// Producer side
+TaskHandle_t producer = nullptr;
+uint32_t reserved_end = 0;
+
+void Drain(void*) {
+  uint32_t reported_drops = 0;
+  while (true) {
+    uint32_t read = tail.load(std::memory_order_relaxed);
+    if (read == head.load(std::memory_order_acquire)) {
+      uint32_t drops = dropped.load(std::memory_order_relaxed);
+      if (drops != reported_drops) {
+        debugW("Deferred log: %u messages dropped", drops - reported_drops);
+        reported_drops = drops;
+      }
+      vTaskDelay(pdMS_TO_TICKS(kDrainInterval));
+      continue;
+    }
+    size_t position = read % kBufferSize;
+    const Record* record = reinterpret_cast<Record*>(&buffer[position]);
+    if (record->format == nullptr) {
+      read += kBufferSize - position;
+    } else {
+      Print(*record);
+      read += RecordSize(record->num_args);
+    }
+    tail.store(read, std::memory_order_release);
+  }
+}
+
+}  // namespace
+
+size_t FormatRecord(const Record& record, char* out, size_t size) {
+  const char* p = record.format;
+  int arg = 0;
+  size_t length = 0;
+  while (*p && length + 1 < size) {
+    if (*p != '%') {
+      out[length++] = *p++;
+      continue;
+    }
+    if (p[1] == '%') {
+      out[length++] = '%';
+      p += 2;
+      continue;
+    }
+
+    // Keep the flags, width and precision and replace the length modifier
+    // with one matching the stored value
+    char spec[16];
+    int n = 0;
+    spec[n++] = *p++;
+    while (*p && strchr("-+ #0123456789.", *p) && n < 10) {
+      spec[n++] = *p++;
+    }
+    while (*p && strchr("hlLqjzt", *p)) {
+      p++;
+    }
+    char conversion = *p;
+    if (conversion == 0 || arg >= record.num_args) {
+      break;
+    }
+    p++;
+
+    ArgType type = record.type(arg);
+    const ArgValue& value = record.args[arg++];
+    int written;
+    if (strchr("fFeEgGaA", conversion)) {
+      double d = type == kFloat    ? value.d
+                 : type == kSigned ? static_cast<double>(value.i)
+                                   : static_cast<double>(value.u);
+      spec[n++] = conversion;
+      spec[n] = 0;
+      written = snprintf(out + length, size - length, spec, d);
+    } else if (strchr("diouxXc", conversion)) {
+      long long i = type == kFloat ? static_cast<long long>(value.d)
+                                   : static_cast<long long>(value.i);
+      if (conversion != 'c') {
+        spec[n++] = 'l';
+        spec[n++] = 'l';
+      }
+      spec[n++] = conversion;
+      spec[n] = 0;
+      written = conversion == 'c'
+                    ? snprintf(out + length, size - length, spec, (int)i)
+                    : snprintf(out + length, size - length, spec, i);
+    } else {
+      // Strings and pointers are not stored
+      written = snprintf(out + length, size - length, "?");
+    }
+    if (written < 0) {
+      break;
+    }
+    length = std::min(length + written, size - 1);
+  }
+  out[length] = 0;
+  return length;
+}
+
+bool IsProducer() {
+  return producer != nullptr && xTaskGetCurrentTaskHandle() == producer;
+}
+
+Record* Reserve(int num_args) {
+  size_t size = RecordSize(num_args);
+  uint32_t write = head.load(std::memory_order_relaxed);
+  size_t position = write % kBufferSize;
+  size_t padding = kBufferSize - position < size ? kBufferSize - position : 0;
+  uint32_t used = write - tail.load(std::memory_order_acquire);
+  if (used + padding + size > kBufferSize) {
+    dropped.fetch_add(1, std::memory_order_relaxed);
+    return nullptr;
+  }
+  if (padding > 0) {
+    // Records are contiguous; skip the rest of the buffer
+    reinterpret_cast<Record*>(&buffer[position])->format = nullptr;
+    position = 0;
+  }
+  reserved_end = write + padding + size;
+  return reinterpret_cast<Record*>(&buffer[position]);
+}
+
+void Commit() { head.store(reserved_end, std::memory_order_release); }
+
+void Print(const Record& record) {
+  static const char kLetters[] = "NEWIDV";
+  char message[kMaxMessageLength];
+  FormatRecord(record, message, sizeof(message));
+  esp_log_write(static_cast<esp_log_level_t>(record.level), kTag,
+                "%c (%u) %s: %s\n", kLetters[record.level], record.time,
+                kTag, message);
+}
+
+}  // namespace deferred_log
+
+void StartDeferredLog() {
+  if (deferred_log::producer != nullptr) {
+    return;
+  }
+  deferred_log::producer = xTaskGetCurrentTaskHandle();
+  xTaskCreatePinnedToCore(deferred_log::Drain, "deferred_log",
+                          deferred_log::kTaskStackSize, nullptr,
+                          deferred_log::kTaskPriority, nullptr,
+                          deferred_log::kTaskCore);
+}
+
+}  // namespace halmet
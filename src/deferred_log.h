@@ -0,0 +1,166 @@
+#ifndef HALMET_SRC_DEFERRED_LOG_H_
+#define HALMET_SRC_DEFERRED_LOG_H_
+
+#include <esp_log.h>
+
+#include <cstddef>
+#include <type_traits>
+
+#include "sensesp_base_app.h"
+
+#ifndef HALMET_DEFERRED_LOG_SIZE
+#define HALMET_DEFERRED_LOG_SIZE 4096
+#endif
+
+/**
+ * Deferred log messages.
+ *
+ * debugD() and friends format their message with printf and write it to
+ * the UART in the calling code, which for per-sample diagnostics means
+ * inside the sensor callbacks. deferredD() and friends instead store the
+ * address of the format string, the capture time and the raw argument
+ * values in a lock-free ring buffer of HALMET_DEFERRED_LOG_SIZE bytes. A
+ * task at idle priority on the other core formats them and writes them to
+ * the ESP-IDF log with their capture time.
+ *
+ * The ring buffer has a single producer, the task that called
+ * StartDeferredLog(), i.e. the event loop. Calls from other tasks, and all
+ * calls before StartDeferredLog(), are formatted immediately. The arguments
+ * must be numbers: a string could be gone by the time the message is
+ * formatted, so deferredD("%s", ...) does not compile. Messages that don't
+ * fit in the buffer are dropped and counted.
+ *
+ * Without ENABLE_DEFERRED_LOG, the macros are plain debugX() calls.
+ */
+
+#ifdef ENABLE_DEFERRED_LOG
+#define deferredE(format, ...) \
+  halmet::DeferredLog(ESP_LOG_ERROR, format, ##__VA_ARGS__)
+#define deferredW(format, ...) \
+  halmet::DeferredLog(ESP_LOG_WARN, format, ##__VA_ARGS__)
+#define deferredI(format, ...) \
+  halmet::DeferredLog(ESP_LOG_INFO, format, ##__VA_ARGS__)
+#define deferredD(format, ...) \
+  halmet::DeferredLog(ESP_LOG_DEBUG, format, ##__VA_ARGS__)
+#define deferredV(format, ...) \
+  halmet::DeferredLog(ESP_LOG_VERBOSE, format, ##__VA_ARGS__)
+#else
+#define deferredE(format, ...) debugE(format, ##__VA_ARGS__)
+#define deferredW(format, ...) debugW(format, ##__VA_ARGS__)
+#define deferredI(format, ...) debugI(format, ##__VA_ARGS__)
+#define deferredD(format, ...) debugD(format, ##__VA_ARGS__)
+#define deferredV(format, ...) debugV(format, ##__VA_ARGS__)
+#endif
+
+namespace halmet {
+
+namespace deferred_log {
+
+const int kMaxArgs = 8;
+
+enum ArgType : uint8_t { kSigned, kUnsigned, kFloat };
+
+union ArgValue {
+  int64_t i;
+  uint64_t u;
+  double d;
+};
+
+struct Record {
+  const char* format;  // Null for padding up to the end of the buffer
+  uint32_t time;       // ms
+  uint8_t level;       // esp_log_level_t
+  uint8_t num_args;
+  uint16_t types;  // ArgType of each argument, two bits each
+  ArgValue args[kMaxArgs];
+
+  ArgType type(int index) const {
+    return static_cast<ArgType>((types >> (2 * index)) & 3);
+  }
+};
+
+/// Size of a record with the given number of arguments
+constexpr size_t RecordSize(int num_args) {
+  return offsetof(Record, args) + num_args * sizeof(ArgValue);
+}
+
+/// True if the calling task may write to the ring buffer.
+bool IsProducer();
+
+/// Space for a record in the ring buffer, or null if it is full.
+Record* Reserve(int num_args);
+
+/// Publish the record returned by the last Reserve() call.
+void Commit();
+
+/// Format the message of a record into out, truncated to size - 1
+/// characters. Returns the length of the formatted message.
+size_t FormatRecord(const Record& record, char* out, size_t size);
+
+/// Format a record and write it to the log.
+void Print(const Record& record);
+
+inline void EncodeArgs(Record* record, int index) {}
+
+template <typename T, typename... Rest>
+void EncodeArgs(Record* record, int index, T value, Rest... rest) {
+  static_assert(std::is_arithmetic<T>::value,
+                "Deferred log arguments must be numbers");
+  ArgType type;
+  if (std::is_floating_point<T>::value) {
+    type = kFloat;
+    record->args[index].d = static_cast<double>(value);
+  } else if (std::is_signed<T>::value) {
+    type = kSigned;
+    record->args[index].i = static_cast<int64_t>(value);
+  } else {
+    type = kUnsigned;
+    record->args[index].u = static_cast<uint64_t>(value);
+  }
+  record->types |= type << (2 * index);
+  EncodeArgs(record, index + 1, rest...);
+}
+
+}  // namespace deferred_log
+
+/// Start the task formatting the deferred messages. Call from the event
+/// loop task, i.e. from setup().
+void StartDeferredLog();
+
+template <typename... Args>
+void DeferredLog(esp_log_level_t level, const char* format, Args... args) {
+  static_assert(sizeof...(Args) <= deferred_log::kMaxArgs,
+                "Too many deferred log arguments");
+  if (level > LOG_LOCAL_LEVEL) {
+    return;
+  }
+
+  deferred_log::Record immediate;
+  deferred_log::Record* record;
+  bool deferred = deferred_log::IsProducer();
+  if (deferred) {
+    record = deferred_log::Reserve(sizeof...(Args));
+    if (record == nullptr) {
+      return;
+    }
+  } else {
+    record = &immediate;
+  }
+
+  record->format = format;
+  record->time = millis();
+  record->level = level;
+  record->num_args = sizeof...(Args);
+  record->types = 0;
+  deferred_log::EncodeArgs(record, 0, args...);
+
+  if (deferred) {
+    deferred_log::Commit();
+  } else {
+    deferred_log::Print(immediate);
+  }
+}
+
+}  // namespace halmet
+
+#endif  // HALMET_SRC_DEFERRED_LOG_H_
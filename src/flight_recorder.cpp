@@ -0,0 +1,295 @@
+#include "flight_recorder.h"
+
+#include <SPIFFS.h>
+
+namespace halmet {
+
+FlightRecorder* flight_recorder = nullptr;
+
+namespace {
+
+const char kRecordingPath[] = "/recorder.bin";
+const char kRecordingTempPath[] = "/recorder.tmp";
+
+// Size of the chunks sent to the HTTP client
+const int kDownloadChunkSize = 512;
+
+// Allocated by the recorder, so builds without it don't reserve the RAM
+uint8_t (*recorder_buffer)[FlightRecorder::kBlockSize] = nullptr;
+
+int EncodeVarint(uint32_t value, uint8_t* buf) {
+  int len = 0;
+  while (value >= 0x80) {
+    buf[len++] = (value & 0x7f) | 0x80;
+    value >>= 7;
+  }
+  buf[len++] = value;
+  return len;
+}
+
+uint32_t ZigZag(int32_t value) {
+  return (static_cast<uint32_t>(value) << 1) ^ (value >> 31);
+}
+
+uint32_t BlockStartTime(const uint8_t* block) {
+  return block[1] | (block[2] << 8) | (block[3] << 16) | (block[4] << 24);
+}
+
+}  // namespace
+
+FlightRecorder::FlightRecorder(const String& config_path)
+    : sensesp::FileSystemSaveable{config_path} {
+  recorder_buffer = new uint8_t[kNumBlocks][kBlockSize];
+  load();
+}
+
+FlightRecorder::Track* FlightRecorder::get_track(uint8_t channel) {
+  for (int i = 0; i < num_tracks_; i++) {
+    if (tracks_[i].channel == channel) {
+      return &tracks_[i];
+    }
+  }
+  if (num_tracks_ == kMaxTracks) {
+    return nullptr;
+  }
+  // Channels not present in the block keyframe start from zero
+  tracks_[num_tracks_] = {channel, 0};
+  return &tracks_[num_tracks_++];
+}
+
+void FlightRecorder::record(uint8_t channel, int32_t value) {
+  if (state_ == State::kSaving) {
+    return;
+  }
+
+  Track* track = get_track(channel);
+  if (track == nullptr) {
+    return;
+  }
+  auto source = static_cast<RecorderSource>(channel >> 6);
+  int32_t previous = track->value;
+
+  // Only the edges of the alarm inputs are of interest
+  if (source == RecorderSource::kAlarm && value == previous) {
+    return;
+  }
+
+  uint32_t now = millis();
+  int32_t delta = static_cast<int32_t>(static_cast<uint32_t>(value) -
+                                       static_cast<uint32_t>(previous));
+  if (!append(channel, now, delta)) {
+    start_block(now);
+    append(channel, now, delta);
+  }
+  track->value = value;
+
+  if (source == RecorderSource::kAlarm && trigger_on_alarm_ && value != 0) {
+    trigger(kEventAlarmTrigger);
+  } else if (source == RecorderSource::kTacho && trigger_on_stall_ &&
+             value == 0 && previous != 0) {
+    trigger(kEventStallTrigger);
+  }
+}
+
+bool FlightRecorder::append(uint8_t channel, uint32_t now, int32_t delta) {
+  uint8_t buf[11];
+  int len = 0;
+  buf[len++] = channel;
+  len += EncodeVarint(now - last_record_time_, buf + len);
+  len += EncodeVarint(ZigZag(delta), buf + len);
+
+  if (current_block_ < 0 || write_pos_ + len > kBlockSize) {
+    return false;
+  }
+  memcpy(&recorder_buffer[current_block_][write_pos_], buf, len);
+  write_pos_ += len;
+  last_record_time_ = now;
+  return true;
+}
+
+void FlightRecorder::start_block(uint32_t now) {
+  current_block_ = (current_block_ + 1) % kNumBlocks;
+  if (blocks_used_ < kNumBlocks) {
+    blocks_used_++;
+  }
+
+  uint8_t* block = recorder_buffer[current_block_];
+  memset(block, kEndOfBlock, kBlockSize);
+
+  // Keyframe: magic, block start time and the current value of each channel
+  int pos = 0;
+  block[pos++] = kBlockMagic;
+  for (int i = 0; i < 4; i++) {
+    block[pos++] = (now >> (8 * i)) & 0xff;
+  }
+  block[pos++] = num_tracks_;
+  for (int i = 0; i < num_tracks_; i++) {
+    block[pos++] = tracks_[i].channel;
+    pos += EncodeVarint(ZigZag(tracks_[i].value), block + pos);
+  }
+
+  write_pos_ = pos;
+  last_record_time_ = now;
+}
+
+void FlightRecorder::trigger(uint8_t event) {
+  if (state_ != State::kRecording) {
+    return;
+  }
+  debugI("Flight recorder triggered by event %d", event);
+
+  uint8_t channel = RecorderChannel(RecorderSource::kEvent, event);
+  Track* track = get_track(channel);
+  record(channel, track == nullptr ? 1 : track->value + 1);
+
+  state_ = State::kTriggered;
+  trigger_time_ = millis();
+  sensesp::event_loop()->onDelay(post_trigger_ * 1000,
+                                 [this]() { this->save_frozen_window(); });
+}
+
+void FlightRecorder::save_frozen_window() {
+  uint32_t window_start = trigger_time_ - pre_trigger_ * 1000;
+
+  // Find the oldest block that still contains samples inside the window
+  int oldest = blocks_used_ < kNumBlocks ? 0 : (current_block_ + 1) % kNumBlocks;
+  int first = current_block_;
+  for (int i = 0; i < blocks_used_ - 1; i++) {
+    int block = (oldest + i) % kNumBlocks;
+    int next = (block + 1) % kNumBlocks;
+    if (static_cast<int32_t>(BlockStartTime(recorder_buffer[next]) -
+                             window_start) > 0) {
+      first = block;
+      break;
+    }
+  }
+
+  File file = SPIFFS.open(kRecordingTempPath, FILE_WRITE);
+  if (!file) {
+    debugE("Flight recorder: unable to open %s", kRecordingTempPath);
+    state_ = State::kRecording;
+    return;
+  }
+  file.close();
+
+  state_ = State::kSaving;
+  save_block_ = first;
+  save_remaining_ =
+      (current_block_ - first + kNumBlocks) % kNumBlocks + 1;
+  save_next_block();
+}
+
+void FlightRecorder::save_next_block() {
+  // Write one block per event loop round to avoid stalling the other
+  // event handlers.
+  File file = SPIFFS.open(kRecordingTempPath, FILE_APPEND);
+  size_t written = 0;
+  if (file) {
+    written = file.write(recorder_buffer[save_block_], kBlockSize);
+    file.close();
+  }
+  if (written != kBlockSize) {
+    debugE("Flight recorder: writing the recording failed");
+    SPIFFS.remove(kRecordingTempPath);
+    state_ = State::kRecording;
+    return;
+  }
+
+  save_block_ = (save_block_ + 1) % kNumBlocks;
+  if (--save_remaining_ > 0) {
+    sensesp::event_loop()->onDelay(0, [this]() { this->save_next_block(); });
+    return;
+  }
+
+  SPIFFS.remove(kRecordingPath);
+  SPIFFS.rename(kRecordingTempPath, kRecordingPath);
+  debugI("Flight recorder: recording saved to %s", kRecordingPath);
+
+  // Start a fresh block so that the next recording begins with a keyframe
+  current_block_ = -1;
+  blocks_used_ = 0;
+  state_ = State::kRecording;
+}
+
+esp_err_t FlightRecorder::handle_download(httpd_req_t* req) {
+  if (state_ == State::kSaving) {
+    httpd_resp_set_status(req, "503 Service Unavailable");
+    return httpd_resp_send(req, "Recording is being saved", HTTPD_RESP_USE_STRLEN);
+  }
+  File file = SPIFFS.open(kRecordingPath, FILE_READ);
+  if (!file) {
+    return httpd_resp_send_404(req);
+  }
+
+  httpd_resp_set_type(req, "application/octet-stream");
+  httpd_resp_set_hdr(req, "Content-Disposition",
+                     "attachment; filename=\"halmet-recording.bin\"");
+
+  // Stream the file in small chunks instead of buffering it in RAM
+  char chunk[kDownloadChunkSize];
+  size_t len;
+  while ((len = file.read(reinterpret_cast<uint8_t*>(chunk), sizeof(chunk))) >
+         0) {
+    if (httpd_resp_send_chunk(req, chunk, len) != ESP_OK) {
+      file.close();
+      return ESP_FAIL;
+    }
+  }
+  file.close();
+  return httpd_resp_send_chunk(req, nullptr, 0);
+}
+
+void FlightRecorder::add_http_handlers(sensesp::HTTPServer* server) {
+  server->add_handler(new sensesp::HTTPRequestHandler(
+      1 << HTTP_GET, "/api/recorder",
+      [this](httpd_req_t* req) { return this->handle_download(req); }));
+
+  server->add_handler(new sensesp::HTTPRequestHandler(
+      1 << HTTP_POST, "/api/recorder/trigger", [this](httpd_req_t* req) {
+        // The HTTP server runs in its own task; trigger in the event loop
+        sensesp::event_loop()->onDelay(
+            0, [this]() { this->trigger(kEventManualTrigger); });
+        return httpd_resp_send(req, "OK", HTTPD_RESP_USE_STRLEN);
+      }));
+}
+
+bool FlightRecorder::to_json(JsonObject& config) {
+  config["pre_trigger"] = pre_trigger_;
+  config["post_trigger"] = post_trigger_;
+  config["trigger_on_alarm"] = trigger_on_alarm_;
+  config["trigger_on_stall"] = trigger_on_stall_;
+  return true;
+}
+
+bool FlightRecorder::from_json(const JsonObject& config) {
+  String expected[] = {"pre_trigger", "post_trigger"};
+  for (auto str : expected) {
+    if (!config[str].is<int>()) {
+      debugE("FlightRecorder: Missing configuration key %s", str.c_str());
+      return false;
+    }
+  }
+  pre_trigger_ = config["pre_trigger"];
+  post_trigger_ = config["post_trigger"];
+  if (config["trigger_on_alarm"].is<bool>()) {
+    trigger_on_alarm_ = config["trigger_on_alarm"];
+  }
+  if (config["trigger_on_stall"].is<bool>()) {
+    trigger_on_stall_ = config["trigger_on_stall"];
+  }
+  return true;
+}
+
+const String ConfigSchema(const FlightRecorder& obj) {
+  return R"###({
+    "type": "object",
+    "properties": {
+      "pre_trigger": { "title": "Pre-trigger time", "type": "integer", "description": "Time to keep before the trigger event (s)" },
+      "post_trigger": { "title": "Post-trigger time", "type": "integer", "description": "Time to keep recording after the trigger event (s)" },
+      "trigger_on_alarm": { "title": "Trigger on alarm", "type": "boolean", "description": "Freeze a recording when an alarm input becomes active" },
+      "trigger_on_stall": { "title": "Trigger on engine stall", "type": "boolean", "description": "Freeze a recording when a tacho input stops" }
+    }
+  })###";
+}
+
+}  // namespace halmet
@@ -0,0 +1,123 @@
+#ifndef HALMET_SRC_FLIGHT_RECORDER_H_
+#define HALMET_SRC_FLIGHT_RECORDER_H_
+
+#include <esp_http_server.h>
+
+#include "sensesp/net/http_server.h"
+#include "sensesp/system/saveable.h"
+#include "sensesp_base_app.h"
+
+// Number of 1 kB blocks in the in-RAM recording ring.
+#ifndef HALMET_RECORDER_BLOCKS
+#define HALMET_RECORDER_BLOCKS 16
+#endif
+
+namespace halmet {
+
+/// Sources of recorded samples. Stored in the two top bits of a channel id.
+enum class RecorderSource : uint8_t {
+  kAnalog = 0,  // Raw ADS1115 codes, index = ADC input number
+  kTacho = 1,   // Tacho pulse counts per counting window, index = GPIO pin
+  kAlarm = 2,   // Alarm input states, index = GPIO pin
+  kEvent = 3,   // Recorder events (triggers), index = event type
+};
+
+inline uint8_t RecorderChannel(RecorderSource source, uint8_t index) {
+  return (static_cast<uint8_t>(source) << 6) | (index & 0x3f);
+}
+
+/**
+ * @brief Circular recorder of raw acquisition samples.
+ *
+ * Samples are stored at full acquisition rate in a RAM ring of fixed size
+ * blocks, allocated when the recorder is created. Each block starts with a
+ * keyframe holding the block start time and the last value of every known
+ * channel, followed by records of the form
+ *
+ *   channel (1 byte), time delta in ms (varint),
+ *   value delta to the previous value of the channel (zigzag varint).
+ *
+ * Unused space at the end of a block is filled with 0xff. A block can thus be
+ * decoded on its own, and a ring that has wrapped around is decoded starting
+ * from its oldest block.
+ *
+ * When a trigger event occurs, recording continues for the post-trigger
+ * time, after which the blocks covering the pre/post-trigger window are
+ * frozen and written to flash. The saved recording can be downloaded from
+ * the /api/recorder HTTP endpoint.
+ */
+class FlightRecorder : public sensesp::FileSystemSaveable {
+ public:
+  static const int kBlockSize = 1024;
+  static const int kNumBlocks = HALMET_RECORDER_BLOCKS;
+  static const uint8_t kBlockMagic = 0xb1;
+  static const uint8_t kEndOfBlock = 0xff;
+
+  // Event types recorded in the kEvent channel
+  static const uint8_t kEventManualTrigger = 0;
+  static const uint8_t kEventAlarmTrigger = 1;
+  static const uint8_t kEventStallTrigger = 2;
+
+  FlightRecorder(const String& config_path);
+
+  void record(uint8_t channel, int32_t value);
+  void trigger(uint8_t event);
+
+  /// Register the download and trigger endpoints on the HTTP server.
+  void add_http_handlers(sensesp::HTTPServer* server);
+
+  virtual bool to_json(JsonObject& config) override;
+  virtual bool from_json(const JsonObject& config) override;
+
+ protected:
+  enum class State { kRecording, kTriggered, kSaving };
+
+  struct Track {
+    uint8_t channel;
+    int32_t value;
+  };
+  static const int kMaxTracks = 24;
+
+  Track* get_track(uint8_t channel);
+  void start_block(uint32_t now);
+  bool append(uint8_t channel, uint32_t now, int32_t delta);
+  void save_frozen_window();
+  void save_next_block();
+  esp_err_t handle_download(httpd_req_t* req);
+
+  unsigned int pre_trigger_ = 60;   // s
+  unsigned int post_trigger_ = 30;  // s
+  bool trigger_on_alarm_ = true;
+  bool trigger_on_stall_ = true;
+
+  State state_ = State::kRecording;
+  uint32_t trigger_time_ = 0;
+
+  Track tracks_[kMaxTracks];
+  int num_tracks_ = 0;
+
+  int current_block_ = -1;
+  int blocks_used_ = 0;
+  int write_pos_ = kBlockSize;
+  uint32_t last_record_time_ = 0;
+
+  // Blocks still to be written to flash while saving
+  int save_block_ = 0;
+  int save_remaining_ = 0;
+};
+
+const String ConfigSchema(const FlightRecorder& obj);
+
+/// Global recorder instance. Null if the recorder is not enabled.
+extern FlightRecorder* flight_recorder;
+
+inline void RecordSample(RecorderSource source, uint8_t index,
+                         int32_t value) {
+  if (flight_recorder != nullptr) {
+    flight_recorder->record(RecorderChannel(source, index), value);
+  }
+}
+
+}  // namespace halmet
+
+#endif  // HALMET_SRC_FLIGHT_RECORDER_H_
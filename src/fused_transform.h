@@ -0,0 +1,499 @@
+#ifndef HALMET_SRC_FUSED_TRANSFORM_H_
+#define HALMET_SRC_FUSED_TRANSFORM_H_
+
+#include <algorithm>
+#include <tuple>
+#include <utility>
+
+#include "live_config.h"
+#include "sensesp/transforms/transform.h"
+#include "sensesp_base_app.h"
+
+namespace halmet {
+
+/**
+ * @brief Transform that applies a fixed chain of stages in a single call.
+ *
+ * In a chain of separate transforms, every stage costs a virtual set() call,
+ * a walk of the observer list and usually a std::function call. When the
+ * intermediate values are not needed, the stages can instead be fused into
+ * one FusedTransform: the stage types are template parameters, so the whole
+ * chain is inlined into set() and only the final value is emitted.
+ *
+ * A stage is any class providing
+ *
+ *   float apply(float input);
+ *   const char* key() const;    // Configuration key, or nullptr
+ *   String get_schema() const;  // JSON schema of the stage configuration
+ *   void to_json(JsonObject& config) const;
+ *   bool from_json(const JsonObject& config);
+ *   void configure(const Stage& other);  // Take over the parameters of other
+ *
+ * The configuration of each stage with a key is stored as a sub-object of
+ * the transform configuration, so the stage parameters remain editable in
+ * the web UI. As in StageTransform, a configuration update is parsed into
+ * copies of the stages and applied by set() before the next sample, so
+ * samples never see half-updated stages.
+ *
+ * Example, equivalent to a Frequency transform followed by a Linear
+ * transform converting revolutions per second to rpm:
+ *
+ *   auto rpm = new FusedTransform<int, FrequencyStage, LinearStage>(
+ *       "/Tacho/RPM", FrequencyStage("frequency", "Frequency", 1 / 100.),
+ *       LinearStage("rpm", "RPM", 60, 0));
+ */
+template <typename IN, typename... Stages>
+class FusedTransform : public sensesp::Transform<IN, float> {
+ public:
+  FusedTransform(const String& config_path, Stages... stages)
+      : sensesp::Transform<IN, float>(config_path),
+        stages_{stages...},
+        configs_{stages...} {
+    this->load();
+    update_stages(std::index_sequence_for<Stages...>());
+  }
+
+  void set(const IN& input) override {
+    update_stages(std::index_sequence_for<Stages...>());
+    float value = input;
+    std::apply(
+        [&value](auto&... stage) { ((value = stage.apply(value)), ...); },
+        stages_);
+    this->emit(value);
+  }
+
+  template <size_t index>
+  auto& get_stage() {
+    return std::get<index>(stages_);
+  }
+
+  virtual bool to_json(JsonObject& root) override {
+    std::apply(
+        [&root](const auto&... config) {
+          (stage_to_json(root, config.get_latest()), ...);
+        },
+        configs_);
+    return true;
+  }
+
+  virtual bool from_json(const JsonObject& config) override {
+    return stages_from_json(config, std::index_sequence_for<Stages...>());
+  }
+
+  String get_config_schema() const {
+    String properties;
+    for_each_stage([&properties](const auto& stage) {
+      if (stage.key() != nullptr) {
+        if (!properties.isEmpty()) {
+          properties += ",";
+        }
+        properties += stage.get_schema();
+      }
+    });
+    return String(R"###({"type": "object", "properties": {)###") +
+           properties + "}}";
+  }
+
+ protected:
+  template <typename Stage>
+  static void stage_to_json(JsonObject& root, const Stage& stage) {
+    if (stage.key() != nullptr) {
+      JsonObject config = root[stage.key()].template to<JsonObject>();
+      stage.to_json(config);
+    }
+  }
+
+  template <typename Stage>
+  static bool stage_from_json(const JsonObject& root, Stage& stage) {
+    if (stage.key() == nullptr) {
+      return true;
+    }
+    JsonObject config = root[stage.key()].template as<JsonObject>();
+    return !config.isNull() && stage.from_json(config);
+  }
+
+  // Parse the configuration into copies of the stages and stage them for
+  // the event loop only if every stage accepted its configuration
+  template <size_t... I>
+  bool stages_from_json(const JsonObject& root, std::index_sequence<I...>) {
+    std::tuple<Stages...> stages{std::get<I>(configs_).get_latest()...};
+    if (!(stage_from_json(root, std::get<I>(stages)) && ...)) {
+      return false;
+    }
+    (std::get<I>(configs_).set(std::get<I>(stages)), ...);
+    return true;
+  }
+
+  template <typename Stage>
+  static void update_stage(Stage& stage, LiveConfig<Stage>& config) {
+    if (config.update()) {
+      stage.configure(config.get());
+    }
+  }
+
+  template <size_t... I>
+  void update_stages(std::index_sequence<I...>) {
+    (update_stage(std::get<I>(stages_), std::get<I>(configs_)), ...);
+  }
+
+  template <typename F>
+  void for_each_stage(F function) const {
+    std::apply([&function](const auto&... stage) { (function(stage), ...); },
+               stages_);
+  }
+
+  // Stages in use by the event loop
+  std::tuple<Stages...> stages_;
+  // Configuration updates from the HTTP server task. A stage takes over the
+  // parameters of its updated copy but keeps its state, such as the time
+  // of the previous input of a FrequencyStage.
+  std::tuple<LiveConfig<Stages>...> configs_;
+};
+
+template <typename IN, typename... Stages>
+const String ConfigSchema(const FusedTransform<IN, Stages...>& obj) {
+  return obj.get_config_schema();
+}
+
+/**
+ * @brief Transform applying a single stage, reconfigurable at runtime.
+ *
+ * The stage configuration is the root of the transform configuration, so
+ * for example a StageTransform<CurveStage> reads the configuration saved by
+ * a CurveInterpolator. A configuration update is parsed into a copy of the
+ * stage, which then replaces the stage in use as a whole (see LiveConfig),
+ * so samples never see a half-updated curve.
+ *
+ * Only for stages without state between samples, such as LinearStage and
+ * CurveStage.
+ */
+template <typename Stage>
+class StageTransform : public sensesp::FloatTransform {
+ public:
+  StageTransform(const String& config_path, Stage stage)
+      : sensesp::FloatTransform(config_path), stage_{stage} {
+    this->load();
+    stage_.update();
+  }
+
+  void set(const float& input) override {
+    stage_.update();
+    this->emit(stage_.get().apply(input));
+  }
+
+  /// Stage in use. Event loop only.
+  const Stage& get_stage() { return stage_.get(); }
+
+  virtual bool to_json(JsonObject& root) override {
+    stage_.get_latest().to_json(root);
+    return true;
+  }
+
+  virtual bool from_json(const JsonObject& config) override {
+    Stage stage = stage_.get_latest();
+    if (!stage.from_json(config)) {
+      return false;
+    }
+    stage_.set(stage);
+    return true;
+  }
+
+  String get_config_schema() const {
+    return String(R"###({"type": "object", "properties": {)###") +
+           stage_.get_latest().get_properties() + "}}";
+  }
+
+ protected:
+  LiveConfig<Stage> stage_;
+};
+
+template <typename Stage>
+const String ConfigSchema(const StageTransform<Stage>& obj) {
+  return obj.get_config_schema();
+}
+
+/// Stage with a configurable multiplier and offset, like Linear.
+class LinearStage {
+ public:
+  LinearStage(const char* key, const char* title, float multiplier,
+              float offset)
+      : key_{key}, title_{title}, multiplier_{multiplier}, offset_{offset} {}
+
+  float apply(float input) const { return multiplier_ * input + offset_; }
+
+  float get_multiplier() const { return multiplier_; }
+
+  const char* key() const { return key_; }
+
+  String get_schema() const {
+    return String("\"") + key_ + R"###(": { "title": ")###" + title_ +
+           R"###(", "type": "object", "properties": {)###" +
+           get_properties() + "}}";
+  }
+
+  String get_properties() const {
+    return R"###(
+        "multiplier": { "title": "Multiplier", "type": "number" },
+        "offset": { "title": "Constant offset", "type": "number" })###";
+  }
+
+  void to_json(JsonObject& config) const {
+    config["multiplier"] = multiplier_;
+    config["offset"] = offset_;
+  }
+
+  bool from_json(const JsonObject& config) {
+    if (!config["multiplier"].is<float>() || !config["offset"].is<float>()) {
+      return false;
+    }
+    multiplier_ = config["multiplier"];
+    offset_ = config["offset"];
+    return true;
+  }
+
+  void configure(const LinearStage& other) {
+    multiplier_ = other.multiplier_;
+    offset_ = other.offset_;
+  }
+
+ protected:
+  const char* key_;
+  const char* title_;
+  float multiplier_;
+  float offset_;
+};
+
+/**
+ * @brief Stage converting a count to a frequency, like Frequency.
+ *
+ * The frequency is calculated from the time elapsed since the previous
+ * input. Inputs less than a millisecond apart count as a millisecond apart,
+ * which keeps the result finite without skipping the calculation.
+ */
+class FrequencyStage {
+ public:
+  FrequencyStage(const char* key, const char* title, float multiplier)
+      : key_{key}, title_{title}, multiplier_{multiplier} {}
+
+  float apply(float input) {
+    uint32_t now = millis();
+    uint32_t elapsed = std::max<uint32_t>(now - previous_time_, 1);
+    previous_time_ = now;
+    return multiplier_ * input * 1000 / elapsed;
+  }
+
+  const char* key() const { return key_; }
+
+  String get_schema() const {
+    return String("\"") + key_ + R"###(": { "title": ")###" + title_ +
+           R"###(", "type": "object", "properties": {)###" +
+           get_properties() + "}}";
+  }
+
+  String get_properties() const {
+    return R"###(
+        "multiplier": { "title": "Multiplier", "type": "number" })###";
+  }
+
+  void to_json(JsonObject& config) const {
+    config["multiplier"] = multiplier_;
+  }
+
+  bool from_json(const JsonObject& config) {
+    if (!config["multiplier"].is<float>()) {
+      return false;
+    }
+    multiplier_ = config["multiplier"];
+    return true;
+  }
+
+  void configure(const FrequencyStage& other) {
+    multiplier_ = other.multiplier_;
+  }
+
+ protected:
+  const char* key_;
+  const char* title_;
+  float multiplier_;
+  uint32_t previous_time_ = 0;
+};
+
+/**
+ * @brief Piecewise linear interpolation stage, like CurveInterpolator.
+ *
+ * Inputs below the first sample are interpolated from the origin and
+ * inputs beyond the last sample produce 9999.9, as in CurveInterpolator.
+ */
+class CurveStage {
+ public:
+  static const int kMaxSamples = 16;
+
+  struct Sample {
+    float input;
+    float output;
+  };
+
+  CurveStage(const char* key, const char* title,
+             std::initializer_list<Sample> samples)
+      : key_{key}, title_{title} {
+    for (const Sample& sample : samples) {
+      add_sample(sample);
+    }
+  }
+
+  float apply(float input) const {
+    float x0 = 0;
+    float y0 = 0;
+    int i = 0;
+    while (i < num_samples_ && input > samples_[i].input) {
+      x0 = samples_[i].input;
+      y0 = samples_[i].output;
+      i++;
+    }
+    if (i == num_samples_) {
+      return 9999.9;
+    }
+    float x1 = samples_[i].input;
+    float y1 = samples_[i].output;
+    return (y0 * (x1 - input) + y1 * (input - x0)) / (x1 - x0);
+  }
+
+  /// Insert a sample, keeping the samples sorted by input. Fails if the
+  /// curve is full or already has a sample with the same input, which
+  /// would make the interpolation divide by zero.
+  bool add_sample(const Sample& sample) {
+    if (num_samples_ == kMaxSamples) {
+      return false;
+    }
+    for (int i = 0; i < num_samples_; i++) {
+      if (samples_[i].input == sample.input) {
+        return false;
+      }
+    }
+    int i = num_samples_++;
+    while (i > 0 && samples_[i - 1].input > sample.input) {
+      samples_[i] = samples_[i - 1];
+      i--;
+    }
+    samples_[i] = sample;
+    return true;
+  }
+
+  const char* key() const { return key_; }
+
+  /// Set the column titles of the samples table in the web UI.
+  CurveStage& set_titles(const char* input_title, const char* output_title) {
+    input_title_ = input_title;
+    output_title_ = output_title;
+    return *this;
+  }
+
+  String get_schema() const {
+    return String("\"") + key_ + R"###(": { "title": ")###" + title_ +
+           R"###(", "type": "object", "properties": {)###" +
+           get_properties() + "}}";
+  }
+
+  String get_properties() const {
+    return String(R"###(
+        "samples": { "title": "Samples", "type": "array", "maxItems": 16,
+          "format": "table",
+          "items": { "type": "object", "properties": {
+            "input": { "title": ")###") +
+           input_title_ + R"###(", "type": "number" },
+            "output": { "title": ")###" +
+           output_title_ + R"###(", "type": "number" }
+          }}
+        })###";
+  }
+
+  void to_json(JsonObject& config) const {
+    JsonArray json_samples = config["samples"].to<JsonArray>();
+    for (int i = 0; i < num_samples_; i++) {
+      JsonObject entry = json_samples.add<JsonObject>();
+      entry["input"] = samples_[i].input;
+      entry["output"] = samples_[i].output;
+    }
+  }
+
+  bool from_json(const JsonObject& config) {
+    // A curve without samples would map every input beyond its end
+    if (!config["samples"].is<JsonArray>() ||
+        config["samples"].as<JsonArray>().size() == 0) {
+      return false;
+    }
+    JsonArray json_samples = config["samples"].as<JsonArray>();
+    if (json_samples.size() > kMaxSamples) {
+      debugE("CurveStage: %d samples given, at most %d are supported",
+             static_cast<int>(json_samples.size()), kMaxSamples);
+      return false;
+    }
+    num_samples_ = 0;
+    for (JsonVariant entry : json_samples) {
+      if (!add_sample({entry["input"], entry["output"]})) {
+        debugE("CurveStage: Duplicate sample input %g",
+               entry["input"].as<float>());
+        return false;
+      }
+    }
+    return true;
+  }
+
+  void configure(const CurveStage& other) {
+    num_samples_ = other.num_samples_;
+    for (int i = 0; i < num_samples_; i++) {
+      samples_[i] = other.samples_[i];
+    }
+  }
+
+ protected:
+  const char* key_;
+  const char* title_;
+  const char* input_title_ = "Input";
+  const char* output_title_ = "Output";
+  Sample samples_[kMaxSamples];
+  int num_samples_ = 0;
+};
+
+/**
+ * @brief Stage applying a fixed function, for example a stateless lambda.
+ *
+ * The stage has no configuration. Unlike a LambdaTransform, the function
+ * type is known at compile time, so the call is inlined.
+ */
+template <typename F>
+class FunctionStage {
+ public:
+  FunctionStage(F function) : function_{function} {}
+
+  float apply(float input) const { return function_(input); }
+
+  const char* key() const { return nullptr; }
+  String get_schema() const { return ""; }
+  void to_json(JsonObject& config) const {}
+  bool from_json(const JsonObject& config) { return true; }
+  void configure(const FunctionStage& other) {}
+
+ protected:
+  F function_;
+};
+
+/// A FunctionStage has no configuration to update, and the lambda it
+/// usually holds can't be assigned, so its LiveConfig only keeps the copy.
+template <typename F>
+class LiveConfig<FunctionStage<F>> {
+ public:
+  LiveConfig(const FunctionStage<F>& stage) : stage_{stage} {}
+
+  const FunctionStage<F>& get() const { return stage_; }
+  bool update() { return false; }
+  FunctionStage<F> get_latest() const { return stage_; }
+  void set(const FunctionStage<F>& stage) {}
+
+ protected:
+  const FunctionStage<F> stage_;
+};
+
+}  // namespace halmet
+
+#endif  // HALMET_SRC_FUSED_TRANSFORM_H_
@@ -1,34 +1,52 @@
 #include "halmet_analog.h"
 
+#include "fused_transform.h"
+#include "sample_age.h"
+#include "sender_fault.h"
 #include "sensesp/sensors/sensor.h"
 #include "sensesp/signalk/signalk_output.h"
 #include "sensesp/system/valueproducer.h"
-#include "sensesp/transforms/curveinterpolator.h"
+#include "sensesp/transforms/lambda_transform.h"
 #include "sensesp/transforms/linear.h"
 #include "sensesp/ui/config_item.h"
+#include "setup_arena.h"
+#include "tank_level_estimator.h"
 
 namespace halmet {
 
-// HALMET constant measurement current (A)
-const float kMeasurementCurrent = 0.01;
-
 // Default fuel tank size, in m3
 const float kTankDefaultSize = 120. / 1000;
 
-sensesp::FloatProducer* ConnectTankSender(Adafruit_ADS1115* ads1115,
-                                          int channel, const String& name,
-                                          const String& sk_id, int sort_order,
-                                          bool enable_signalk_output) {
+TankSenderOutputs ConnectTankSender(ADS1115Scanner* ads1115, int input,
+                                    const String& name, const String& sk_id,
+                                    int sort_order,
+                                    bool enable_signalk_output) {
   const uint ads_read_delay = 500;  // ms
 
   // Configure the sender resistance sensor
 
+  char input_config_path[80];
+  snprintf(input_config_path, sizeof(input_config_path),
+           "/Tanks/%s/Sender Input", name.c_str());
+  char input_title[80];
+  snprintf(input_title, sizeof(input_title), "%s Tank Sender Input",
+           name.c_str());
+  char input_description[80];
+  snprintf(input_description, sizeof(input_description),
+           "Sampling of the %s tank sender voltage", name.c_str());
+
+  auto sender_voltage = ArenaNew<ADS1115VoltageInput>(
+      ads1115, input, input_config_path, ads_read_delay);
+
+  ConfigItem(sender_voltage)
+      ->set_title(input_title)
+      ->set_description(input_description)
+      ->set_sort_order(sort_order + 11);
+
   auto sender_resistance =
-      new sensesp::RepeatSensor<float>(ads_read_delay, [ads1115, channel]() {
-        int16_t adc_output = ads1115->readADC_SingleEnded(channel);
-        float adc_output_volts = ads1115->computeVolts(adc_output);
-        return kVoltageDividerScale * adc_output_volts / kMeasurementCurrent;
-      });
+      sender_voltage->connect_to(
+          ArenaNew<sensesp::LambdaTransform<float, float>>(
+              [](float voltage) { return voltage / kMeasurementCurrent; }));
 
   if (enable_signalk_output) {
     char resistance_sk_config_path[80];
@@ -51,7 +69,7 @@ sensesp::FloatProducer* ConnectTankSender(Adafruit_ADS1115* ads1115,
     snprintf(resistance_meta_description, sizeof(resistance_meta_description),
              "Measured tank %s sender resistance", name.c_str());
 
-    auto sender_resistance_sk_output = new sensesp::SKOutputFloat(
+    auto sender_resistance_sk_output = ArenaNew<sensesp::SKOutputFloat>(
         resistance_sk_path, resistance_sk_config_path,
         new sensesp::SKMetadata("ohm", resistance_meta_display_name,
                                 resistance_meta_description));
@@ -64,6 +82,72 @@ sensesp::FloatProducer* ConnectTankSender(Adafruit_ADS1115* ads1115,
     sender_resistance->connect_to(sender_resistance_sk_output);
   }
 
+  // Configure the sender open/short detection
+
+  char fault_config_path[80];
+  snprintf(fault_config_path, sizeof(fault_config_path),
+           "/Tanks/%s/Sender Fault Detection", name.c_str());
+  char fault_title[80];
+  snprintf(fault_title, sizeof(fault_title), "%s Tank Sender Fault Detection",
+           name.c_str());
+  char fault_description[80];
+  snprintf(fault_description, sizeof(fault_description),
+           "Plausible resistance range of the %s tank sender", name.c_str());
+
+  auto sender_fault_detector =
+      ArenaNew<SenderFaultDetector>(fault_config_path);
+
+  ConfigItem(sender_fault_detector)
+      ->set_title(fault_title)
+      ->set_description(fault_description)
+      ->set_sort_order(sort_order + 9);
+
+  sender_resistance->connect_to(sender_fault_detector);
+
+  if (enable_signalk_output) {
+    char notification_config_path[80];
+    snprintf(notification_config_path, sizeof(notification_config_path),
+             "/Tanks/%s/Sender Notification SK Path", name.c_str());
+    char notification_title[80];
+    snprintf(notification_title, sizeof(notification_title),
+             "%s Tank Sender Notification SK Path", name.c_str());
+    char notification_description[80];
+    snprintf(notification_description, sizeof(notification_description),
+             "Signal K path for the %s tank sender fault notification",
+             name.c_str());
+    char notification_sk_path[80];
+    snprintf(notification_sk_path, sizeof(notification_sk_path),
+             "notifications.tanks.%s.sender", sk_id.c_str());
+
+    auto notification_sk_output = ArenaNew<sensesp::SKOutputRawJson>(
+        notification_sk_path, notification_config_path);
+
+    ConfigItem(notification_sk_output)
+        ->set_title(notification_title)
+        ->set_description(notification_description)
+        ->set_sort_order(sort_order + 6);
+
+    String tank_name = name;
+    sender_fault_detector->fault_
+        .connect_to(ArenaNew<sensesp::LambdaTransform<bool, String>>(
+            [sender_fault_detector, tank_name](bool fault) {
+              JsonDocument notification;
+              notification["state"] = fault ? "alarm" : "normal";
+              JsonArray method = notification["method"].to<JsonArray>();
+              if (fault) {
+                method.add("visual");
+                method.add("sound");
+              }
+              notification["message"] =
+                  tank_name + " tank sender " +
+                  SenderFaultDescription(sender_fault_detector->get_fault());
+              String json;
+              serializeJson(notification, json);
+              return json;
+            }))
+        ->connect_to(notification_sk_output);
+  }
+
   // Configure the piecewise linear interpolator for the tank level (ratio)
 
   char curve_config_path[80];
@@ -76,24 +160,41 @@ sensesp::FloatProducer* ConnectTankSender(Adafruit_ADS1115* ads1115,
   snprintf(curve_description, sizeof(curve_description),
            "Piecewise linear curve for the %s tank level", name.c_str());
 
-  auto tank_level = (new sensesp::CurveInterpolator(nullptr, curve_config_path))
-                        ->set_input_title("Sender Resistance (ohms)")
-                        ->set_output_title("Fuel Level (ratio)");
+  // The curve is replaced as a whole when edited, so it can be changed
+  // while the tank level is being sent. The default applies if there's no
+  // prior configuration.
+  auto tank_level = ArenaNew<StageTransform<CurveStage>>(
+      curve_config_path,
+      CurveStage("curve", "Level Curve", {{0, 0}, {180., 1}, {1000., 1}})
+          .set_titles("Sender Resistance (ohms)", "Fuel Level (ratio)"));
 
   ConfigItem(tank_level)
       ->set_title(curve_title)
       ->set_description(curve_description)
       ->set_sort_order(sort_order + 1);
 
-  if (tank_level->get_samples().empty()) {
-    // If there's no prior configuration, provide a default curve
-    tank_level->clear_samples();
-    tank_level->add_sample(sensesp::CurveInterpolator::Sample(0, 0));
-    tank_level->add_sample(sensesp::CurveInterpolator::Sample(180., 1));
-    tank_level->add_sample(sensesp::CurveInterpolator::Sample(1000., 1));
-  }
+  sender_fault_detector->connect_to(tank_level);
+
+  // Configure the level and consumption rate estimator
+
+  char estimator_config_path[80];
+  snprintf(estimator_config_path, sizeof(estimator_config_path),
+           "/Tanks/%s/Level Estimator", name.c_str());
+  char estimator_title[80];
+  snprintf(estimator_title, sizeof(estimator_title), "%s Tank Level Estimator",
+           name.c_str());
+  char estimator_description[80];
+  snprintf(estimator_description, sizeof(estimator_description),
+           "Level and consumption rate filter of the %s tank", name.c_str());
 
-  sender_resistance->connect_to(tank_level);
+  auto level_estimator = ArenaNew<TankLevelEstimator>(estimator_config_path);
+
+  ConfigItem(level_estimator)
+      ->set_title(estimator_title)
+      ->set_description(estimator_description)
+      ->set_sort_order(sort_order + 7);
+
+  tank_level->connect_to(level_estimator);
 
   if (enable_signalk_output) {
     char level_config_path[80];
@@ -115,7 +216,7 @@ sensesp::FloatProducer* ConnectTankSender(Adafruit_ADS1115* ads1115,
     snprintf(level_meta_description, sizeof(level_meta_description),
              "Tank %s level", name.c_str());
 
-    auto tank_level_sk_output = new sensesp::SKOutputFloat(
+    auto tank_level_sk_output = ArenaNew<sensesp::SKOutputFloat>(
         level_sk_path, level_config_path,
         new sensesp::SKMetadata("ratio", level_meta_display_name,
                                 level_meta_description));
@@ -125,7 +226,15 @@ sensesp::FloatProducer* ConnectTankSender(Adafruit_ADS1115* ads1115,
         ->set_description(level_description)
         ->set_sort_order(sort_order + 2);
 
-    tank_level->connect_to(tank_level_sk_output);
+    level_estimator->connect_to(tank_level_sk_output);
+
+    if (pipeline_profiler != nullptr) {
+      char level_age_name[80];
+      snprintf(level_age_name, sizeof(level_age_name),
+               "/Tanks/%s level SK pipeline age", name.c_str());
+      level_estimator->connect_to(
+          ArenaNew<PipelineAgeProbe<float>>(level_age_name));
+    }
   }
 
   // Configure the linear transform for the tank volume
@@ -139,15 +248,16 @@ sensesp::FloatProducer* ConnectTankSender(Adafruit_ADS1115* ads1115,
   char volume_description[80];
   snprintf(volume_description, sizeof(volume_description),
            "Calculated total volume of the %s tank", name.c_str());
-  auto tank_volume =
-      new sensesp::Linear(kTankDefaultSize, 0, volume_config_path);
+  auto tank_volume = ArenaNew<StageTransform<LinearStage>>(
+      volume_config_path,
+      LinearStage("volume", "Total Volume", kTankDefaultSize, 0));
 
   ConfigItem(tank_volume)
       ->set_title(volume_title)
       ->set_description(volume_description)
       ->set_sort_order(sort_order + 3);
 
-  tank_level->connect_to(tank_volume);
+  level_estimator->connect_to(tank_volume);
 
   if (enable_signalk_output) {
     char volume_sk_config_path[80];
@@ -169,7 +279,7 @@ sensesp::FloatProducer* ConnectTankSender(Adafruit_ADS1115* ads1115,
     snprintf(volume_meta_description, sizeof(volume_meta_description),
              "Calculated tank %s remaining volume", name.c_str());
 
-    auto tank_volume_sk_output = new sensesp::SKOutputFloat(
+    auto tank_volume_sk_output = ArenaNew<sensesp::SKOutputFloat>(
         volume_sk_path, volume_sk_config_path,
         new sensesp::SKMetadata("m3", volume_meta_display_name,
                                 volume_meta_description));
@@ -182,7 +292,90 @@ sensesp::FloatProducer* ConnectTankSender(Adafruit_ADS1115* ads1115,
     tank_volume->connect_to(tank_volume_sk_output);
   }
 
-  return tank_level;
+  // Configure the time to empty and fuel rate outputs
+
+  if (enable_signalk_output) {
+    char tte_config_path[80];
+    snprintf(tte_config_path, sizeof(tte_config_path),
+             "/Tanks/%s/Time to Empty SK Path", name.c_str());
+    char tte_title[80];
+    snprintf(tte_title, sizeof(tte_title), "%s Tank Time to Empty SK Path",
+             name.c_str());
+    char tte_description[80];
+    snprintf(tte_description, sizeof(tte_description),
+             "Signal K path for the %s tank time to empty", name.c_str());
+    char tte_sk_path[80];
+    snprintf(tte_sk_path, sizeof(tte_sk_path), "tanks.%s.timeToEmpty",
+             sk_id.c_str());
+    char tte_meta_display_name[80];
+    snprintf(tte_meta_display_name, sizeof(tte_meta_display_name),
+             "Tank %s time to empty", name.c_str());
+    char tte_meta_description[80];
+    snprintf(tte_meta_description, sizeof(tte_meta_description),
+             "Estimated time until tank %s is empty", name.c_str());
+
+    auto tte_sk_output = ArenaNew<sensesp::SKOutputFloat>(
+        tte_sk_path, tte_config_path,
+        new sensesp::SKMetadata("s", tte_meta_display_name,
+                                tte_meta_description));
+
+    ConfigItem(tte_sk_output)
+        ->set_title(tte_title)
+        ->set_description(tte_description)
+        ->set_sort_order(sort_order + 8);
+
+    level_estimator->time_to_empty_.connect_to(tte_sk_output);
+  }
+
+  // The level rate is negative when the tank is drained, so minus the total
+  // volume gives a positive fuel rate (m3/s). The volume is taken from the
+  // Total Volume item, so editing it there updates the fuel rate as well.
+  // A rising level is not a fuel rate; it is reported as not available
+  // (NaN), like the rate before the estimator has settled.
+  auto fuel_rate = ArenaNew<sensesp::LambdaTransform<float, float>>(
+      [tank_volume](float rate) {
+        float fuel_rate = -tank_volume->get_stage().get_multiplier() * rate;
+        return fuel_rate >= 0 ? fuel_rate : NAN;
+      });
+
+  level_estimator->rate_.connect_to(fuel_rate);
+
+  if (enable_signalk_output) {
+    char fuel_rate_sk_config_path[80];
+    snprintf(fuel_rate_sk_config_path, sizeof(fuel_rate_sk_config_path),
+             "/Tanks/%s/Fuel Rate SK Path", name.c_str());
+    char fuel_rate_sk_title[80];
+    snprintf(fuel_rate_sk_title, sizeof(fuel_rate_sk_title),
+             "%s Tank Fuel Rate SK Path", name.c_str());
+    char fuel_rate_sk_description[80];
+    snprintf(fuel_rate_sk_description, sizeof(fuel_rate_sk_description),
+             "Signal K path for the %s tank fuel rate", name.c_str());
+    char fuel_rate_sk_path[80];
+    snprintf(fuel_rate_sk_path, sizeof(fuel_rate_sk_path),
+             "tanks.%s.fuelRate", sk_id.c_str());
+    char fuel_rate_meta_display_name[80];
+    snprintf(fuel_rate_meta_display_name,
+             sizeof(fuel_rate_meta_display_name), "Tank %s fuel rate",
+             name.c_str());
+    char fuel_rate_meta_description[80];
+    snprintf(fuel_rate_meta_description, sizeof(fuel_rate_meta_description),
+             "Fuel consumption from tank %s", name.c_str());
+
+    auto fuel_rate_sk_output = ArenaNew<sensesp::SKOutputFloat>(
+        fuel_rate_sk_path, fuel_rate_sk_config_path,
+        new sensesp::SKMetadata("m3/s", fuel_rate_meta_display_name,
+                                fuel_rate_meta_description));
+
+    ConfigItem(fuel_rate_sk_output)
+        ->set_title(fuel_rate_sk_title)
+        ->set_description(fuel_rate_sk_description)
+        ->set_sort_order(sort_order + 12);
+
+    fuel_rate->connect_to(fuel_rate_sk_output);
+  }
+
+  return {level_estimator, tank_volume, &sender_fault_detector->fault_,
+          fuel_rate, sender_voltage};
 }
 
 }  // namespace halmet
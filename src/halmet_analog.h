@@ -1,8 +1,13 @@
 #ifndef HALMET_ANALOG_H_
 #define HALMET_ANALOG_H_
 
-#include <Adafruit_ADS1X15.h>
-
+#include "adaptive_sampling.h"
+#include "ads1115_scanner.h"
+#include "live_config.h"
+#include "pipeline_profiler.h"
+#include "power_manager.h"
+#include "sensesp/system/lambda_consumer.h"
+#include "setup_arena.h"
 #include "sensesp/sensors/sensor.h"
 #include "sensesp_base_app.h"
 
@@ -11,71 +16,254 @@ namespace halmet {
 // HALMET voltage divider scale factor
 const float kVoltageDividerScale = 33.3 / 3.3;
 
-sensesp::FloatProducer* ConnectTankSender(Adafruit_ADS1115* ads1115,
-                                          int channel, const String& name,
-                                          const String& sk_id, int sort_order,
-                                          bool enable_signalk_output = true);
+// HALMET constant measurement current (A)
+const float kMeasurementCurrent = 0.01;
+
+class ADS1115VoltageInput;
+
+/// Outputs of a tank sender pipeline.
+struct TankSenderOutputs {
+  sensesp::FloatProducer* level;        // Tank level (ratio)
+  sensesp::FloatProducer* volume;       // Tank volume (m3)
+  sensesp::BoolProducer* sender_fault;  // True while the sender reading is
+                                        // implausible
+  sensesp::FloatProducer* fuel_rate;    // Consumption from the tank (m3/s)
+  ADS1115VoltageInput* sender_voltage;  // Input sampling the sender
+};
+
+TankSenderOutputs ConnectTankSender(ADS1115Scanner* ads1115, int input,
+                                    const String& name, const String& sk_id,
+                                    int sort_order,
+                                    bool enable_signalk_output = true);
 
+/**
+ * @brief Voltage of a HALMET analog input, before the voltage divider.
+ *
+ * The conversion is requested from the ADS1115Scanner at the read interval
+ * and the value is emitted when the conversion completes. Changes to the
+ * read interval and the calibration factor take effect at the next sample,
+ * without a restart.
+ *
+ * With adaptive sampling enabled, the read interval varies between the
+ * configured minimum and maximum with the activity of the input voltage
+ * (see AdaptiveSampler). The sample counts and detection latencies are
+ * logged every minute against the fixed read interval.
+ */
 class ADS1115VoltageInput : public sensesp::FloatSensor {
  public:
-  ADS1115VoltageInput(Adafruit_ADS1115* ads1115, int channel,
+  ADS1115VoltageInput(ADS1115Scanner* ads1115, int input,
                       const String& config_path,
                       unsigned int read_interval = 500,
                       float calibration_factor = 1.0)
       : sensesp::FloatSensor(config_path),
         ads1115_{ads1115},
-        channel_{channel},
-        read_interval_{read_interval},
-        calibration_factor_{calibration_factor} {
+        input_{input},
+        params_{{read_interval, calibration_factor, {}}},
+        sampler_{config_path} {
     load();
+    params_.update();
 
-    repeat_event_ = set_repeat_event(read_interval_);
+    if (!config_path.isEmpty()) {
+      AddProfilerStatistics(config_path + " sample time", &sample_time_);
+      sensesp::event_loop()->onRepeat(kSummaryInterval, [this, config_path]() {
+        const Parameters& params = this->params_.get();
+        if (params.adaptive.enabled) {
+          this->sampler_.log_summary(config_path, params.read_interval);
+        }
+      });
+    }
+
+    if (!ads1115_->has_input(input_)) {
+      debugE("ADS1115 input %d is not available", input_);
+    }
+    ads1115_->set_handler(input_, [this](int16_t adc_output) {
+      this->handle_conversion(adc_output);
+    });
+
+    repeat_event_ = set_repeat_event(get_current_interval());
+
+    if (power_manager != nullptr) {
+      // Slow down the sampling while the engine is off
+      power_manager->connect_to(ArenaNew<sensesp::LambdaConsumer<bool>>(
+          [this](bool) { set_repeat_event(get_current_interval()); }));
+    }
   }
 
   void update() {
-    int16_t adc_output = ads1115_->readADC_SingleEnded(channel_);
-    float adc_output_volts = ads1115_->computeVolts(adc_output);
-    this->emit(calibration_factor_ * kVoltageDividerScale * adc_output_volts);
+    // Configuration changes are applied here only, so a change read
+    // elsewhere first can't skip re-arming the timer
+    if (params_.update()) {
+      adaptive_interval_ = 0;
+      sampler_.reset();
+      // Re-arm the timer outside of its own callback
+      sensesp::event_loop()->onDelay(0, [this]() {
+        this->set_repeat_event(this->get_current_interval());
+      });
+    }
+    ads1115_->request(input_);
+  }
+
+  /**
+   * @brief Sample only when sample() is called, for example ahead of the
+   * NMEA 2000 transmission using the value, instead of at the read
+   * interval.
+   *
+   * In low-power mode, the input is still sampled at the low-power interval
+   * and sample() does nothing.
+   */
+  void set_triggered() {
+    triggered_ = true;
+    set_repeat_event(get_current_interval());
+  }
+
+  /// Request a sample in triggered mode.
+  void sample() {
+    if (triggered_ && get_current_interval() == 0) {
+      update();
+    }
+  }
+
+  ADS1115Scanner* get_scanner() const { return ads1115_; }
+  int get_input() const { return input_; }
+
+  /// Voltage at the input terminal for a raw conversion result. Event loop
+  /// only.
+  float to_volts(int16_t adc_output) {
+    return params_.get().calibration_factor * kVoltageDividerScale *
+           ads1115_->compute_volts(input_, adc_output);
+  }
+
+  /// Time spent processing a sample, including all the connected consumers
+  /// (us)
+  const RunningStatistics& get_sample_time_statistics() const {
+    return sample_time_;
   }
 
   virtual bool to_json(JsonObject& root) override {
-    root["calibration_factor"] = calibration_factor_;
+    Parameters params = params_.get_latest();
+    root["read_interval"] = params.read_interval;
+    root["calibration_factor"] = params.calibration_factor;
+    root["adaptive"] = params.adaptive.enabled;
+    root["min_interval"] = params.adaptive.min_interval;
+    root["max_interval"] = params.adaptive.max_interval;
+    root["rate_threshold"] = params.adaptive.rate_threshold;
+    root["deviation_threshold"] = params.adaptive.deviation_threshold;
     return true;
   };
 
   virtual bool from_json(const JsonObject& config) override {
-    if (config["calibration_factor"].is<float>()) {
-      calibration_factor_ = config["calibration_factor"];
-      return true;
+    if (!config["calibration_factor"].is<float>()) {
+      return false;
     }
-    return false;
+    Parameters params = params_.get_latest();
+    params.calibration_factor = config["calibration_factor"];
+    // Configurations saved by earlier versions have no read interval
+    if (config["read_interval"].is<int>() &&
+        config["read_interval"].as<int>() > 0) {
+      params.read_interval = config["read_interval"];
+    }
+    // ... nor adaptive sampling settings
+    if (config["adaptive"].is<bool>()) {
+      params.adaptive.enabled = config["adaptive"];
+    }
+    if (config["min_interval"].is<int>() &&
+        config["max_interval"].is<int>() &&
+        config["min_interval"].as<int>() > 0 &&
+        config["min_interval"].as<int>() <= config["max_interval"].as<int>()) {
+      params.adaptive.min_interval = config["min_interval"];
+      params.adaptive.max_interval = config["max_interval"];
+    }
+    if (config["rate_threshold"].is<float>()) {
+      params.adaptive.rate_threshold = config["rate_threshold"];
+    }
+    if (config["deviation_threshold"].is<float>()) {
+      params.adaptive.deviation_threshold = config["deviation_threshold"];
+    }
+    params_.set(params);
+    return true;
   }
 
  protected:
+  // Interval for logging the adaptive sampling summary
+  static const unsigned int kSummaryInterval = 60000;  // ms
+
+  struct Parameters {
+    unsigned int read_interval;  // ms
+    float calibration_factor;
+    AdaptiveSamplingParameters adaptive;
+  };
+
+  unsigned int get_current_interval() {
+    if (power_manager != nullptr && power_manager->is_low_power()) {
+      return power_manager->get_sample_interval();
+    }
+    if (triggered_) {
+      return 0;
+    }
+    if (params_.get().adaptive.enabled && adaptive_interval_ > 0) {
+      return adaptive_interval_;
+    }
+    return params_.get().read_interval;
+  }
+
   reactesp::RepeatEvent* repeat_event_ = nullptr;
 
+  /// Replace the sampling timer. No timer is set if read_interval is 0.
   reactesp::RepeatEvent* set_repeat_event(unsigned int read_interval) {
     if (repeat_event_ != nullptr) {
       repeat_event_->remove(sensesp::event_loop());
+      repeat_event_ = nullptr;
     }
 
-    repeat_event_ = sensesp::event_loop()->onRepeat(
-        read_interval, [this]() { this->update(); });
+    if (read_interval > 0) {
+      repeat_event_ = sensesp::event_loop()->onRepeat(
+          read_interval, [this]() { this->update(); });
+    }
     return repeat_event_;
   }
 
+  bool triggered_ = false;
+  unsigned int adaptive_interval_ = 0;  // ms, 0 until the first sample
+
  private:
-  Adafruit_ADS1115* ads1115_;
-  int channel_;
-  unsigned int read_interval_;
-  float calibration_factor_;
+  void handle_conversion(int16_t adc_output) {
+    ScopedTimer timer(&sample_time_);
+    float volts = to_volts(adc_output);
+    adapt_interval(volts);
+    this->emit(volts);
+  }
+
+  void adapt_interval(float volts) {
+    const Parameters& params = params_.get();
+    if (!params.adaptive.enabled || triggered_ ||
+        (power_manager != nullptr && power_manager->is_low_power())) {
+      return;
+    }
+    unsigned int interval = sampler_.update(volts, params.adaptive);
+    if (interval != adaptive_interval_) {
+      adaptive_interval_ = interval;
+      set_repeat_event(interval);
+    }
+  }
+
+  ADS1115Scanner* ads1115_;
+  int input_;
+  LiveConfig<Parameters> params_;
+  RunningStatistics sample_time_;
+  AdaptiveSampler sampler_;
 };
 
 inline const String ConfigSchema(const ADS1115VoltageInput& obj) {
   const char SCHEMA[] = R"###({
       "type": "object",
       "properties": {
-          "calibration_factor": { "title": "Calibration factor", "type": "number", "description": "Multiplier to apply to the raw input value" }
+          "read_interval": { "title": "Read interval", "type": "integer", "description": "Time between samples (ms)" },
+          "calibration_factor": { "title": "Calibration factor", "type": "number", "description": "Multiplier to apply to the raw input value" },
+          "adaptive": { "title": "Adaptive sampling", "type": "boolean", "description": "Sample slowly while the voltage is stable and fast while it changes, instead of at the read interval" },
+          "min_interval": { "title": "Minimum interval", "type": "integer", "description": "Time between samples while the voltage changes (ms)" },
+          "max_interval": { "title": "Maximum interval", "type": "integer", "description": "Longest time between samples while the voltage is stable (ms)" },
+          "rate_threshold": { "title": "Rate threshold", "type": "number", "description": "Rate of change above which the voltage is changing (V/s)" },
+          "deviation_threshold": { "title": "Deviation threshold", "type": "number", "description": "Standard deviation of the recent samples above which the voltage is changing (V)" }
       }
     })###";
 
@@ -83,7 +271,7 @@ inline const String ConfigSchema(const ADS1115VoltageInput& obj) {
 }
 
 inline const bool ConfigRequiresRestart(const ADS1115VoltageInput& obj) {
-  return true;
+  return false;
 }
 
 }  // namespace halmet
@@ -12,6 +12,10 @@ const int kSCLPin = 22;
 // ADS1115 I2C address
 const int kADS1115Address = 0x4b;
 
+// I2C addresses available for additional ADS1115 converters, for example on
+// an expansion board
+const int kADS1115ExpansionAddresses[] = {0x48, 0x49, 0x4a};
+
 // CAN bus (NMEA 2000) pins on HALMET
 const gpio_num_t kCANRxPin = GPIO_NUM_18;
 const gpio_num_t kCANTxPin = GPIO_NUM_19;
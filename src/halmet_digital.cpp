@@ -1,10 +1,17 @@
 #include "halmet_digital.h"
 
+#include "flight_recorder.h"
+#include "pulse_counter.h"
+#include "sample_age.h"
 #include "sensesp/sensors/digital_input.h"
 #include "sensesp/sensors/sensor.h"
 #include "sensesp/signalk/signalk_output.h"
+#include "sensesp/system/lambda_consumer.h"
 #include "sensesp/transforms/frequency.h"
+#include "sensesp/transforms/lambda_transform.h"
 #include "sensesp/ui/config_item.h"
+#include "setup_arena.h"
+#include "trace_replay.h"
 
 using namespace sensesp;
 
@@ -12,7 +19,10 @@ using namespace sensesp;
 // This is rarely, if ever correct.
 const float kDefaultFrequencyScale = 1 / 100.;
 
-FloatProducer* ConnectTachoSender(int pin, String name) {
+// Tacho pulse counting interval, in ms
+const unsigned int kTachoCountInterval = 500;
+
+TachoSenderOutputs ConnectTachoSender(int pin, String name) {
   char config_path[80];
   char sk_path[80];
   char config_title[80];
@@ -22,8 +32,8 @@ FloatProducer* ConnectTachoSender(int pin, String name) {
   snprintf(config_title, sizeof(config_title), "Tacho %s Pin", name.c_str());
   snprintf(config_description, sizeof(config_description), "Tacho %s Input Pin",
            name.c_str());
-  auto tacho_input =
-      new DigitalInputCounter(pin, INPUT, RISING, 500, config_path);
+  auto tacho_input = halmet::ArenaNew<halmet::PulseCounter>(
+      pin, INPUT, RISING, kTachoCountInterval, config_path);
 
   ConfigItem(tacho_input)
       ->set_title(config_title)
@@ -35,9 +45,24 @@ FloatProducer* ConnectTachoSender(int pin, String name) {
            name.c_str());
   snprintf(config_description, sizeof(config_description),
            "Tacho %s Multiplier", name.c_str());
-  auto tacho_frequency = new Frequency(kDefaultFrequencyScale, config_path);
+  auto tacho_frequency =
+      halmet::ArenaNew<Frequency>(kDefaultFrequencyScale, config_path);
+
+  tacho_input->connect_to(
+      halmet::ArenaNew<LambdaConsumer<int>>([pin](int count) {
+        halmet::RecordSample(halmet::RecorderSource::kTacho, pin, count);
+      }));
+
+  auto tacho_count = tacho_input->connect_to(
+      halmet::ArenaNew<LambdaTransform<int, int>>([pin](int count) {
+        // The count represents the whole counting interval; use its
+        // midpoint as the acquisition time.
+        halmet::MarkSampleAcquired(millis() - kTachoCountInterval / 2);
+        return halmet::ReplaySample(halmet::RecorderSource::kTacho, pin,
+                                    count);
+      }));
 
-  tacho_input->connect_to(tacho_frequency);
+  tacho_count->connect_to(tacho_frequency);
 
 #ifdef ENABLE_SIGNALK
   snprintf(config_path, sizeof(config_path), "/Tacho %s/Revolutions SK Path",
@@ -48,16 +73,24 @@ FloatProducer* ConnectTachoSender(int pin, String name) {
   snprintf(config_description, sizeof(config_description),
            "Tacho %s Signal K Path", name.c_str());
 
-  auto tacho_frequency_sk_output = new SKOutputFloat(sk_path, config_path);
+  auto tacho_frequency_sk_output =
+      halmet::ArenaNew<SKOutputFloat>(sk_path, config_path);
 
   ConfigItem(tacho_frequency_sk_output)
       ->set_title(config_title)
       ->set_description(config_description);
 
   tacho_frequency->connect_to(tacho_frequency_sk_output);
+
+  if (halmet::pipeline_profiler != nullptr) {
+    snprintf(config_path, sizeof(config_path), "/Tacho %s SK pipeline age",
+             name.c_str());
+    tacho_frequency->connect_to(
+        halmet::ArenaNew<halmet::PipelineAgeProbe<float>>(config_path));
+  }
 #endif
 
-  return tacho_frequency;
+  return {tacho_frequency, tacho_input};
 }
 
 BoolProducer* ConnectAlarmSender(int pin, String name) {
@@ -66,7 +99,19 @@ BoolProducer* ConnectAlarmSender(int pin, String name) {
   char config_title[80];
   char config_description[80];
 
-  auto* alarm_input = new DigitalInputState(pin, INPUT, 100);
+  auto* alarm_input = halmet::ArenaNew<DigitalInputState>(pin, INPUT, 100);
+
+  alarm_input->connect_to(
+      halmet::ArenaNew<LambdaConsumer<bool>>([pin](bool state) {
+        halmet::RecordSample(halmet::RecorderSource::kAlarm, pin, state);
+      }));
+
+  auto alarm_state = alarm_input->connect_to(
+      halmet::ArenaNew<LambdaTransform<bool, bool>>([pin](bool state) {
+        halmet::MarkSampleAcquired();
+        return halmet::ReplaySample(halmet::RecorderSource::kAlarm, pin,
+                                    state) != 0;
+      }));
 
 #ifdef ENABLE_SIGNALK
   snprintf(config_path, sizeof(config_path), "/Alarm %s/SK Path", name.c_str());
@@ -76,14 +121,14 @@ BoolProducer* ConnectAlarmSender(int pin, String name) {
   snprintf(config_description, sizeof(config_description),
            "Alarm %s Signal K Path", name.c_str());
 
-  auto alarm_sk_output = new SKOutputBool(sk_path, config_path);
+  auto alarm_sk_output = halmet::ArenaNew<SKOutputBool>(sk_path, config_path);
 
   ConfigItem(alarm_sk_output)
       ->set_title(config_title)
       ->set_description(config_description);
 
-  alarm_input->connect_to(alarm_sk_output);
+  alarm_state->connect_to(alarm_sk_output);
 #endif
 
-  return alarm_input;
+  return alarm_state;
 }
@@ -1,11 +1,18 @@
 #ifndef __SRC_HALMET_DIGITAL_H__
 #define __SRC_HALMET_DIGITAL_H__
 
+#include "pulse_counter.h"
 #include "sensesp/sensors/sensor.h"
 
 using namespace sensesp;
 
-FloatProducer* ConnectTachoSender(int pin, String name);
+/// Outputs of a tacho sender pipeline.
+struct TachoSenderOutputs {
+  FloatProducer* frequency;       // Engine speed (Hz)
+  halmet::PulseCounter* counter;  // Input counting the pulses
+};
+
+TachoSenderOutputs ConnectTachoSender(int pin, String name);
 BoolProducer* ConnectAlarmSender(int pin, String name);
 
 #endif
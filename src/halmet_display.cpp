@@ -3,21 +3,30 @@
 
 #include <WiFi.h>
 
+#include "setup_arena.h"
+
 namespace halmet {
 
 // OLED display width and height, in pixels
 const int kScreenWidth = 128;
 const int kScreenHeight = 64;
 
+bool display_on = true;
+bool display_paused = false;
+bool display_changed = false;
+
 bool InitializeSSD1306(sensesp::SensESPBaseApp* sensesp_app,
                        Adafruit_SSD1306** display, TwoWire* i2c) {
-  *display = new Adafruit_SSD1306(kScreenWidth, kScreenHeight, i2c, -1);
-  bool init_successful = (*display)->begin(SSD1306_SWITCHCAPVCC, 0x3C);
+  auto ssd1306 =
+      ArenaNew<Adafruit_SSD1306>(kScreenWidth, kScreenHeight, i2c, -1);
+  bool init_successful = ssd1306->begin(SSD1306_SWITCHCAPVCC, 0x3C);
   if (!init_successful) {
     debugD("SSD1306 allocation failed");
     return false;
   }
-  delay(100);
+  // Only publish the display once it is ready; until then, the values
+  // printed to it are dropped.
+  *display = ssd1306;
   (*display)->setRotation(2);
   (*display)->clearDisplay();
   (*display)->setTextSize(1);
@@ -29,24 +38,55 @@ bool InitializeSSD1306(sensesp::SensESPBaseApp* sensesp_app,
   return true;
 }
 
+void SetDisplayPower(Adafruit_SSD1306* display, bool on) {
+  display_on = on;
+  if (display == nullptr) {
+    return;
+  }
+  display->ssd1306_command(on ? SSD1306_DISPLAYON : SSD1306_DISPLAYOFF);
+}
+
+void SetDisplayPaused(Adafruit_SSD1306* display, bool paused) {
+  display_paused = paused;
+  if (!paused && display_changed && display != nullptr) {
+    display->display();
+  }
+  display_changed = false;
+}
+
+// Send the buffer to the display, unless it is paused
+void UpdateDisplay(Adafruit_SSD1306* display) {
+  if (display_paused) {
+    display_changed = true;
+    return;
+  }
+  display->display();
+}
+
 /// Clear a text row on an Adafruit graphics display
 void ClearRow(Adafruit_SSD1306* display, int row) {
   display->fillRect(0, 8 * row, kScreenWidth, 8, 0);
 }
 
 void PrintValue(Adafruit_SSD1306* display, int row, String title, float value) {
+  if (display == nullptr || !display_on) {
+    return;
+  }
   ClearRow(display, row);
   display->setCursor(0, 8 * row);
   display->printf("%s: %.1f", title.c_str(), value);
-  display->display();
+  UpdateDisplay(display);
 }
 
 void PrintValue(Adafruit_SSD1306* display, int row, String title,
                 String value) {
+  if (display == nullptr || !display_on) {
+    return;
+  }
   ClearRow(display, row);
   display->setCursor(0, 8 * row);
   display->printf("%s: %s", title.c_str(), value.c_str());
-  display->display();
+  UpdateDisplay(display);
 }
 
 }  // namespace halmet
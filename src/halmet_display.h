@@ -8,9 +8,19 @@
 
 namespace halmet {
 
+/// Initialize the display. *display is left unchanged if none is found.
 bool InitializeSSD1306(sensesp::SensESPBaseApp* sensesp_app,
                        Adafruit_SSD1306** display, TwoWire* i2c);
 
+/// Switch the display panel on or off. Updates are skipped while off.
+/// SetDisplayPower() and PrintValue() do nothing if display is null.
+void SetDisplayPower(Adafruit_SSD1306* display, bool on);
+
+/// Hold back the transfers to the display, for example while another
+/// device needs the I2C bus to itself. PrintValue() keeps drawing into the
+/// buffer, which is sent when the display is resumed.
+void SetDisplayPaused(Adafruit_SSD1306* display, bool paused);
+
 void ClearRow(Adafruit_SSD1306* display, int row);
 
 void PrintValue(Adafruit_SSD1306* display, int row, String title, float value);
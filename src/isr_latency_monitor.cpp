@@ -0,0 +1,133 @@
+#include "isr_latency_monitor.h"
+
+#include <SPIFFS.h>
+#include <esp_attr.h>
+#include <esp_intr_alloc.h>
+#include <esp_timer.h>
+
+namespace halmet {
+
+namespace {
+
+// The Arduino core uses timer group 0 for its hardware timers
+const timer_group_t kTimerGroup = TIMER_GROUP_1;
+
+// The timers count microseconds
+const uint32_t kTimerDivider = 80;
+const uint32_t kTimerPeriod = 1000;  // us
+
+// Latencies above this are counted as outliers (us)
+const uint32_t kOutlierThreshold = 50;
+
+const unsigned int kFlashWriteInterval = 5000;  // ms
+const unsigned int kReportInterval = 10000;     // ms
+
+// Size of the test file, similar to a configuration file (bytes)
+const size_t kFlashWriteSize = 512;
+const char kFlashWritePath[] = "/isr_latency_test";
+
+}  // namespace
+
+IsrLatencyMonitor::IsrLatencyMonitor() {
+  start_probe(&iram_probe_, true);
+  start_probe(&flash_probe_, false);
+
+  AddProfilerStatistics("ISR latency IRAM max",
+                        &iram_probe_.max_latency_statistics);
+  AddProfilerStatistics("ISR latency flash max",
+                        &flash_probe_.max_latency_statistics);
+  AddProfilerStatistics("ISR latency flash write time", &flash_write_time_);
+
+  sensesp::event_loop()->onRepeat(kFlashWriteInterval,
+                                  [this]() { this->write_flash(); });
+  sensesp::event_loop()->onRepeat(kReportInterval,
+                                  [this]() { this->report(); });
+}
+
+void IsrLatencyMonitor::start_probe(Probe* probe, bool iram) {
+  timer_config_t config = {};
+  config.alarm_en = TIMER_ALARM_EN;
+  config.counter_en = TIMER_PAUSE;
+  config.intr_type = TIMER_INTR_LEVEL;
+  config.counter_dir = TIMER_COUNT_UP;
+  config.auto_reload = TIMER_AUTORELOAD_EN;
+  config.divider = kTimerDivider;
+  timer_init(kTimerGroup, probe->timer, &config);
+  timer_set_counter_value(kTimerGroup, probe->timer, 0);
+  timer_set_alarm_value(kTimerGroup, probe->timer, kTimerPeriod);
+  timer_enable_intr(kTimerGroup, probe->timer);
+  timer_isr_callback_add(kTimerGroup, probe->timer,
+                         iram ? iram_handler : flash_handler, this,
+                         iram ? ESP_INTR_FLAG_IRAM : 0);
+  probe->last_time = esp_timer_get_time();
+  timer_start(kTimerGroup, probe->timer);
+}
+
+// Called from both handlers, so it has to be in IRAM
+void IRAM_ATTR IsrLatencyMonitor::handle(IsrLatencyMonitor* monitor,
+                                         Probe* probe) {
+  // The counter restarted from zero at the alarm
+  uint32_t latency =
+      timer_group_get_counter_value_in_isr(kTimerGroup, probe->timer);
+  int64_t now = esp_timer_get_time();
+  uint32_t elapsed = now - probe->last_time;
+  probe->last_time = now;
+
+  if (latency > probe->max_latency) {
+    probe->max_latency = latency;
+  }
+  if (elapsed > kTimerPeriod * 3 / 2) {
+    probe->missed += (elapsed + kTimerPeriod / 2) / kTimerPeriod - 1;
+  }
+  if (latency > kOutlierThreshold) {
+    if (monitor->flash_write_active_) {
+      probe->flash_write_outliers++;
+    } else {
+      probe->outliers++;
+    }
+  }
+}
+
+bool IRAM_ATTR IsrLatencyMonitor::iram_handler(void* arg) {
+  IsrLatencyMonitor* monitor = static_cast<IsrLatencyMonitor*>(arg);
+  handle(monitor, &monitor->iram_probe_);
+  return false;
+}
+
+bool IsrLatencyMonitor::flash_handler(void* arg) {
+  IsrLatencyMonitor* monitor = static_cast<IsrLatencyMonitor*>(arg);
+  handle(monitor, &monitor->flash_probe_);
+  return false;
+}
+
+void IsrLatencyMonitor::write_flash() {
+  uint8_t buffer[kFlashWriteSize];
+  memset(buffer, millis() & 0xff, sizeof(buffer));
+
+  uint32_t start = millis();
+  flash_write_active_ = true;
+  File file = SPIFFS.open(kFlashWritePath, FILE_WRITE);
+  if (file) {
+    file.write(buffer, sizeof(buffer));
+    file.close();
+  }
+  flash_write_active_ = false;
+  flash_write_time_.add(millis() - start);
+}
+
+void IsrLatencyMonitor::report() {
+  for (Probe* probe : {&iram_probe_, &flash_probe_}) {
+    // The counters are only updated on the core of the handler. Reading
+    // them without a lock may be off by one interrupt, which is fine here.
+    uint32_t max_latency = probe->max_latency;
+    probe->max_latency = 0;
+    probe->max_latency_statistics.add(max_latency);
+    debugI(
+        "ISR latency %s: max %u us, outliers %u, during flash writes %u, "
+        "missed %u",
+        probe->name, max_latency, probe->outliers,
+        probe->flash_write_outliers, probe->missed);
+  }
+}
+
+}  // namespace halmet
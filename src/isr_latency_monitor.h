@@ -0,0 +1,61 @@
+#ifndef HALMET_SRC_ISR_LATENCY_MONITOR_H_
+#define HALMET_SRC_ISR_LATENCY_MONITOR_H_
+
+#include <driver/timer.h>
+
+#include "pipeline_profiler.h"
+#include "sensesp_base_app.h"
+
+namespace halmet {
+
+/**
+ * @brief Count interrupt latency outliers caused by flash writes.
+ *
+ * Two hardware timers raise an interrupt every millisecond. One handler is
+ * placed in IRAM and allocated as IRAM-safe, like that of PulseCounter; the
+ * other runs from flash, like the handlers installed through the Arduino
+ * core. Each handler reads how long ago its timer alarm fired, and counts
+ * the latencies above kOutlierThreshold and the alarms missed entirely.
+ *
+ * To provoke the stalls that configuration saves cause, a file of the size
+ * of a typical configuration is written to SPIFFS every few seconds.
+ * Outliers during these writes are counted separately. The flash handler
+ * should show them, the IRAM handler should not. The counts are logged
+ * every ten seconds, and the maximum latency per period is added to the
+ * profiler report.
+ */
+class IsrLatencyMonitor {
+ public:
+  IsrLatencyMonitor();
+
+ protected:
+  struct Probe {
+    const char* name;
+    timer_idx_t timer;
+    // Updated by the interrupt handler
+    uint32_t max_latency;  // us, since the last report
+    uint32_t outliers;
+    uint32_t flash_write_outliers;
+    uint32_t missed;
+    int64_t last_time;  // us
+    // Maximum latency per report period (us)
+    RunningStatistics max_latency_statistics;
+  };
+
+  static bool iram_handler(void* arg);
+  static bool flash_handler(void* arg);
+  static void handle(IsrLatencyMonitor* monitor, Probe* probe);
+
+  void start_probe(Probe* probe, bool iram);
+  void write_flash();
+  void report();
+
+  Probe iram_probe_{"IRAM", TIMER_0};
+  Probe flash_probe_{"flash", TIMER_1};
+  volatile bool flash_write_active_ = false;
+  RunningStatistics flash_write_time_;  // ms
+};
+
+}  // namespace halmet
+
+#endif  // HALMET_SRC_ISR_LATENCY_MONITOR_H_
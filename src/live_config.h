@@ -0,0 +1,82 @@
+#ifndef HALMET_SRC_LIVE_CONFIG_H_
+#define HALMET_SRC_LIVE_CONFIG_H_
+
+#include <freertos/FreeRTOS.h>
+
+#include <atomic>
+#include <type_traits>
+
+namespace halmet {
+
+/**
+ * @brief Parameters that can be replaced while they are in use.
+ *
+ * Configuration changes arrive in from_json(), which runs in the HTTP
+ * server task, while the event loop keeps reading the parameters. Writing
+ * the members one by one would let a sample see a mix of old and new
+ * values, or a curve in the middle of being rebuilt.
+ *
+ * Instead, from_json() parses into a complete copy of the parameter struct
+ * and hands it over with set(). The event loop swaps it in as a whole when
+ * it calls update(), so the parameters in effect are always either all old
+ * or all new, and the data streams continue without a restart. get() only
+ * reads, so the owner calls update() at a single point, e.g. at the start
+ * of its sampling callback, and reacts to the change there; a reader
+ * elsewhere never takes the change away from it. Owners that load their
+ * configuration in the constructor call update() after load(). The copies
+ * are taken under a spinlock, so T must be trivially copyable and small.
+ */
+template <typename T>
+class LiveConfig {
+  static_assert(std::is_trivially_copyable<T>::value,
+                "LiveConfig parameters must be trivially copyable");
+
+ public:
+  LiveConfig(const T& initial = T()) : active_{initial}, staged_{initial} {}
+
+  /// Parameters in effect. Event loop only.
+  const T& get() const { return active_; }
+
+  /**
+   * @brief Apply staged parameters. Event loop only.
+   *
+   * @return True if new parameters were applied, for example to re-arm a
+   * timer.
+   */
+  bool update() {
+    if (!pending_.load(std::memory_order_acquire)) {
+      return false;
+    }
+    portENTER_CRITICAL(&lock_);
+    active_ = staged_;
+    pending_.store(false, std::memory_order_relaxed);
+    portEXIT_CRITICAL(&lock_);
+    return true;
+  }
+
+  /// Latest parameters, including staged ones. Any task, e.g. to_json().
+  T get_latest() const {
+    portENTER_CRITICAL(&lock_);
+    T latest = pending_.load(std::memory_order_relaxed) ? staged_ : active_;
+    portEXIT_CRITICAL(&lock_);
+    return latest;
+  }
+
+  /// Stage new parameters for the event loop. Any task, e.g. from_json().
+  void set(const T& params) {
+    portENTER_CRITICAL(&lock_);
+    staged_ = params;
+    pending_.store(true, std::memory_order_release);
+    portEXIT_CRITICAL(&lock_);
+  }
+
+ protected:
+  T active_;
+  T staged_;
+  std::atomic<bool> pending_{false};
+  mutable portMUX_TYPE lock_ = portMUX_INITIALIZER_UNLOCKED;
+};
+
+}  // namespace halmet
+
+#endif  // HALMET_SRC_LIVE_CONFIG_H_
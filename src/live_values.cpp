@@ -0,0 +1,174 @@
+#include "live_values.h"
+
+#include <esp_heap_caps.h>
+
+#include <cmath>
+
+namespace halmet {
+
+LiveValues* live_values = nullptr;
+
+namespace {
+
+// Minimum interval between snapshot renders
+const unsigned int kRenderInterval = 100;  // ms
+
+// Maximum interval between snapshot renders, to keep the ages current
+const unsigned int kMaxRenderInterval = 1000;  // ms
+
+// Interval for logging the request statistics
+const unsigned int kStatsLogInterval = 60000;  // ms
+
+}  // namespace
+
+LiveValues::LiveValues() {
+  const char empty[] = "{\"uptime\":0,\"values\":{}}";
+  memcpy(buffers_[0], empty, sizeof(empty) - 1);
+  lengths_[0] = sizeof(empty) - 1;
+
+  AddProfilerStatistics("/Live values render time", &render_time_);
+  AddProfilerStatistics("/Live values request time", &request_time_);
+
+  sensesp::event_loop()->onRepeat(kRenderInterval, [this]() {
+    if (this->dirty_ || millis() - this->last_render_ >= kMaxRenderInterval) {
+      this->render();
+    }
+  });
+  sensesp::event_loop()->onRepeat(kStatsLogInterval,
+                                  [this]() { this->log_statistics(); });
+}
+
+LiveValues::Channel* LiveValues::add_channel(const char* name,
+                                             const char* units,
+                                             bool is_bool) {
+  if (num_channels_ == kMaxChannels) {
+    debugE("LiveValues: Too many channels");
+    return nullptr;
+  }
+  Channel* channel = &channels_[num_channels_++];
+  channel->name_ = name;
+  channel->units_ = units;
+  channel->is_bool_ = is_bool;
+  channel->owner_ = this;
+  return channel;
+}
+
+sensesp::ValueConsumer<float>* LiveValues::float_channel(const char* name,
+                                                         const char* units) {
+  return add_channel(name, units, false);
+}
+
+sensesp::ValueConsumer<bool>* LiveValues::bool_channel(const char* name) {
+  return add_channel(name, nullptr, true);
+}
+
+void LiveValues::render() {
+  uint32_t start = micros();
+  uint32_t now = millis();
+
+  int back = 1 - front_.load(std::memory_order_relaxed);
+  char* buffer = buffers_[back];
+  // Leave room for the closing braces
+  const size_t capacity = kBufferSize - 2;
+
+  size_t length = snprintf(buffer, capacity, "{\"uptime\":%u,\"values\":{",
+                           (unsigned int)now);
+  for (int i = 0; i < num_channels_; i++) {
+    const Channel& channel = channels_[i];
+
+    char value[24];
+    if (!channel.has_value_ || std::isnan(channel.value_)) {
+      strcpy(value, "null");
+    } else if (channel.is_bool_) {
+      strcpy(value, channel.value_ != 0 ? "true" : "false");
+    } else {
+      snprintf(value, sizeof(value), "%.6g", channel.value_);
+    }
+    char age[12];
+    if (channel.has_value_) {
+      snprintf(age, sizeof(age), "%u",
+               (unsigned int)(now - channel.timestamp_));
+    } else {
+      strcpy(age, "null");
+    }
+
+    int written;
+    if (channel.units_ != nullptr) {
+      written = snprintf(
+          buffer + length, capacity - length,
+          "%s\"%s\":{\"value\":%s,\"units\":\"%s\",\"age\":%s}",
+          i > 0 ? "," : "", channel.name_, value, channel.units_, age);
+    } else {
+      written = snprintf(buffer + length, capacity - length,
+                         "%s\"%s\":{\"value\":%s,\"age\":%s}",
+                         i > 0 ? "," : "", channel.name_, value, age);
+    }
+    if (written < 0 || length + written >= capacity) {
+      if (!overflow_logged_) {
+        debugE("LiveValues: Snapshot buffer too small, increase "
+               "HALMET_LIVE_VALUES_BUFFER_SIZE");
+        overflow_logged_ = true;
+      }
+      break;
+    }
+    length += written;
+  }
+  buffer[length++] = '}';
+  buffer[length++] = '}';
+  lengths_[back] = length;
+
+  front_.store(back, std::memory_order_release);
+  generation_.fetch_add(1, std::memory_order_release);
+
+  dirty_ = false;
+  last_render_ = now;
+  render_time_.add(micros() - start);
+}
+
+esp_err_t LiveValues::handle_request(httpd_req_t* req) {
+  uint32_t start = micros();
+
+  // The next render writes into the buffer that was the front buffer
+  // before the latest swap, so a copy is valid if no swap happened
+  // while it was made.
+  size_t length;
+  uint32_t generation = generation_.load(std::memory_order_acquire);
+  while (true) {
+    int front = front_.load(std::memory_order_acquire);
+    length = lengths_[front];
+    memcpy(send_buffer_, buffers_[front], length);
+    uint32_t current = generation_.load(std::memory_order_acquire);
+    if (current == generation) {
+      break;
+    }
+    generation = current;
+    copy_retries_++;
+  }
+  copy_time_.add(micros() - start);
+
+  httpd_resp_set_type(req, "application/json");
+  esp_err_t result = httpd_resp_send(req, send_buffer_, length);
+  request_time_.add(micros() - start);
+  requests_++;
+  return result;
+}
+
+void LiveValues::add_http_handlers(sensesp::HTTPServer* server) {
+  server->add_handler(new sensesp::HTTPRequestHandler(
+      1 << HTTP_GET, "/api/values",
+      [this](httpd_req_t* req) { return this->handle_request(req); }));
+}
+
+void LiveValues::log_statistics() {
+  debugI("Live values: %u requests (%.2f/s), copy %.0f us, request %.0f us "
+         "average, %u copy retries, render %.0f us average, free heap %u",
+         requests_, requests_ * 1000. / kStatsLogInterval, copy_time_.mean(),
+         request_time_.mean(), copy_retries_, render_time_.mean(),
+         (unsigned int)heap_caps_get_free_size(MALLOC_CAP_8BIT));
+  requests_ = 0;
+  copy_retries_ = 0;
+  copy_time_.reset();
+  request_time_.reset();
+}
+
+}  // namespace halmet
@@ -0,0 +1,110 @@
+#ifndef HALMET_SRC_LIVE_VALUES_H_
+#define HALMET_SRC_LIVE_VALUES_H_
+
+#include <esp_http_server.h>
+
+#include <atomic>
+
+#include "pipeline_profiler.h"
+#include "sensesp/net/http_server.h"
+#include "sensesp/system/valueconsumer.h"
+#include "sensesp_base_app.h"
+
+#ifndef HALMET_LIVE_VALUES_BUFFER_SIZE
+#define HALMET_LIVE_VALUES_BUFFER_SIZE 2048
+#endif
+
+namespace halmet {
+
+/**
+ * @brief Pre-serialized snapshot of the current values, served over HTTP.
+ *
+ * Producers are connected to named channels. Whenever a value has changed,
+ * at most every 100 ms, and at least once per second to refresh the ages,
+ * the snapshot is rendered as JSON into the back one of two fixed-size
+ * buffers, which then becomes the front buffer:
+ *
+ *   {"uptime": 123456, "values": {
+ *     "tank_a1_level": {"value": 0.52, "units": "ratio", "age": 340}, ...}}
+ *
+ * "age" is the time in ms from the latest update of the channel to the
+ * rendering of the snapshot. Values not yet received are null.
+ *
+ * A request to /api/values copies the front buffer and sends it; no JSON
+ * is built and nothing is allocated per request. The HTTP server runs in
+ * its own task, so the copy is repeated if the buffers were swapped while
+ * it was in progress.
+ */
+class LiveValues {
+ public:
+  static const int kMaxChannels = 32;
+  static const size_t kBufferSize = HALMET_LIVE_VALUES_BUFFER_SIZE;
+
+  LiveValues();
+
+  /// Get the consumer feeding a numeric channel. Name and units must be
+  /// string literals or otherwise outlive the object.
+  sensesp::ValueConsumer<float>* float_channel(const char* name,
+                                               const char* units);
+
+  /// Get the consumer feeding a boolean channel.
+  sensesp::ValueConsumer<bool>* bool_channel(const char* name);
+
+  void add_http_handlers(sensesp::HTTPServer* server);
+
+ protected:
+  class Channel : public sensesp::ValueConsumer<float>,
+                  public sensesp::ValueConsumer<bool> {
+   public:
+    void set(const float& value) override { update(value); }
+    void set(const bool& value) override { update(value); }
+
+    const char* name_ = nullptr;
+    const char* units_ = nullptr;
+    bool is_bool_ = false;
+    bool has_value_ = false;
+    float value_ = 0;
+    uint32_t timestamp_ = 0;
+    LiveValues* owner_ = nullptr;
+
+   protected:
+    void update(float value) {
+      value_ = value;
+      timestamp_ = millis();
+      has_value_ = true;
+      owner_->dirty_ = true;
+    }
+  };
+
+  Channel* add_channel(const char* name, const char* units, bool is_bool);
+  void render();
+  esp_err_t handle_request(httpd_req_t* req);
+  void log_statistics();
+
+  Channel channels_[kMaxChannels];
+  int num_channels_ = 0;
+  bool dirty_ = true;
+  uint32_t last_render_ = 0;
+  bool overflow_logged_ = false;
+
+  char buffers_[2][kBufferSize];
+  size_t lengths_[2] = {0, 0};
+  std::atomic<int> front_{0};
+  std::atomic<uint32_t> generation_{0};
+
+  // Only used by the HTTP server task
+  char send_buffer_[kBufferSize];
+
+  RunningStatistics render_time_;   // us
+  RunningStatistics copy_time_;     // us
+  RunningStatistics request_time_;  // us
+  uint32_t requests_ = 0;
+  uint32_t copy_retries_ = 0;
+};
+
+/// Global live values instance. Null if live values are not enabled.
+extern LiveValues* live_values;
+
+}  // namespace halmet
+
+#endif  // HALMET_SRC_LIVE_VALUES_H_
@@ -11,12 +11,13 @@
 #include <Adafruit_ADS1X15.h>
 #include <Adafruit_GFX.h>
 #include <Adafruit_SSD1306.h>
+#include <SPIFFS.h>
 
 #ifdef ENABLE_NMEA2000_OUTPUT
 #include <NMEA2000_esp32.h>
 #endif
 
-#include "n2k_senders.h"
+#include "n2k_multi_senders.h"
 #include "sensesp/net/discovery.h"
 #include "sensesp/sensors/analog_input.h"
 #include "sensesp/sensors/digital_input.h"
@@ -35,11 +36,28 @@
 #include "sensesp_minimal_app_builder.h"
 #endif
 
+#include "flight_recorder.h"
+#include "ads1115_scanner.h"
+#include "boot_timeline.h"
+#include "comparator_alarm.h"
+#include "deferred_log.h"
 #include "halmet_analog.h"
 #include "halmet_const.h"
 #include "halmet_digital.h"
 #include "halmet_display.h"
 #include "halmet_serial.h"
+#include "isr_latency_monitor.h"
+#include "live_values.h"
+#include "n2k_source_address.h"
+#include "pipeline_profiler.h"
+#include "power_manager.h"
+#include "ripple_analyzer.h"
+#include "sample_age.h"
+#include "setup_arena.h"
+#include "telemetry_stream.h"
+#include "trace_replay.h"
+#include "transform_benchmark.h"
+#include "window_statistics.h"
 #include "sensesp/net/http_server.h"
 #include "sensesp/net/networking.h"
 
@@ -67,6 +85,10 @@ elapsedMillis n2k_time_since_tx = 0;
 TwoWire* i2c;
 Adafruit_SSD1306* display;
 
+#ifdef ENABLE_TELEMETRY_STREAM
+TelemetryStream* telemetry;
+#endif
+
 // Store alarm states in an array for local display output
 bool alarm_states[4] = {false, false, false, false};
 
@@ -96,21 +118,48 @@ const int kTestOutputPin = GPIO_NUM_33;
 const int kTestOutputFrequency = 380;
 #endif
 
-/////////////////////////////////////////////////////////////////////
-// The setup function performs one-time application initialization.
-void setup() {
-  SetupLogging(ESP_LOG_DEBUG);
-
-  // These calls can be used for fine-grained control over the logging level.
-  // esp_log_level_set("*", esp_log_level_t::ESP_LOG_DEBUG);
+#ifdef ENABLE_COMPARATOR_ALARMS
+// GPIO connected to the ALERT/RDY pin of the converter used for the
+// comparator alarms.
+// EDIT: Change this to match your wiring.
+const int kComparatorAlertPin = GPIO_NUM_32;
+#endif
 
-  Serial.begin(115200);
+#ifdef ENABLE_NMEA2000_OUTPUT
+// Number of engines and tanks sent over NMEA 2000
+// EDIT: Change these to match the tachos and tanks connected below.
+const size_t kNumEngines = 1;
+const size_t kNumTanks = 1;
+
+#ifdef ENABLE_JIT_SAMPLING
+// Time between requesting a tank sample and its transmission. Covers the
+// conversions queued on the ADS1115 and the processing.
+const unsigned int kTankSampleLeadTime = 50;  // ms
+// The tacho pulses are counted over this many rapid update rounds (500 ms)
+// and read at the start of the round sending them.
+const unsigned int kTachoCountRounds = 5;
+#endif
+#endif
 
-  /////////////////////////////////////////////////////////////////////
-  // Initialize the application framework
+// Delay from the end of setup() to starting the network stack. This gives
+// the NMEA 2000 address claim and the first rapid update messages time to
+// go out before the WiFi initialization blocks the event loop.
+const unsigned int kNetworkStartDelay = 300;  // ms
 
-  // Construct the global SensESPApp() object
-  BUILDER_CLASS builder;
+/////////////////////////////////////////////////////////////////////
+// Second boot stage: start the application framework with WiFi, Signal K
+// and the web UI, and initialize the display. Runs from the event loop
+// after the inputs and the NMEA 2000 senders are already running.
+//
+// The stage is split into steps, each run in an event loop round of its
+// own, so that the NMEA 2000 senders and the CAN receive queue are
+// serviced in between instead of waiting for the whole stage.
+
+// Construct the application framework, which starts WiFi
+void StartNetwork() {
+  // Construct the global SensESPApp() object. The builder is static so that
+  // it lives for the whole runtime, like the app it builds.
+  static BUILDER_CLASS builder;
   sensesp_app = (&builder)
                     // EDIT: Set a custom hostname for the app.
                     ->set_hostname("halmet")
@@ -122,17 +171,159 @@ void setup() {
                     //->enable_ota("my_ota_password")
                     ->get_app();
 
+#ifndef ENABLE_SIGNALK
+  // Initialize components that would normally be present in SensESPApp
+  networking = new Networking("/System/WiFi Settings", "", "");
+  ConfigItem(networking);
+#endif
+
+  BootTimelineMark("Network stack started");
+}
+
+// Start the web server and register the HTTP handlers of the diagnostic
+// components
+void StartWebServer() {
+#ifndef ENABLE_SIGNALK
+  mdns_discovery = new MDNSDiscovery();
+  http_server = new HTTPServer();
+  system_status_led = new SystemStatusLed(LED_BUILTIN);
+#endif
+
+#ifdef ENABLE_PIPELINE_PROFILER
+#ifdef ENABLE_SIGNALK
+  pipeline_profiler->add_http_handlers(sensesp_app->get_http_server().get());
+#else
+  pipeline_profiler->add_http_handlers(http_server);
+#endif
+#endif
+
+#ifdef ENABLE_FLIGHT_RECORDER
+#ifdef ENABLE_SIGNALK
+  flight_recorder->add_http_handlers(sensesp_app->get_http_server().get());
+#else
+  flight_recorder->add_http_handlers(http_server);
+#endif
+#endif
+
+#ifdef ENABLE_TRACE_REPLAY
+#ifdef ENABLE_SIGNALK
+  trace_replay->add_http_handlers(sensesp_app->get_http_server().get());
+#else
+  trace_replay->add_http_handlers(http_server);
+#endif
+#endif
+
+#ifdef ENABLE_LIVE_VALUES
+#ifdef ENABLE_SIGNALK
+  live_values->add_http_handlers(sensesp_app->get_http_server().get());
+#else
+  live_values->add_http_handlers(http_server);
+#endif
+#endif
+
+  BootTimelineMark("Web server started");
+}
+
+// Initialize the OLED display and connect the outputs to it
+void StartDisplay() {
+  bool display_present = InitializeSSD1306(sensesp_app.get(), &display, i2c);
+
+  if (display_present) {
+#ifdef ENABLE_SIGNALK
+    event_loop()->onRepeat(1000, []() {
+      PrintValue(display, 1, "IP:", WiFi.localIP().toString());
+    });
+#endif
+
+#ifdef ENABLE_POWER_MANAGEMENT
+    power_manager->connect_to(ArenaNew<LambdaConsumer<bool>>(
+        [](bool low_power) { SetDisplayPower(display, !low_power); }));
+#endif
+
+    // Create a poor man's "christmas tree" display for the alarms
+    event_loop()->onRepeat(1000, []() {
+      char state_string[5] = {};
+      for (int i = 0; i < 4; i++) {
+        state_string[i] = alarm_states[i] ? '*' : '_';
+      }
+      PrintValue(display, 4, "Alarm", state_string);
+    });
+  }
+
+  BootTimelineMark("Display set up");
+
+#ifdef ENABLE_SETUP_ARENA
+  ArenaUsage arena_usage = GetArenaUsage();
+  debugI("Setup arena: %u of %u bytes used by %u objects, "
+         "%u objects (%u bytes) on the heap",
+         arena_usage.used, arena_usage.capacity, arena_usage.allocations,
+         arena_usage.heap_fallbacks, arena_usage.heap_fallback_bytes);
+#endif
+}
+
+void (*const kNetworkAndDisplaySteps[])() = {StartNetwork, StartWebServer,
+                                            StartDisplay};
+
+void StartNetworkAndDisplay(size_t step = 0) {
+  kNetworkAndDisplaySteps[step]();
+  if (step + 1 < sizeof(kNetworkAndDisplaySteps) /
+                     sizeof(kNetworkAndDisplaySteps[0])) {
+    event_loop()->onDelay(0, [step]() { StartNetworkAndDisplay(step + 1); });
+  }
+}
+
+/////////////////////////////////////////////////////////////////////
+// The setup function performs one-time application initialization.
+void setup() {
+  SetupLogging(ESP_LOG_DEBUG);
+
+  // These calls can be used for fine-grained control over the logging level.
+  // esp_log_level_set("*", esp_log_level_t::ESP_LOG_DEBUG);
+
+#ifdef ENABLE_DEFERRED_LOG
+  // Format the deferredD() and similar messages in a background task
+  StartDeferredLog();
+#endif
+
+  Serial.begin(115200);
+  BootTimelineMark("setup() entered");
+
+  // The NMEA 2000 senders and the input pipelines are started before the
+  // network stack, so that engine data reaches the bus as early as possible.
+  // Their configuration is loaded from the filesystem, which SensESPApp
+  // would only mount when constructed, so mount it here already.
+  SPIFFS.begin(true);
+  BootTimelineMark("Filesystem mounted");
+
   // initialize the I2C bus
-  i2c = new TwoWire(0);
+  i2c = ArenaNew<TwoWire>(0);
   i2c->begin(kSDAPin, kSCLPin);
 
-  // Initialize ADS1115
-  auto ads1115 = new Adafruit_ADS1115();
+  // Initialize the ADS1115 converters. The HALMET analog inputs A1-A4 are
+  // inputs 0-3 of the scanner.
+  auto ads1115 = ArenaNew<ADS1115Scanner>(i2c, kADS1115Gain);
 
-  ads1115->setGain(kADS1115Gain);
-  bool ads_initialized = ads1115->begin(kADS1115Address, i2c);
+  bool ads_initialized = ads1115->add_converter(kADS1115Address) >= 0;
   debugD("ADS1115 initialized: %d", ads_initialized);
 
+  // EDIT: Uncomment to add converters on an expansion board. The converters
+  // at 0x48, 0x49 and 0x4a provide inputs 4-7, 8-11 and 12-15, also if
+  // another converter is missing. Conversions on different converters run
+  // in parallel.
+  // for (int address : kADS1115ExpansionAddresses) {
+  //   ads1115->add_converter(address);
+  // }
+
+#ifdef ENABLE_COMPARATOR_ALARMS
+  // The comparator alarms take over a converter of their own. If you
+  // uncommented the loop above, use the input numbers it assigned instead of
+  // adding the converter again:
+  //   int comparator_inputs = ADS1115Scanner::first_input(
+  //       kADS1115ExpansionAddresses[0]);
+  int comparator_inputs =
+      ads1115->add_converter(kADS1115ExpansionAddresses[0]);
+#endif
+
 #ifdef ENABLE_TEST_OUTPUT_PIN
   pinMode(kTestOutputPin, OUTPUT);
   // Set the LEDC peripheral to a 13-bit resolution
@@ -149,7 +340,7 @@ void setup() {
   /////////////////////////////////////////////////////////////////////
   // Initialize NMEA 2000 functionality
 
-  nmea2000 = new tNMEA2000_esp32(kCANTxPin, kCANRxPin);
+  nmea2000 = ArenaNew<tNMEA2000_esp32>(kCANTxPin, kCANRxPin);
 
   // Reserve enough buffer for sending all messages.
   nmea2000->SetN2kCANSendFrameBufSize(250);
@@ -180,27 +371,103 @@ void setup() {
       50,                      // Device class: Propulsion
       2046);                   // Manufacturer code
 
-  nmea2000->SetMode(tNMEA2000::N2km_NodeOnly,
-                    71  // Default N2k node address
-  );
+  // Start with the source address claimed last time
+  auto n2k_source_address = ArenaNew<N2kSourceAddress>(
+      "/NMEA 2000/Source Address", 71);  // Default N2k node address
+
+  nmea2000->SetMode(tNMEA2000::N2km_NodeOnly, n2k_source_address->get());
   nmea2000->EnableForward(false);
   nmea2000->Open();
+  n2k_source_address->watch(nmea2000);
+  BootTimelineMark("NMEA 2000 opened");
+
+  // Use the cached PGN encoders if they match the library encoding
+  VerifyN2kEncoders();
 
   // No need to parse the messages at every single loop iteration; 1 ms will do
   event_loop()->onRepeat(1, []() { nmea2000->ParseMessages(); });
 #endif  // ENABLE_NMEA2000_OUTPUT
 
-#ifndef ENABLE_SIGNALK
-  // Initialize components that would normally be present in SensESPApp
-  networking = new Networking("/System/WiFi Settings", "", "");
-  ConfigItem(networking);
-  mdns_discovery = new MDNSDiscovery();
-  http_server = new HTTPServer();
-  system_status_led = new SystemStatusLed(LED_BUILTIN);
+#ifdef ENABLE_PIPELINE_PROFILER
+  // Collect pipeline timing and load statistics. The report is available
+  // at http://halmet.local/api/profile.
+  pipeline_profiler = ArenaNew<PipelineProfiler>();
+#endif  // ENABLE_PIPELINE_PROFILER
+
+#ifdef ENABLE_ISR_LATENCY_MONITOR
+  // Count interrupt latency outliers of IRAM and flash interrupt handlers
+  // while the flash is being written
+  ArenaNew<IsrLatencyMonitor>();
 #endif
 
-  // Initialize the OLED display
-  bool display_present = InitializeSSD1306(sensesp_app.get(), &display, i2c);
+#ifdef ENABLE_TRANSFORM_BENCHMARK
+  // Compare dynamic and fused transform chains and the library and cached
+  // PGN encoders once the system has settled
+  event_loop()->onDelay(5000, []() {
+    RunTransformBenchmark();
+    RunN2kEncoderBenchmark();
+  });
+#endif
+
+#ifdef ENABLE_FLIGHT_RECORDER
+  // Record raw samples and alarm edges. Recordings frozen by a trigger event
+  // can be downloaded from http://halmet.local/api/recorder.
+  flight_recorder = ArenaNew<FlightRecorder>("/Flight Recorder");
+
+  ConfigItem(flight_recorder)
+      ->set_title("Flight Recorder")
+      ->set_description("Raw sample recorder trigger settings")
+      ->set_sort_order(4000);
+#endif  // ENABLE_FLIGHT_RECORDER
+
+#ifdef ENABLE_TRACE_REPLAY
+  // Replay recorded traces through the pipelines. Upload a trace to
+  // /api/replay/trace, start it with /api/replay/start and download the
+  // captured outputs from /api/replay/output.
+  trace_replay = ArenaNew<TraceReplay>();
+#endif  // ENABLE_TRACE_REPLAY
+
+#ifdef ENABLE_LIVE_VALUES
+  // Snapshot of all current values, served at http://halmet.local/api/values
+  live_values = ArenaNew<LiveValues>();
+#endif
+
+#ifdef ENABLE_TELEMETRY_STREAM
+  // Binary UDP telemetry stream for high-rate diagnostics. Decode the stream
+  // with tools/telemetry_decode.py.
+  telemetry = ArenaNew<TelemetryStream>("/Telemetry Stream");
+
+  ConfigItem(telemetry)
+      ->set_title("Telemetry Stream")
+      ->set_description("Binary UDP multicast stream of the raw values")
+      ->set_sort_order(4010);
+#endif
+
+#ifdef ENABLE_POWER_MANAGEMENT
+  // Enter low-power mode when the engine has been off for a while. Tacho
+  // pulses, alarm changes and engine speeds from other devices on the
+  // NMEA 2000 bus restore full power.
+  power_manager = ArenaNew<PowerManager>("/Power Management");
+
+  ConfigItem(power_manager)
+      ->set_title("Power Management")
+      ->set_description("Engine-off low-power mode settings")
+      ->set_sort_order(4020);
+
+  // EDIT: Add the pins of all tacho and alarm inputs defined below.
+  power_manager->add_wakeup_pin((gpio_num_t)kDigitalInputPin1,
+                                PowerManager::WakeSource::kTacho);
+  power_manager->add_wakeup_pin((gpio_num_t)kDigitalInputPin2,
+                                PowerManager::WakeSource::kAlarm);
+  power_manager->add_wakeup_pin((gpio_num_t)kDigitalInputPin3,
+                                PowerManager::WakeSource::kAlarm);
+
+#ifdef ENABLE_NMEA2000_OUTPUT
+  power_manager->add_wakeup_pin(kCANRxPin, PowerManager::WakeSource::kCAN);
+  nmea2000->SetMsgHandler(
+      [](const tN2kMsg& msg) { power_manager->handle_can_message(msg); });
+#endif
+#endif  // ENABLE_POWER_MANAGEMENT
 
   ///////////////////////////////////////////////////////////////////
   // Analog inputs
@@ -213,59 +480,144 @@ void setup() {
 
   // Connect the tank senders.
   // EDIT: To enable more tanks, uncomment the lines below.
-  auto tank_a1_volume = ConnectTankSender(ads1115, 0, "Fuel", "fuel.main", 3000,
-                                          enable_signalk_output);
-  // auto tank_a2_volume = ConnectTankSender(ads1115, 1, "A2");
-  // auto tank_a3_volume = ConnectTankSender(ads1115, 2, "A3");
-  // auto tank_a4_volume = ConnectTankSender(ads1115, 3, "A4");
+  auto tank_a1 = ConnectTankSender(ads1115, 0, "Fuel", "fuel.main", 3000,
+                                   enable_signalk_output);
+  auto tank_a1_volume = tank_a1.level;
+  // auto tank_a2_volume = ConnectTankSender(ads1115, 1, "A2").level;
+  // auto tank_a3_volume = ConnectTankSender(ads1115, 2, "A3").level;
+  // auto tank_a4_volume = ConnectTankSender(ads1115, 3, "A4").level;
 
 #ifdef ENABLE_NMEA2000_OUTPUT
-  // Tank 1, instance 0. Capacity 200 liters. You can change the capacity
-  // in the web UI as well.
-  // EDIT: Make sure this matches your tank configuration above.
-  N2kFluidLevelSender* tank_a1_sender = new N2kFluidLevelSender(
-      "/Tanks/Fuel/NMEA 2000", 0, N2kft_Fuel, 200, nmea2000);
-
-  ConfigItem(tank_a1_sender)
-      ->set_title("Tank A1 NMEA 2000")
-      ->set_description("NMEA 2000 tank sender for tank A1")
+  // All tanks are sent by one sender. By default, tank n has instance n-1
+  // and a capacity of 200 liters. The instances, types and capacities can
+  // be changed in the web UI.
+  // EDIT: Make sure kNumTanks matches your tank configuration above.
+  auto tank_sender = ArenaNew<N2kFluidLevelMultiSender<kNumTanks>>(
+      "/Tanks/NMEA 2000", N2kft_Fuel, 200, nmea2000);
+
+  ConfigItem(tank_sender)
+      ->set_title("Tanks NMEA 2000")
+      ->set_description("NMEA 2000 fluid level sender for all tanks")
       ->set_sort_order(3005);
 
-  tank_a1_volume->connect_to(&(tank_a1_sender->tank_level_));
+  tank_a1_volume->connect_to(&(tank_sender->tank(0).tank_level_));
+  tank_a1.sender_fault->connect_to(&(tank_sender->tank(0).sender_fault_));
+
+#ifdef ENABLE_JIT_SAMPLING
+  // Sample the tank senders just before their levels are sent
+  auto tank_a1_voltage = tank_a1.sender_voltage;
+  tank_a1_voltage->set_triggered();
+  tank_sender->add_acquisition(
+      [tank_a1_voltage]() { tank_a1_voltage->sample(); }, kTankSampleLeadTime);
+#endif
 #endif  // ENABLE_NMEA2000_OUTPUT
 
-  if (display_present) {
-    // EDIT: Duplicate the lines below to make the display show all your tanks.
-    tank_a1_volume->connect_to(new LambdaConsumer<float>(
-        [](float value) { PrintValue(display, 2, "Tank A1", 100 * value); }));
-  }
+  // The display is initialized later; values are dropped until then.
+  // EDIT: Duplicate the lines below to make the display show all your tanks.
+  tank_a1_volume->connect_to(ArenaNew<LambdaConsumer<float>>(
+      [](float value) { PrintValue(display, 2, "Tank A1", 100 * value); }));
+
+#ifdef ENABLE_TELEMETRY_STREAM
+  // EDIT: Each telemetry channel needs a unique channel number.
+  tank_a1_volume->connect_to(telemetry->channel(2));
+#endif
+
+#ifdef ENABLE_TRACE_REPLAY
+  tank_a1_volume->connect_to(trace_replay->capture("tank_a1_level"));
+#endif
+
+#ifdef ENABLE_LIVE_VALUES
+  // EDIT: Add a channel for every value you want in the snapshot.
+  tank_a1_volume->connect_to(
+      live_values->float_channel("tank_a1_level", "ratio"));
+  tank_a1.volume->connect_to(
+      live_values->float_channel("tank_a1_volume", "m3"));
+#endif
+
+#ifdef ENABLE_WINDOW_STATISTICS
+  ConnectWindowStatistics(tank_a1_volume, "Tank A1 Level 15 min",
+                          "tanks.fuel.main.currentLevelStatistics.15m",
+                          "ratio", 15 * 60, 3100);
+#endif
 
   // Read the voltage level of analog input A2
-  auto a2_voltage = new ADS1115VoltageInput(ads1115, 1, "/Voltage A2");
+  auto a2_voltage = ArenaNew<ADS1115VoltageInput>(ads1115, 1, "/Voltage A2");
 
   ConfigItem(a2_voltage)
       ->set_title("Analog Voltage A2")
       ->set_description("Voltage level of analog input A2")
       ->set_sort_order(3000);
 
-  a2_voltage->connect_to(new LambdaConsumer<float>(
-      [](float value) { debugD("Voltage A2: %f", value); }));
+  a2_voltage->connect_to(ArenaNew<LambdaConsumer<float>>(
+      [](float value) { deferredD("Voltage A2: %f", value); }));
+
+#ifdef ENABLE_TELEMETRY_STREAM
+  a2_voltage->connect_to(telemetry->channel(1));
+#endif
+
+#ifdef ENABLE_TRACE_REPLAY
+  a2_voltage->connect_to(trace_replay->capture("a2_voltage"));
+#endif
+
+#ifdef ENABLE_LIVE_VALUES
+  a2_voltage->connect_to(live_values->float_channel("a2_voltage", "V"));
+#endif
+
+#ifdef ENABLE_WINDOW_STATISTICS
+  // EDIT: Add statistics of other values by duplicating these lines. Each
+  // call creates Signal K outputs for the minimum, maximum, mean, standard
+  // deviation and rate of change.
+  ConnectWindowStatistics(a2_voltage, "Voltage A2 1 min",
+                          "sensors.a2.voltageStatistics.1m", "V", 60, 3110);
+  ConnectWindowStatistics(a2_voltage, "Voltage A2 15 min",
+                          "sensors.a2.voltageStatistics.15m", "V", 15 * 60,
+                          3120);
+#endif
+
+#ifdef ENABLE_RIPPLE_ANALYSIS
+  // EDIT: Connect the input measuring the alternator output or the battery
+  // being charged.
+  auto ripple_analyzer = ConnectRippleAnalyzer(a2_voltage, "Voltage A2",
+                                               "sensors.a2.ripple", 3150);
+  // EDIT: Pause any other devices on the I2C bus during the bursts.
+  ripple_analyzer->capturing_.connect_to(ArenaNew<LambdaConsumer<bool>>(
+      [](bool capturing) { SetDisplayPaused(display, capturing); }));
+#endif
 
   // If you want to output something else than the voltage value,
   // you can insert a suitable transform here.
   // For example, to convert the voltage to a distance with a conversion
   // factor of 0.17 m/V, you could use the following code:
-  // auto a2_distance = new Linear(0.17, 0.0);
+  // auto a2_distance = ArenaNew<Linear>(0.17, 0.0);
   // a2_voltage->connect_to(a2_distance);
 
 #ifdef ENABLE_SIGNALK
   a2_voltage->connect_to(
-      new SKOutputFloat("sensors.a2.voltage", "Analog Voltage A2",
-                        new SKMetadata("V","Analog Voltage A2")));
+      ArenaNew<SKOutputFloat>("sensors.a2.voltage", "Analog Voltage A2",
+                              new SKMetadata("V","Analog Voltage A2")));
+  if (pipeline_profiler != nullptr) {
+    a2_voltage->connect_to(
+        ArenaNew<PipelineAgeProbe<float>>("/Voltage A2 SK pipeline age"));
+  }
   // Example of how to output the distance value to Signal K.
   // a2_distance->connect_to(
-  //     new SKOutputFloat("sensors.a2.distance", "Analog Distance A2",
-  //                       new SKMetadata("m", "Analog Distance A2")));
+  //     ArenaNew<SKOutputFloat>("sensors.a2.distance", "Analog Distance A2",
+  //                             new SKMetadata("m", "Analog Distance A2")));
+#endif
+
+#ifdef ENABLE_COMPARATOR_ALARMS
+  ///////////////////////////////////////////////////////////////////
+  // Comparator alarms
+
+  // EDIT: Connect the battery to the first input of the comparator
+  // converter. The alarm is raised below 11.5 V; the high threshold is above
+  // the input range and never reached.
+  BoolProducer* low_voltage_alarm = nullptr;
+  if (comparator_inputs >= 0) {
+    low_voltage_alarm =
+        ConnectComparatorAlarm(ads1115, comparator_inputs, kComparatorAlertPin,
+                               "LowVoltage", 11.5, 100, 3140);
+  }
 #endif
 
   ///////////////////////////////////////////////////////////////////
@@ -277,35 +629,62 @@ void setup() {
   auto alarm_d3_input = ConnectAlarmSender(kDigitalInputPin3, "D3");
   // auto alarm_d4_input = ConnectAlarmSender(kDigitalInputPin4, "D4");
 
+#ifdef ENABLE_LIVE_VALUES
+  alarm_d2_input->connect_to(live_values->bool_channel("alarm_d2"));
+  alarm_d3_input->connect_to(live_values->bool_channel("alarm_d3"));
+#endif
+
+#ifdef ENABLE_POWER_MANAGEMENT
+  alarm_d2_input->connect_to(power_manager->alarm_input());
+  alarm_d3_input->connect_to(power_manager->alarm_input());
+#endif
+
   // Update the alarm states based on the input value changes.
   // EDIT: If you added more alarm inputs, uncomment the respective lines below.
-  alarm_d2_input->connect_to(
-      new LambdaConsumer<bool>([](bool value) { alarm_states[1] = value; }));
+  alarm_d2_input->connect_to(ArenaNew<LambdaConsumer<bool>>(
+      [](bool value) { alarm_states[1] = value; }));
   // In this example, alarm_d3_input is active low, so invert the value.
   auto alarm_d3_inverted = alarm_d3_input->connect_to(
-      new LambdaTransform<bool, bool>([](bool value) { return !value; }));
-  alarm_d3_inverted->connect_to(
-      new LambdaConsumer<bool>([](bool value) { alarm_states[2] = value; }));
-  // alarm_d4_input->connect_to(
-  //     new LambdaConsumer<bool>([](bool value) { alarm_states[3] = value; }));
+      ArenaNew<LambdaTransform<bool, bool>>([](bool value) { return !value; }));
+  alarm_d3_inverted->connect_to(ArenaNew<LambdaConsumer<bool>>(
+      [](bool value) { alarm_states[2] = value; }));
+  // alarm_d4_input->connect_to(ArenaNew<LambdaConsumer<bool>>(
+  //     [](bool value) { alarm_states[3] = value; }));
 
 #ifdef ENABLE_NMEA2000_OUTPUT
   // EDIT: This example connects the D2 alarm input to the low oil pressure
   // warning. Modify according to your needs.
-  N2kEngineParameterDynamicSender* engine_dynamic_sender =
-      new N2kEngineParameterDynamicSender("/NMEA 2000/Engine 1 Dynamic", 0,
-                                          nmea2000);
+  auto engine_dynamic_sender =
+      ArenaNew<N2kEngineParameterDynamicMultiSender<kNumEngines>>(
+          "/NMEA 2000/Engines Dynamic", nmea2000);
 
   ConfigItem(engine_dynamic_sender)
-      ->set_title("Engine 1 Dynamic")
-      ->set_description("NMEA 2000 dynamic engine parameters for engine 1")
+      ->set_title("Engines Dynamic")
+      ->set_description("NMEA 2000 dynamic engine parameters for all engines")
       ->set_sort_order(3010);
 
-  alarm_d2_input->connect_to(engine_dynamic_sender->low_oil_pressure_);
+  auto& engine_1_dynamic = engine_dynamic_sender->engine(0);
+
+  alarm_d2_input->connect_to(&engine_1_dynamic.low_oil_pressure_);
 
   // This is just an example -- normally temperature alarms would not be
   // active-low (inverted).
-  alarm_d3_inverted->connect_to(engine_dynamic_sender->over_temperature_);
+  alarm_d3_inverted->connect_to(&engine_1_dynamic.over_temperature_);
+
+  // EDIT: The fuel rate estimated from the A1 tank level is reported as the
+  // engine fuel rate. Remove this if the tank feeds more than one engine.
+  tank_a1.fuel_rate
+      ->connect_to(ArenaNew<LambdaTransform<float, double>>([](float rate) {
+        // m3/s to l/h; NaN while the fuel rate is not available
+        return std::isnan(rate) ? N2kDoubleNA : rate * 3600. * 1000.;
+      }))
+      ->connect_to(&engine_1_dynamic.fuel_rate_);
+
+#ifdef ENABLE_COMPARATOR_ALARMS
+  if (low_voltage_alarm != nullptr) {
+    low_voltage_alarm->connect_to(&engine_1_dynamic.low_system_voltage_);
+  }
+#endif
 #endif  // ENABLE_NMEA2000_OUTPUT
 
   // FIXME: Transmit the alarms over SK as well.
@@ -314,52 +693,70 @@ void setup() {
   // Digital tacho inputs
 
   // Connect the tacho senders. Engine name is "main".
-  // EDIT: More tacho inputs can be defined by duplicating the line below.
-  auto tacho_d1_frequency = ConnectTachoSender(kDigitalInputPin1, "main");
+  // EDIT: More tacho inputs can be defined by duplicating the lines below.
+  auto tacho_d1 = ConnectTachoSender(kDigitalInputPin1, "main");
+  auto tacho_d1_frequency = tacho_d1.frequency;
+
+#ifdef ENABLE_TELEMETRY_STREAM
+  tacho_d1_frequency->connect_to(telemetry->channel(0));
+#endif
+
+#ifdef ENABLE_TRACE_REPLAY
+  tacho_d1_frequency->connect_to(trace_replay->capture("tacho_d1_frequency"));
+#endif
+
+#ifdef ENABLE_LIVE_VALUES
+  tacho_d1_frequency->connect_to(
+      live_values->float_channel("tacho_d1_frequency", "Hz"));
+#endif
+
+#ifdef ENABLE_POWER_MANAGEMENT
+  tacho_d1_frequency->connect_to(power_manager->tacho_input());
+#endif
+
+#ifdef ENABLE_WINDOW_STATISTICS
+  ConnectWindowStatistics(tacho_d1_frequency, "Tacho D1 1 min",
+                          "propulsion.main.revolutionsStatistics.1m", "Hz",
+                          60, 3130);
+#endif
 
 #ifdef ENABLE_NMEA2000_OUTPUT
-  // Connect outputs to the N2k senders.
+  // Connect outputs to the N2k senders. By default, engine n has instance
+  // n-1; the instances can be changed in the web UI.
   // EDIT: Make sure this matches your tacho configuration above.
-  //       Duplicate the lines below to connect more tachos, but be sure to
-  //       use different engine instances.
-  N2kEngineParameterRapidSender* engine_rapid_sender =
-      new N2kEngineParameterRapidSender("/NMEA 2000/Engine 1 Rapid Update", 0,
-                                        nmea2000);  // Engine 1, instance 0
+  //       To connect more tachos, increase kNumEngines and connect them
+  //       to engine(1), engine(2) and so on.
+  auto engine_rapid_sender =
+      ArenaNew<N2kEngineParameterRapidMultiSender<kNumEngines>>(
+          "/NMEA 2000/Engines Rapid Update", nmea2000);
 
   ConfigItem(engine_rapid_sender)
-      ->set_title("Engine 1 Rapid Update")
-      ->set_description("NMEA 2000 rapid update engine parameters for engine 1")
+      ->set_title("Engines Rapid Update")
+      ->set_description("NMEA 2000 rapid update engine parameters")
       ->set_sort_order(3015);
 
-  tacho_d1_frequency->connect_to(&(engine_rapid_sender->engine_speed_));
+  tacho_d1_frequency->connect_to(
+      &(engine_rapid_sender->engine(0).engine_speed_));
 
+#ifdef ENABLE_JIT_SAMPLING
+  // Read the pulse counts right before the engine speeds are sent
+  auto tacho_d1_counter = tacho_d1.counter;
+  tacho_d1_counter->set_triggered();
+  engine_rapid_sender->add_acquisition(
+      [tacho_d1_counter]() { tacho_d1_counter->sample(); }, 0,
+      kTachoCountRounds);
+#endif
 #endif  // ENABLE_NMEA2000_OUTPUT
 
-  if (display_present) {
-    tacho_d1_frequency->connect_to(new LambdaConsumer<float>(
-        [](float value) { PrintValue(display, 3, "RPM D1", 60 * value); }));
-  }
+  tacho_d1_frequency->connect_to(ArenaNew<LambdaConsumer<float>>(
+      [](float value) { PrintValue(display, 3, "RPM D1", 60 * value); }));
 
-  ///////////////////////////////////////////////////////////////////
-  // Display setup
+  BootTimelineMark("Inputs and NMEA 2000 senders started");
 
-  // Connect the outputs to the display
-  if (display_present) {
-#ifdef ENABLE_SIGNALK
-    event_loop()->onRepeat(1000, []() {
-      PrintValue(display, 1, "IP:", WiFi.localIP().toString());
-    });
-#endif
-
-    // Create a poor man's "christmas tree" display for the alarms
-    event_loop()->onRepeat(1000, []() {
-      char state_string[5] = {};
-      for (int i = 0; i < 4; i++) {
-        state_string[i] = alarm_states[i] ? '*' : '_';
-      }
-      PrintValue(display, 4, "Alarm", state_string);
-    });
-  }
+  // Bring up the network and the display once the first NMEA 2000
+  // messages have been sent.
+  event_loop()->onDelay(kNetworkStartDelay,
+                        []() { StartNetworkAndDisplay(); });
 
   // To avoid garbage collecting all shared pointers created in setup(),
   // loop from here.
@@ -368,4 +765,12 @@ void setup() {
   }
 }
 
-void loop() { event_loop()->tick(); }
+void loop() {
+#ifdef ENABLE_PIPELINE_PROFILER
+  uint32_t tick_start = micros();
+  event_loop()->tick();
+  pipeline_profiler->add_tick_time(micros() - tick_start);
+#else
+  event_loop()->tick();
+#endif
+}
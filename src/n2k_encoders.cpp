@@ -0,0 +1,229 @@
+#include "n2k_encoders.h"
+
+#include "pipeline_profiler.h"
+#include "sensesp_base_app.h"
+
+namespace halmet {
+
+bool n2k_encoders_verified = false;
+
+namespace {
+
+// Messages per timed batch and number of batches per encoder
+const int kBatchSize = 1000;
+const int kNumBatches = 10;
+
+// Keeps the encoded messages from being optimized away
+volatile unsigned char benchmark_sink;
+
+// Encoding time per message (us)
+RunningStatistics rapid_library_time;
+RunningStatistics rapid_cached_time;
+RunningStatistics dynamic_library_time;
+RunningStatistics dynamic_cached_time;
+RunningStatistics fluid_library_time;
+RunningStatistics fluid_cached_time;
+
+struct RapidArgs {
+  unsigned char engine_instance;
+  double engine_speed;
+  double engine_boost_pressure;
+  int8_t engine_tilt_trim;
+};
+
+struct DynamicArgs {
+  unsigned char engine_instance;
+  double engine_oil_press;
+  double engine_oil_temp;
+  double engine_coolant_temp;
+  double alternator_voltage;
+  double fuel_rate;
+  double engine_hours;
+  double engine_coolant_press;
+  double engine_fuel_press;
+  int8_t engine_load;
+  int8_t engine_torque;
+  uint16_t status1;
+  uint16_t status2;
+};
+
+struct FluidArgs {
+  unsigned char instance;
+  tN2kFluidType fluid_type;
+  double level;
+  double capacity;
+};
+
+// Consecutive entries change only some of the fields, so that both newly
+// encoded and cached fields are compared
+const RapidArgs kRapidTests[] = {
+    {0, 0, N2kDoubleNA, N2kInt8NA},
+    {0, 1500.25, N2kDoubleNA, N2kInt8NA},
+    {0, 1500.3, 120000, 5},
+    {1, 1500.3, 120000, -3},
+    {1, N2kDoubleNA, 120000, -3},
+    {1, 20000, N2kDoubleNA, N2kInt8NA},  // Beyond the field range
+    {253, -5, 0, 0},                      // Negative unsigned value
+};
+
+const DynamicArgs kDynamicTests[] = {
+    {0, N2kDoubleNA, N2kDoubleNA, N2kDoubleNA, N2kDoubleNA, N2kDoubleNA,
+     N2kUInt32NA, N2kDoubleNA, N2kDoubleNA, N2kInt8NA, N2kInt8NA, 0, 0},
+    {0, 350000, 363.15, 355.15, 14.2, 12.5, 3600 * 1234, 150000, 300000, 75,
+     60, 0, 0},
+    {0, 352000, 363.15, 355.15, 14.21, 12.6, 3600 * 1234, 150000, 300000, 76,
+     60, 0x0041, 0},
+    {0, 352000, 363.15, 355.15, -0.5, -1.25, 3600 * 1235, 150000, 300000, -2,
+     -100, 0x0041, 0x0081},
+    {2, 1e7, 700, 700, 400, 4000, 5e9, 1e8, 1e8, 127, 127, 0xffff, 0xffff},
+};
+
+const FluidArgs kFluidTests[] = {
+    {0, N2kft_Fuel, 50, 200},
+    {0, N2kft_Fuel, 50.002, 200},
+    {0, N2kft_Fuel, N2kDoubleNA, 200},
+    {1, N2kft_Water, 100, 200},
+    {15, N2kft_Water, -1, N2kDoubleNA},
+    {0, N2kft_Fuel, 200, 1e9},  // Beyond the field ranges
+};
+
+bool SameMessage(const tN2kMsg& a, const tN2kMsg& b) {
+  return a.PGN == b.PGN && a.Priority == b.Priority &&
+         a.DataLen == b.DataLen && memcmp(a.Data, b.Data, a.DataLen) == 0;
+}
+
+template <typename Args, size_t N, typename Library, typename Cached>
+bool Verify(const char* name, const Args (&tests)[N], Library library,
+            Cached cached) {
+  for (size_t i = 0; i < N; i++) {
+    tN2kMsg expected;
+    tN2kMsg actual;
+    library(expected, tests[i]);
+    cached(actual, tests[i]);
+    if (!SameMessage(expected, actual)) {
+      debugE("N2k encoders: %s test %u differs from the library encoding",
+             name, i);
+      return false;
+    }
+  }
+  return true;
+}
+
+void EncodeRapid(tN2kMsg& msg, const RapidArgs& args) {
+  SetN2kEngineParamRapid(msg, args.engine_instance, args.engine_speed,
+                         args.engine_boost_pressure, args.engine_tilt_trim);
+}
+
+void EncodeDynamic(tN2kMsg& msg, const DynamicArgs& args) {
+  SetN2kEngineDynamicParam(
+      msg, args.engine_instance, args.engine_oil_press, args.engine_oil_temp,
+      args.engine_coolant_temp, args.alternator_voltage, args.fuel_rate,
+      args.engine_hours, args.engine_coolant_press, args.engine_fuel_press,
+      args.engine_load, args.engine_torque, args.status1, args.status2);
+}
+
+void EncodeFluid(tN2kMsg& msg, const FluidArgs& args) {
+  SetN2kFluidLevel(msg, args.instance, args.fluid_type, args.level,
+                   args.capacity);
+}
+
+template <typename Encode>
+void RunBatches(RunningStatistics* time, Encode encode) {
+  tN2kMsg msg;
+  for (int batch = 0; batch < kNumBatches; batch++) {
+    uint32_t start = micros();
+    for (int i = 0; i < kBatchSize; i++) {
+      encode(msg, i);
+    }
+    time->add(float(micros() - start) / kBatchSize);
+    benchmark_sink = msg.Data[1];
+  }
+}
+
+}  // namespace
+
+bool VerifyN2kEncoders() {
+  N2kEngineParamRapidEncoder rapid;
+  N2kEngineDynamicParamEncoder dynamic;
+  N2kFluidLevelEncoder fluid;
+
+  n2k_encoders_verified =
+      Verify("PGN 127488", kRapidTests, EncodeRapid,
+             [&rapid](tN2kMsg& msg, const RapidArgs& args) {
+               rapid.encode_cached(msg, args.engine_instance,
+                                   args.engine_speed,
+                                   args.engine_boost_pressure,
+                                   args.engine_tilt_trim);
+             }) &&
+      Verify("PGN 127489", kDynamicTests, EncodeDynamic,
+             [&dynamic](tN2kMsg& msg, const DynamicArgs& args) {
+               dynamic.encode_cached(
+                   msg, args.engine_instance, args.engine_oil_press,
+                   args.engine_oil_temp, args.engine_coolant_temp,
+                   args.alternator_voltage, args.fuel_rate, args.engine_hours,
+                   args.engine_coolant_press, args.engine_fuel_press,
+                   args.engine_load, args.engine_torque, args.status1,
+                   args.status2);
+             }) &&
+      Verify("PGN 127505", kFluidTests, EncodeFluid,
+             [&fluid](tN2kMsg& msg, const FluidArgs& args) {
+               fluid.encode_cached(msg, args.instance, args.fluid_type,
+                                   args.level, args.capacity);
+             });
+
+  if (n2k_encoders_verified) {
+    debugI("N2k encoders: Verified against the library encoding");
+  } else {
+    debugE("N2k encoders: Falling back to the library functions");
+  }
+  return n2k_encoders_verified;
+}
+
+void RunN2kEncoderBenchmark() {
+  // Typical update patterns: the engine speed changes in every message,
+  // the dynamic parameters in every tenth and the tank level rarely
+  N2kEngineParamRapidEncoder rapid;
+  N2kEngineDynamicParamEncoder dynamic;
+  N2kFluidLevelEncoder fluid;
+
+  RunBatches(&rapid_library_time, [](tN2kMsg& msg, int i) {
+    SetN2kEngineParamRapid(msg, 0, 1500 + i % 100, N2kDoubleNA, N2kInt8NA);
+  });
+  RunBatches(&rapid_cached_time, [&rapid](tN2kMsg& msg, int i) {
+    rapid.encode_cached(msg, 0, 1500 + i % 100, N2kDoubleNA, N2kInt8NA);
+  });
+  RunBatches(&dynamic_library_time, [](tN2kMsg& msg, int i) {
+    SetN2kEngineDynamicParam(msg, 0, 350000 + 100 * (i / 10), 363.15,
+                             355.15 + 0.1 * (i / 10), 14.2, 12.5, 3600 * 1234,
+                             N2kDoubleNA, N2kDoubleNA, N2kInt8NA, N2kInt8NA,
+                             0, 0);
+  });
+  RunBatches(&dynamic_cached_time, [&dynamic](tN2kMsg& msg, int i) {
+    dynamic.encode_cached(msg, 0, 350000 + 100 * (i / 10), 363.15,
+                          355.15 + 0.1 * (i / 10), 14.2, 12.5, 3600 * 1234,
+                          N2kDoubleNA, N2kDoubleNA, N2kInt8NA, N2kInt8NA, 0,
+                          0);
+  });
+  RunBatches(&fluid_library_time, [](tN2kMsg& msg, int i) {
+    SetN2kFluidLevel(msg, 0, N2kft_Fuel, 50 + 0.1 * (i / 100), 200);
+  });
+  RunBatches(&fluid_cached_time, [&fluid](tN2kMsg& msg, int i) {
+    fluid.encode_cached(msg, 0, N2kft_Fuel, 50 + 0.1 * (i / 100), 200);
+  });
+
+  debugI("N2k encoder benchmark (us/message): 127488 library %.3f, cached "
+         "%.3f; 127489 library %.3f, cached %.3f; 127505 library %.3f, "
+         "cached %.3f",
+         rapid_library_time.mean(), rapid_cached_time.mean(),
+         dynamic_library_time.mean(), dynamic_cached_time.mean(),
+         fluid_library_time.mean(), fluid_cached_time.mean());
+
+  AddProfilerStatistics("benchmark 127488 library", &rapid_library_time);
+  AddProfilerStatistics("benchmark 127488 cached", &rapid_cached_time);
+  AddProfilerStatistics("benchmark 127489 library", &dynamic_library_time);
+  AddProfilerStatistics("benchmark 127489 cached", &dynamic_cached_time);
+  AddProfilerStatistics("benchmark 127505 library", &fluid_library_time);
+  AddProfilerStatistics("benchmark 127505 cached", &fluid_cached_time);
+}
+
+}  // namespace halmet
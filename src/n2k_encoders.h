@@ -0,0 +1,280 @@
+#ifndef HALMET_SRC_N2K_ENCODERS_H_
+#define HALMET_SRC_N2K_ENCODERS_H_
+
+#include <N2kMessages.h>
+#include <N2kMsg.h>
+
+#include <cstring>
+
+namespace halmet {
+
+/**
+ * Cached encoders for the PGNs sent by HALMET.
+ *
+ * The NMEA2000 library functions (SetN2kEngineParamRapid and so on) encode
+ * every field of a message from scratch each time it is sent, although
+ * most fields rarely change. Each encoder below instead keeps the payload
+ * of the previous message. Its fields sit at compile-time offsets and
+ * remember the value they were last encoded with, so a message only
+ * re-encodes the fields that changed and then copies the payload into the
+ * tN2kMsg.
+ *
+ * The field values are encoded with the buffer functions of the library,
+ * with the same not-available handling as the tN2kMsg::Add functions, so
+ * the messages are byte-identical to those of the library functions.
+ * VerifyN2kEncoders() checks this at startup. If any message differs, for
+ * example after a library update that changed a layout, the senders fall
+ * back to the library functions.
+ */
+
+/// True if the encoders produced the same messages as the library functions
+/// in VerifyN2kEncoders().
+extern bool n2k_encoders_verified;
+
+namespace n2k_encoding {
+
+struct Byte {
+  using Type = uint8_t;
+  static void encode(uint8_t value, double, unsigned char* buf) {
+    buf[0] = value;
+  }
+};
+
+struct UInt16 {
+  using Type = uint16_t;
+  static void encode(uint16_t value, double, unsigned char* buf) {
+    int index = 0;
+    SetBuf2ByteUInt(value, index, buf);
+  }
+};
+
+struct UDouble2 {
+  using Type = double;
+  static void encode(double value, double precision, unsigned char* buf) {
+    int index = 0;
+    if (value != N2kDoubleNA) {
+      SetBuf2ByteUDouble(value, precision, index, buf);
+    } else {
+      SetBuf2ByteUInt(N2kUInt16NA, index, buf);
+    }
+  }
+};
+
+struct Double2 {
+  using Type = double;
+  static void encode(double value, double precision, unsigned char* buf) {
+    int index = 0;
+    if (value != N2kDoubleNA) {
+      SetBuf2ByteDouble(value, precision, index, buf);
+    } else {
+      SetBuf2ByteInt(N2kInt16NA, index, buf);
+    }
+  }
+};
+
+struct UDouble4 {
+  using Type = double;
+  static void encode(double value, double precision, unsigned char* buf) {
+    int index = 0;
+    if (value != N2kDoubleNA) {
+      SetBuf4ByteUDouble(value, precision, index, buf);
+    } else {
+      SetBufUInt32(N2kUInt32NA, index, buf);
+    }
+  }
+};
+
+}  // namespace n2k_encoding
+
+/// Payload field at a fixed offset, re-encoded only when its value changes.
+template <typename Encoding, int kOffset>
+class N2kField {
+ public:
+  using Type = typename Encoding::Type;
+
+  N2kField(double precision = 1) : precision_{precision} {}
+
+  void set(unsigned char* payload, Type value) {
+    if (encoded_ && value == value_) {
+      return;
+    }
+    Encoding::encode(value, precision_, payload + kOffset);
+    value_ = value;
+    encoded_ = true;
+  }
+
+ protected:
+  const double precision_;
+  Type value_;
+  bool encoded_ = false;
+};
+
+/// Set up a message with a cached payload.
+inline void SetN2kPayload(tN2kMsg& msg, unsigned long pgn,
+                          unsigned char priority,
+                          const unsigned char* payload, int length) {
+  msg.SetPGN(pgn);
+  msg.Priority = priority;
+  memcpy(msg.Data, payload, length);
+  msg.DataLen = length;
+}
+
+/// PGN 127488: Engine Parameters, Rapid Update. See SetN2kEngineParamRapid.
+class N2kEngineParamRapidEncoder {
+ public:
+  static const unsigned long kPgn = 127488L;
+  static const unsigned char kPriority = 2;
+  static const int kLength = 8;
+
+  N2kEngineParamRapidEncoder() { memset(payload_, 0xff, kLength); }
+
+  /// Encode with the cached payload if the encoders were verified, and
+  /// with SetN2kEngineParamRapid otherwise.
+  template <typename... Args>
+  void encode(tN2kMsg& msg, Args... args) {
+    if (n2k_encoders_verified) {
+      encode_cached(msg, args...);
+    } else {
+      SetN2kEngineParamRapid(msg, args...);
+    }
+  }
+
+  void encode_cached(tN2kMsg& msg, unsigned char engine_instance,
+                     double engine_speed,
+                     double engine_boost_pressure = N2kDoubleNA,
+                     int8_t engine_tilt_trim = N2kInt8NA) {
+    engine_instance_.set(payload_, engine_instance);
+    engine_speed_.set(payload_, engine_speed);
+    engine_boost_pressure_.set(payload_, engine_boost_pressure);
+    engine_tilt_trim_.set(payload_, engine_tilt_trim);
+    SetN2kPayload(msg, kPgn, kPriority, payload_, kLength);
+  }
+
+ protected:
+  unsigned char payload_[kLength];  // Bytes 6-7 are reserved
+  N2kField<n2k_encoding::Byte, 0> engine_instance_;
+  N2kField<n2k_encoding::UDouble2, 1> engine_speed_{0.25};
+  N2kField<n2k_encoding::UDouble2, 3> engine_boost_pressure_{100};
+  N2kField<n2k_encoding::Byte, 5> engine_tilt_trim_;
+};
+
+/// PGN 127489: Engine Parameters, Dynamic. See SetN2kEngineDynamicParam.
+class N2kEngineDynamicParamEncoder {
+ public:
+  static const unsigned long kPgn = 127489L;
+  static const unsigned char kPriority = 2;
+  static const int kLength = 26;
+
+  N2kEngineDynamicParamEncoder() { memset(payload_, 0xff, kLength); }
+
+  /// Encode with the cached payload if the encoders were verified, and
+  /// with SetN2kEngineDynamicParam otherwise.
+  template <typename... Args>
+  void encode(tN2kMsg& msg, Args... args) {
+    if (n2k_encoders_verified) {
+      encode_cached(msg, args...);
+    } else {
+      SetN2kEngineDynamicParam(msg, args...);
+    }
+  }
+
+  void encode_cached(tN2kMsg& msg, unsigned char engine_instance,
+                     double engine_oil_press, double engine_oil_temp,
+                     double engine_coolant_temp, double alternator_voltage,
+                     double fuel_rate, double engine_hours,
+                     double engine_coolant_press = N2kDoubleNA,
+                     double engine_fuel_press = N2kDoubleNA,
+                     int8_t engine_load = N2kInt8NA,
+                     int8_t engine_torque = N2kInt8NA,
+                     tN2kEngineDiscreteStatus1 status1 = 0,
+                     tN2kEngineDiscreteStatus2 status2 = 0) {
+    engine_instance_.set(payload_, engine_instance);
+    engine_oil_press_.set(payload_, engine_oil_press);
+    engine_oil_temp_.set(payload_, engine_oil_temp);
+    engine_coolant_temp_.set(payload_, engine_coolant_temp);
+    alternator_voltage_.set(payload_, alternator_voltage);
+    fuel_rate_.set(payload_, fuel_rate);
+    engine_hours_.set(payload_, engine_hours);
+    engine_coolant_press_.set(payload_, engine_coolant_press);
+    engine_fuel_press_.set(payload_, engine_fuel_press);
+    status1_.set(payload_, status1.Status);
+    status2_.set(payload_, status2.Status);
+    engine_load_.set(payload_, engine_load);
+    engine_torque_.set(payload_, engine_torque);
+    SetN2kPayload(msg, kPgn, kPriority, payload_, kLength);
+  }
+
+ protected:
+  unsigned char payload_[kLength];  // Byte 19 is reserved
+  N2kField<n2k_encoding::Byte, 0> engine_instance_;
+  N2kField<n2k_encoding::UDouble2, 1> engine_oil_press_{100};
+  N2kField<n2k_encoding::UDouble2, 3> engine_oil_temp_{0.1};
+  N2kField<n2k_encoding::UDouble2, 5> engine_coolant_temp_{0.01};
+  N2kField<n2k_encoding::Double2, 7> alternator_voltage_{0.01};
+  N2kField<n2k_encoding::Double2, 9> fuel_rate_{0.1};
+  N2kField<n2k_encoding::UDouble4, 11> engine_hours_{1};
+  N2kField<n2k_encoding::UDouble2, 15> engine_coolant_press_{100};
+  N2kField<n2k_encoding::UDouble2, 17> engine_fuel_press_{1000};
+  N2kField<n2k_encoding::UInt16, 20> status1_;
+  N2kField<n2k_encoding::UInt16, 22> status2_;
+  N2kField<n2k_encoding::Byte, 24> engine_load_;
+  N2kField<n2k_encoding::Byte, 25> engine_torque_;
+};
+
+/// PGN 127505: Fluid Level. See SetN2kFluidLevel.
+class N2kFluidLevelEncoder {
+ public:
+  static const unsigned long kPgn = 127505L;
+  static const unsigned char kPriority = 6;
+  static const int kLength = 8;
+
+  N2kFluidLevelEncoder() { memset(payload_, 0xff, kLength); }
+
+  /// Encode with the cached payload if the encoders were verified, and
+  /// with SetN2kFluidLevel otherwise.
+  template <typename... Args>
+  void encode(tN2kMsg& msg, Args... args) {
+    if (n2k_encoders_verified) {
+      encode_cached(msg, args...);
+    } else {
+      SetN2kFluidLevel(msg, args...);
+    }
+  }
+
+  void encode_cached(tN2kMsg& msg, unsigned char instance,
+                     tN2kFluidType fluid_type, double level,
+                     double capacity) {
+    instance_and_type_.set(payload_,
+                           (instance & 0x0f) | ((fluid_type & 0x0f) << 4));
+    level_.set(payload_, level);
+    capacity_.set(payload_, capacity);
+    SetN2kPayload(msg, kPgn, kPriority, payload_, kLength);
+  }
+
+ protected:
+  unsigned char payload_[kLength];  // Byte 7 is reserved
+  N2kField<n2k_encoding::Byte, 0> instance_and_type_;
+  N2kField<n2k_encoding::Double2, 1> level_{0.004};
+  N2kField<n2k_encoding::UDouble4, 3> capacity_{0.1};
+};
+
+/**
+ * @brief Compare the encoders against the library functions.
+ *
+ * Encodes a set of test messages, including not-available, negative and
+ * out-of-range values and messages where only some fields change, with
+ * both and sets n2k_encoders_verified. Takes well under a millisecond.
+ */
+bool VerifyN2kEncoders();
+
+/**
+ * @brief Log the encoding time per message of the library functions and the
+ * encoders and add it to the profiler report.
+ *
+ * Blocks the event loop for a few tens of milliseconds.
+ */
+void RunN2kEncoderBenchmark();
+
+}  // namespace halmet
+
+#endif  // HALMET_SRC_N2K_ENCODERS_H_
@@ -0,0 +1,461 @@
+#ifndef HALMET_SRC_N2K_MULTI_SENDERS_H_
+#define HALMET_SRC_N2K_MULTI_SENDERS_H_
+
+#include "expiring_value.h"
+#include "live_config.h"
+#include "n2k_encoders.h"
+#include "n2k_senders.h"
+#include "power_manager.h"
+#include "sensesp/system/valueconsumer.h"
+
+namespace halmet {
+
+/**
+ * @brief Sender input holding the latest value until it expires.
+ *
+ * Unlike RepeatExpiring, the input has no timer and allocates nothing; the
+ * sender polls it when composing a message. After the expiry time without
+ * updates, the expired value (normally the NMEA 2000 "not available" value)
+ * is returned.
+ */
+template <typename T>
+class ExpiringInput : public sensesp::ValueConsumer<T> {
+ public:
+  ExpiringInput(unsigned long expiry, T expired_value)
+      : value_{expired_value, expiry, expired_value} {}
+
+  void set(const T& value) override {
+    value_.update(value);
+    sample_time_ = current_sample_time;
+  }
+
+  T get() const { return value_.get(); }
+  bool is_expired() const { return value_.is_expired(); }
+
+  /// Acquisition time of the latest value
+  uint32_t get_sample_time() const { return sample_time_; }
+
+ protected:
+  ExpiringValue<T> value_;
+  uint32_t sample_time_ = 0;
+};
+
+/// NMEA 2000 instance numbers of N engines. Engine i defaults to instance i.
+template <size_t N>
+struct N2kEngineInstances {
+  N2kEngineInstances() {
+    for (size_t i = 0; i < N; i++) {
+      engine_instance[i] = i;
+    }
+  }
+
+  uint8_t engine_instance[N];
+};
+
+template <size_t N>
+bool FromJson(const JsonObject& config,
+              LiveConfig<N2kEngineInstances<N>>& instances) {
+  if (!config["engines"].is<JsonArray>()) {
+    return false;
+  }
+  N2kEngineInstances<N> parsed = instances.get_latest();
+  size_t i = 0;
+  for (JsonVariant entry : config["engines"].as<JsonArray>()) {
+    if (i == N || !entry["engine_instance"].is<int>()) {
+      break;
+    }
+    parsed.engine_instance[i++] = entry["engine_instance"];
+  }
+  instances.set(parsed);
+  return true;
+}
+
+template <size_t N>
+bool ToJson(JsonObject& config,
+            const LiveConfig<N2kEngineInstances<N>>& instances) {
+  N2kEngineInstances<N> latest = instances.get_latest();
+  JsonArray engines = config["engines"].to<JsonArray>();
+  for (uint8_t instance : latest.engine_instance) {
+    engines.add<JsonObject>()["engine_instance"] = instance;
+  }
+  return true;
+}
+
+/**
+ * @brief Transmit PGN 127488: Engine Parameters, Rapid Update for N engines.
+ *
+ * All engines are stored in one array, share a single configuration
+ * document and are sent in one pass of a single timer. Adding engines
+ * therefore costs neither timers nor heap allocations. Instance changes
+ * are swapped in between two transmission rounds, without a restart.
+ */
+template <size_t N>
+class N2kEngineParameterRapidMultiSender : public N2kSender {
+ public:
+  class Engine {
+   public:
+    ExpiringInput<double> engine_speed_{kExpiry, N2kDoubleNA};  // Hz
+    ExpiringInput<double> engine_boost_pressure_{kExpiry, N2kDoubleNA};
+    ExpiringInput<int8_t> engine_tilt_trim_{kExpiry, N2kInt8NA};
+  };
+
+  N2kEngineParameterRapidMultiSender(String config_path, tNMEA2000* nmea2000)
+      : N2kSender{config_path, nmea2000,
+                  100,  // In ms. Dictated by NMEA 2000 standard!
+                  kExpiry} {
+    this->load();
+
+    sensesp::event_loop()->onRepeat(repeat_interval_,
+                                    [this]() { this->send_all(); });
+  }
+
+  /// Engine by index (0 to N-1); not the NMEA 2000 instance number
+  Engine& engine(size_t index) { return engines_[index]; }
+
+  virtual bool from_json(const JsonObject& config) override {
+    return FromJson(config, instances_);
+  }
+
+  virtual bool to_json(JsonObject& config) override {
+    return ToJson(config, instances_);
+  }
+
+ protected:
+  static const unsigned int kExpiry = 1000;  // In ms. When the inputs expire.
+
+  void send_all() {
+    mark_interval();
+    instances_.update();
+    const N2kEngineInstances<N>& instances = instances_.get();
+    for (size_t i = 0; i < N; i++) {
+      Engine& engine = engines_[i];
+      N2kEngineParamRapidEncoder& encoder = encoders_[i];
+      uint8_t instance = instances.engine_instance[i];
+      set_sample_time(engine.engine_speed_.get_sample_time());
+      send_message([&engine, &encoder, instance](tN2kMsg& N2kMsg) {
+        double speed = engine.engine_speed_.get();
+        encoder.encode(N2kMsg, instance,
+                       speed == N2kDoubleNA ? N2kDoubleNA : 60 * speed,
+                       engine.engine_boost_pressure_.get(),
+                       engine.engine_tilt_trim_.get());
+      });
+    }
+  }
+
+  Engine engines_[N];
+  N2kEngineParamRapidEncoder encoders_[N];
+  LiveConfig<N2kEngineInstances<N>> instances_;
+};
+
+template <size_t N>
+const String ConfigSchema(const N2kEngineParameterRapidMultiSender<N>& obj) {
+  return R"###({
+    "type": "object",
+    "properties": {
+      "engines": { "title": "Engines", "type": "array", "format": "table",
+        "items": { "type": "object", "properties": {
+          "engine_instance": { "title": "Engine instance", "type": "integer", "description": "Engine NMEA 2000 instance number (0-253)" }
+        }}
+      }
+    }
+  })###";
+}
+
+/**
+ * @brief Transmit PGN 127489: Engine Parameters, Dynamic for N engines.
+ *
+ * See N2kEngineParameterRapidMultiSender for the storage and scheduling.
+ */
+template <size_t N>
+class N2kEngineParameterDynamicMultiSender : public N2kSender {
+ public:
+  class Engine {
+   public:
+    ExpiringInput<double> oil_pressure_{kExpiry, N2kDoubleNA};
+    ExpiringInput<double> oil_temperature_{kExpiry, N2kDoubleNA};
+    ExpiringInput<double> temperature_{kExpiry, N2kDoubleNA};
+    ExpiringInput<double> alternator_potential_{kExpiry, N2kDoubleNA};
+    ExpiringInput<double> fuel_rate_{kExpiry, N2kDoubleNA};  // l/h
+    ExpiringInput<uint32_t> total_engine_hours_{kExpiry, N2kUInt32NA};
+    ExpiringInput<double> coolant_pressure_{kExpiry, N2kDoubleNA};
+    ExpiringInput<double> fuel_pressure_{kExpiry, N2kDoubleNA};
+    ExpiringInput<int> engine_load_{kExpiry, N2kInt8NA};
+    ExpiringInput<int> engine_torque_{kExpiry, N2kInt8NA};
+    // Engine status 1 fields
+    ExpiringInput<bool> over_temperature_{kExpiry, false};
+    ExpiringInput<bool> low_oil_pressure_{kExpiry, false};
+    ExpiringInput<bool> low_oil_level_{kExpiry, false};
+    ExpiringInput<bool> low_fuel_pressure_{kExpiry, false};
+    ExpiringInput<bool> low_system_voltage_{kExpiry, false};
+    ExpiringInput<bool> low_coolant_level_{kExpiry, false};
+    ExpiringInput<bool> water_flow_{kExpiry, false};
+    ExpiringInput<bool> water_in_fuel_{kExpiry, false};
+    ExpiringInput<bool> charge_indicator_{kExpiry, false};
+    ExpiringInput<bool> preheat_indicator_{kExpiry, false};
+    ExpiringInput<bool> high_boost_pressure_{kExpiry, false};
+    ExpiringInput<bool> rev_limit_exceeded_{kExpiry, false};
+    ExpiringInput<bool> egr_system_{kExpiry, false};
+    ExpiringInput<bool> throttle_position_sensor_{kExpiry, false};
+    ExpiringInput<bool> emergency_stop_{kExpiry, false};
+    // Engine status 2 fields
+    ExpiringInput<bool> warning_level_1_{kExpiry, false};
+    ExpiringInput<bool> warning_level_2_{kExpiry, false};
+    ExpiringInput<bool> power_reduction_{kExpiry, false};
+    ExpiringInput<bool> maintenance_needed_{kExpiry, false};
+    ExpiringInput<bool> engine_comm_error_{kExpiry, false};
+    ExpiringInput<bool> sub_or_secondary_throttle_{kExpiry, false};
+    ExpiringInput<bool> neutral_start_protect_{kExpiry, false};
+    ExpiringInput<bool> engine_shutting_down_{kExpiry, false};
+
+    tN2kEngineDiscreteStatus1 get_engine_status_1() const {
+      tN2kEngineDiscreteStatus1 status = 0;
+      status.Bits.OverTemperature = over_temperature_.get();
+      status.Bits.LowOilPressure = low_oil_pressure_.get();
+      status.Bits.LowOilLevel = low_oil_level_.get();
+      status.Bits.LowFuelPressure = low_fuel_pressure_.get();
+      status.Bits.LowSystemVoltage = low_system_voltage_.get();
+      status.Bits.LowCoolantLevel = low_coolant_level_.get();
+      status.Bits.WaterFlow = water_flow_.get();
+      status.Bits.WaterInFuel = water_in_fuel_.get();
+      status.Bits.ChargeIndicator = charge_indicator_.get();
+      status.Bits.PreheatIndicator = preheat_indicator_.get();
+      status.Bits.HighBoostPressure = high_boost_pressure_.get();
+      status.Bits.RevLimitExceeded = rev_limit_exceeded_.get();
+      status.Bits.EGRSystem = egr_system_.get();
+      status.Bits.ThrottlePositionSensor = throttle_position_sensor_.get();
+      status.Bits.EngineEmergencyStopMode = emergency_stop_.get();
+
+      // Set CheckEngine if any other status bit is set
+      status.Bits.CheckEngine = status.Status != 0;
+      return status;
+    }
+
+    tN2kEngineDiscreteStatus2 get_engine_status_2() const {
+      tN2kEngineDiscreteStatus2 status = 0;
+      status.Bits.WarningLevel1 = warning_level_1_.get();
+      status.Bits.WarningLevel2 = warning_level_2_.get();
+      status.Bits.LowOiPowerReduction = power_reduction_.get();
+      status.Bits.MaintenanceNeeded = maintenance_needed_.get();
+      status.Bits.EngineCommError = engine_comm_error_.get();
+      status.Bits.SubOrSecondaryThrottle = sub_or_secondary_throttle_.get();
+      status.Bits.NeutralStartProtect = neutral_start_protect_.get();
+      status.Bits.EngineShuttingDown = engine_shutting_down_.get();
+      return status;
+    }
+  };
+
+  N2kEngineParameterDynamicMultiSender(String config_path, tNMEA2000* nmea2000)
+      : N2kSender{config_path, nmea2000,
+                  500,  // In ms. Dictated by NMEA 2000 standard!
+                  kExpiry} {
+    this->load();
+
+    sensesp::event_loop()->onRepeat(repeat_interval_,
+                                    [this]() { this->send_all(); });
+  }
+
+  /// Engine by index (0 to N-1); not the NMEA 2000 instance number
+  Engine& engine(size_t index) { return engines_[index]; }
+
+  virtual bool from_json(const JsonObject& config) override {
+    return FromJson(config, instances_);
+  }
+
+  virtual bool to_json(JsonObject& config) override {
+    return ToJson(config, instances_);
+  }
+
+ protected:
+  static const unsigned int kExpiry = 5000;  // In ms. When the inputs expire.
+
+  void send_all() {
+    mark_interval();
+    instances_.update();
+    const N2kEngineInstances<N>& instances = instances_.get();
+    for (size_t i = 0; i < N; i++) {
+      Engine& engine = engines_[i];
+      N2kEngineDynamicParamEncoder& encoder = encoders_[i];
+      uint8_t instance = instances.engine_instance[i];
+      send_message([&engine, &encoder, instance](tN2kMsg& N2kMsg) {
+        encoder.encode(
+            N2kMsg, instance, engine.oil_pressure_.get(),
+            engine.oil_temperature_.get(), engine.temperature_.get(),
+            engine.alternator_potential_.get(), engine.fuel_rate_.get(),
+            engine.total_engine_hours_.get(), engine.coolant_pressure_.get(),
+            engine.fuel_pressure_.get(), engine.engine_load_.get(),
+            engine.engine_torque_.get(), engine.get_engine_status_1(),
+            engine.get_engine_status_2());
+      });
+    }
+  }
+
+  Engine engines_[N];
+  N2kEngineDynamicParamEncoder encoders_[N];
+  LiveConfig<N2kEngineInstances<N>> instances_;
+};
+
+template <size_t N>
+const String ConfigSchema(
+    const N2kEngineParameterDynamicMultiSender<N>& obj) {
+  return R"###({
+    "type": "object",
+    "properties": {
+      "engines": { "title": "Engines", "type": "array", "format": "table",
+        "items": { "type": "object", "properties": {
+          "engine_instance": { "title": "Engine instance", "type": "integer", "description": "Engine NMEA 2000 instance number (0-253)" }
+        }}
+      }
+    }
+  })###";
+}
+
+/**
+ * @brief Transmit PGN 127505: Fluid Level for N tanks.
+ *
+ * See N2kEngineParameterRapidMultiSender for the storage and scheduling.
+ * A tank is sent immediately when its sender
+ * fault input becomes true, and its level is sent as not available while
+ * the fault persists.
+ */
+template <size_t N>
+class N2kFluidLevelMultiSender : public N2kSender {
+ public:
+  class Tank;
+
+  /// Sender fault input triggering an immediate transmission
+  class SenderFaultInput : public sensesp::ValueConsumer<bool> {
+   public:
+    void set(const bool& fault) override {
+      bool new_fault = fault && !fault_;
+      fault_ = fault;
+      if (new_fault) {
+        sender_->send_tank(index_);
+      }
+    }
+
+    bool get() const { return fault_; }
+
+   protected:
+    friend class N2kFluidLevelMultiSender;
+    N2kFluidLevelMultiSender* sender_;
+    size_t index_;
+    bool fault_ = false;
+  };
+
+  class Tank {
+   public:
+    ExpiringInput<double> tank_level_{kExpiry, N2kDoubleNA};  // ratio
+    SenderFaultInput sender_fault_;
+  };
+
+  N2kFluidLevelMultiSender(String config_path, tN2kFluidType tank_type,
+                           double tank_capacity, tNMEA2000* nmea2000)
+      : N2kSender{config_path, nmea2000,
+                  2500,  // In ms. Dictated by NMEA 2000 standard!
+                  kExpiry} {
+    TankConfigs configs;
+    for (size_t i = 0; i < N; i++) {
+      configs.tanks[i] = {(uint8_t)i, tank_type, tank_capacity};
+      tanks_[i].sender_fault_.sender_ = this;
+      tanks_[i].sender_fault_.index_ = i;
+    }
+    tank_configs_.set(configs);
+    this->load();
+    tank_configs_.update();
+
+    sensesp::event_loop()->onRepeat(repeat_interval_,
+                                    [this]() { this->send_all(); });
+  }
+
+  /// Tank by index (0 to N-1); not the NMEA 2000 instance number
+  Tank& tank(size_t index) { return tanks_[index]; }
+
+  virtual bool from_json(const JsonObject& config) override {
+    if (!config["tanks"].is<JsonArray>()) {
+      return false;
+    }
+    TankConfigs configs = tank_configs_.get_latest();
+    size_t i = 0;
+    for (JsonVariant entry : config["tanks"].as<JsonArray>()) {
+      if (i == N || !entry["tank_instance"].is<int>() ||
+          !entry["tank_type"].is<int>() ||
+          !entry["tank_capacity"].is<float>()) {
+        break;
+      }
+      N2kTankConfig& tank_config = configs.tanks[i++];
+      tank_config.tank_instance = entry["tank_instance"];
+      tank_config.tank_type = entry["tank_type"];
+      tank_config.tank_capacity = entry["tank_capacity"];
+    }
+    tank_configs_.set(configs);
+    return true;
+  }
+
+  virtual bool to_json(JsonObject& config) override {
+    TankConfigs configs = tank_configs_.get_latest();
+    JsonArray tanks = config["tanks"].to<JsonArray>();
+    for (const N2kTankConfig& tank_config : configs.tanks) {
+      JsonObject entry = tanks.add<JsonObject>();
+      entry["tank_instance"] = tank_config.tank_instance;
+      entry["tank_type"] = tank_config.tank_type;
+      entry["tank_capacity"] = tank_config.tank_capacity;
+    }
+    return true;
+  }
+
+ protected:
+  static const unsigned int kExpiry = 10000;  // In ms. When the inputs expire.
+  static_assert(1000 * PowerManager::kMaxSampleInterval < kExpiry,
+                "Tank levels would expire between low-power samples");
+
+  struct TankConfigs {
+    N2kTankConfig tanks[N];
+  };
+
+  void send_all() {
+    mark_interval();
+    tank_configs_.update();
+    for (size_t i = 0; i < N; i++) {
+      send_tank(i);
+    }
+  }
+
+  void send_tank(size_t index) {
+    Tank& tank = tanks_[index];
+    N2kFluidLevelEncoder& encoder = encoders_[index];
+    const N2kTankConfig& tank_config = tank_configs_.get().tanks[index];
+    set_sample_time(tank.tank_level_.get_sample_time());
+    send_message([&tank, &encoder, &tank_config](tN2kMsg& N2kMsg) {
+      double level = tank.tank_level_.get();
+      encoder.encode(N2kMsg, tank_config.tank_instance, tank_config.tank_type,
+                     tank.sender_fault_.get() || level == N2kDoubleNA
+                         ? N2kDoubleNA
+                         : 100 * level,
+                     tank_config.tank_capacity);
+    });
+  }
+
+  Tank tanks_[N];
+  N2kFluidLevelEncoder encoders_[N];
+  LiveConfig<TankConfigs> tank_configs_;
+};
+
+template <size_t N>
+const String ConfigSchema(const N2kFluidLevelMultiSender<N>& obj) {
+  return R"###({
+    "type": "object",
+    "properties": {
+      "tanks": { "title": "Tanks", "type": "array", "format": "table",
+        "items": { "type": "object", "properties": {
+          "tank_instance": { "title": "Tank instance", "type": "integer", "description": "Tank NMEA 2000 instance number (0-13)" },
+          "tank_type": { "title": "Tank type", "type": "integer", "description": "Tank type (0-13)" },
+          "tank_capacity": { "title": "Tank capacity", "type": "number", "description": "Tank capacity (liters)" }
+        }}
+      }
+    }
+  })###";
+}
+
+}  // namespace halmet
+
+#endif  // HALMET_SRC_N2K_MULTI_SENDERS_H_
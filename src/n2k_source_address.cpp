@@ -0,0 +1,46 @@
+#include "n2k_source_address.h"
+
+namespace halmet {
+
+namespace {
+
+// Interval for checking the claimed source address
+const unsigned int kAddressCheckInterval = 1000;  // ms
+
+}  // namespace
+
+N2kSourceAddress::N2kSourceAddress(const String& config_path,
+                                   uint8_t default_address)
+    : sensesp::FileSystemSaveable{config_path}, address_{default_address} {
+  load();
+}
+
+void N2kSourceAddress::watch(tNMEA2000* nmea2000) {
+  sensesp::event_loop()->onRepeat(kAddressCheckInterval, [this, nmea2000]() {
+    if (nmea2000->ReadResetAddressChanged()) {
+      address_ = nmea2000->GetN2kSource();
+      debugI("NMEA 2000 source address changed to %d", address_);
+      save();
+    }
+  });
+}
+
+bool N2kSourceAddress::to_json(JsonObject& config) {
+  config["address"] = address_;
+  return true;
+}
+
+bool N2kSourceAddress::from_json(const JsonObject& config) {
+  if (!config["address"].is<int>()) {
+    return false;
+  }
+  int address = config["address"];
+  // 254 is the null address of a device that failed to claim one
+  if (address < 0 || address > 253) {
+    return false;
+  }
+  address_ = address;
+  return true;
+}
+
+}  // namespace halmet
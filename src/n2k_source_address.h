@@ -0,0 +1,37 @@
+#ifndef HALMET_SRC_N2K_SOURCE_ADDRESS_H_
+#define HALMET_SRC_N2K_SOURCE_ADDRESS_H_
+
+#include <NMEA2000.h>
+
+#include "sensesp/system/saveable.h"
+#include "sensesp_base_app.h"
+
+namespace halmet {
+
+/**
+ * @brief Persistent NMEA 2000 source address.
+ *
+ * The source address claimed on the bus is saved whenever it changes and
+ * used as the preferred address at the next boot. Starting with the
+ * address held last time avoids repeating the address negotiation on
+ * busy buses, so the device starts transmitting sooner.
+ */
+class N2kSourceAddress : public sensesp::FileSystemSaveable {
+ public:
+  N2kSourceAddress(const String& config_path, uint8_t default_address);
+
+  uint8_t get() const { return address_; }
+
+  /// Periodically check the claimed address and save any changes.
+  void watch(tNMEA2000* nmea2000);
+
+  virtual bool to_json(JsonObject& config) override;
+  virtual bool from_json(const JsonObject& config) override;
+
+ protected:
+  uint8_t address_;
+};
+
+}  // namespace halmet
+
+#endif  // HALMET_SRC_N2K_SOURCE_ADDRESS_H_
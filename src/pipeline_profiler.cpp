@@ -0,0 +1,122 @@
+#include "pipeline_profiler.h"
+
+#include <esp_heap_caps.h>
+
+#include "sample_age.h"
+#include "setup_arena.h"
+
+namespace halmet {
+
+PipelineProfiler* pipeline_profiler = nullptr;
+
+namespace {
+
+// Interval for logging the profiling report
+const unsigned int kReportLogInterval = 60000;  // ms
+
+}  // namespace
+
+PipelineProfiler::PipelineProfiler() {
+  report_mutex_ = xSemaphoreCreateMutex();
+  window_start_ = millis();
+  sensesp::event_loop()->onRepeat(kWindowLength,
+                                  [this]() { this->close_window(); });
+  sensesp::event_loop()->onRepeat(kReportLogInterval, [this]() {
+    debugI("Profile: %s", this->get_report().c_str());
+  });
+}
+
+void PipelineProfiler::add_statistics(const String& name,
+                                      const RunningStatistics* statistics) {
+  entries_.push_back({name, statistics, nullptr});
+}
+
+void PipelineProfiler::add_statistics(const String& name,
+                                      const AgeStatistics* statistics) {
+  entries_.push_back({name, statistics, statistics});
+}
+
+void PipelineProfiler::close_window() {
+  uint32_t now = millis();
+  uint32_t length = now - window_start_;
+  if (length == 0) {
+    return;
+  }
+  ticks_per_second_ = 1000. * window_ticks_ / length;
+  occupancy_ = window_busy_time_ / (1000. * length);
+  max_tick_ = window_max_tick_;
+
+  window_start_ = now;
+  window_ticks_ = 0;
+  window_busy_time_ = 0;
+  window_max_tick_ = 0;
+
+  render_report();
+}
+
+void PipelineProfiler::render_report() {
+  String report = get_report();
+  xSemaphoreTake(report_mutex_, portMAX_DELAY);
+  report_ = std::move(report);
+  xSemaphoreGive(report_mutex_);
+}
+
+String PipelineProfiler::get_report() {
+  JsonDocument doc;
+
+  doc["uptime"] = millis();
+
+  JsonObject heap = doc["heap"].to<JsonObject>();
+  heap["free"] = heap_caps_get_free_size(MALLOC_CAP_8BIT);
+  heap["min_free"] = heap_caps_get_minimum_free_size(MALLOC_CAP_8BIT);
+  heap["largest_block"] = heap_caps_get_largest_free_block(MALLOC_CAP_8BIT);
+
+  ArenaUsage arena_usage = GetArenaUsage();
+  if (arena_usage.capacity > 0) {
+    JsonObject arena = doc["arena"].to<JsonObject>();
+    arena["capacity"] = arena_usage.capacity;
+    arena["used"] = arena_usage.used;
+    arena["heap_fallbacks"] = arena_usage.heap_fallbacks;
+  }
+
+  JsonObject loop = doc["event_loop"].to<JsonObject>();
+  loop["ticks_per_s"] = ticks_per_second_;
+  loop["occupancy"] = occupancy_;
+  loop["max_tick_us"] = max_tick_;
+
+  JsonObject statistics = doc["statistics"].to<JsonObject>();
+  for (auto& entry : entries_) {
+    JsonObject stats = statistics[entry.name].to<JsonObject>();
+    stats["count"] = entry.statistics->count();
+    stats["mean"] = entry.statistics->mean();
+    stats["stddev"] = entry.statistics->stddev();
+    stats["min"] = entry.statistics->min();
+    stats["max"] = entry.statistics->max();
+    if (entry.ages != nullptr) {
+      stats["p50"] = entry.ages->percentile(0.5);
+      stats["p90"] = entry.ages->percentile(0.9);
+      stats["p99"] = entry.ages->percentile(0.99);
+    }
+  }
+
+  String report;
+  serializeJson(doc, report);
+  return report;
+}
+
+void PipelineProfiler::add_http_handlers(sensesp::HTTPServer* server) {
+  server->add_handler(new sensesp::HTTPRequestHandler(
+      1 << HTTP_GET, "/api/profile", [this](httpd_req_t* req) {
+        xSemaphoreTake(this->report_mutex_, portMAX_DELAY);
+        String report = this->report_;
+        xSemaphoreGive(this->report_mutex_);
+        if (report.isEmpty()) {
+          // No measurement window has been closed yet
+          report = "{}";
+        }
+        httpd_resp_set_type(req, "application/json");
+        return httpd_resp_send(req, report.c_str(), report.length());
+      }));
+}
+
+}  // namespace halmet
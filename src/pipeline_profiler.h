@@ -0,0 +1,187 @@
+#ifndef HALMET_SRC_PIPELINE_PROFILER_H_
+#define HALMET_SRC_PIPELINE_PROFILER_H_
+
+#include <esp_http_server.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/semphr.h>
+
+#include <cmath>
+#include <vector>
+
+#include "sensesp/net/http_server.h"
+#include "sensesp_base_app.h"
+
+namespace halmet {
+
+class AgeStatistics;
+class PipelineProfiler;
+
+/// Global profiler instance. Null if profiling is not enabled.
+extern PipelineProfiler* pipeline_profiler;
+
+/// True if the pipeline instrumentation should collect statistics.
+inline bool ProfilingEnabled() { return pipeline_profiler != nullptr; }
+
+/**
+ * @brief Running count, mean, standard deviation and range of a series of
+ * measurements.
+ *
+ * Uses Welford's algorithm, so adding a value is O(1) and allocation-free.
+ * The mean and the sum of squares are kept in double precision: in single
+ * precision, they stop following the values after a few million samples,
+ * and the statistics are never reset.
+ */
+class RunningStatistics {
+ public:
+  void add(float value) {
+    count_++;
+    double delta = value - mean_;
+    mean_ += delta / count_;
+    m2_ += delta * (value - mean_);
+    if (count_ == 1 || value < min_) {
+      min_ = value;
+    }
+    if (count_ == 1 || value > max_) {
+      max_ = value;
+    }
+  }
+
+  void reset() {
+    count_ = 0;
+    mean_ = m2_ = min_ = max_ = 0;
+  }
+
+  uint32_t count() const { return count_; }
+  float mean() const { return mean_; }
+  float stddev() const { return count_ > 1 ? sqrt(m2_ / (count_ - 1)) : 0; }
+  float min() const { return min_; }
+  float max() const { return max_; }
+
+ protected:
+  uint32_t count_ = 0;
+  double mean_ = 0;
+  double m2_ = 0;
+  float min_ = 0;
+  float max_ = 0;
+};
+
+/**
+ * @brief Statistics of the time between consecutive events, in ms.
+ *
+ * The standard deviation is the interval jitter. Nothing is collected if
+ * profiling is not enabled.
+ */
+class IntervalStatistics : public RunningStatistics {
+ public:
+  void mark() {
+    if (!ProfilingEnabled()) {
+      return;
+    }
+    uint32_t now = micros();
+    if (started_) {
+      add((now - last_) / 1000.);
+    }
+    last_ = now;
+    started_ = true;
+  }
+
+ protected:
+  bool started_ = false;
+  uint32_t last_ = 0;
+};
+
+/// Add the time spent in the enclosing scope, in us, to a RunningStatistics.
+/// Does nothing if profiling is not enabled.
+class ScopedTimer {
+ public:
+  ScopedTimer(RunningStatistics* statistics)
+      : statistics_{ProfilingEnabled() ? statistics : nullptr},
+        start_(micros()) {}
+  ~ScopedTimer() {
+    if (statistics_ != nullptr) {
+      statistics_->add(micros() - start_);
+    }
+  }
+
+ private:
+  RunningStatistics* statistics_;
+  uint32_t start_;
+};
+
+/**
+ * @brief Collect load and timing statistics of the signal pipelines.
+ *
+ * Reports event loop occupancy, heap usage and all registered statistics
+ * (per-sample processing times, PGN transmit intervals and jitter) as JSON
+ * at /api/profile and periodically in the debug log.
+ *
+ * The statistics are written by the event loop, so the report is rendered
+ * there too, at the end of every measurement window. The HTTP handler only
+ * copies the latest rendered report and never reads half-updated values.
+ */
+class PipelineProfiler {
+ public:
+  PipelineProfiler();
+
+  /// Register a statistics object to be included in the report.
+  void add_statistics(const String& name, const RunningStatistics* statistics);
+  /// Register age statistics, reported with their percentiles.
+  void add_statistics(const String& name, const AgeStatistics* statistics);
+
+  /// Account for the duration of one event loop tick, in us.
+  void add_tick_time(uint32_t duration) {
+    window_ticks_++;
+    if (duration > kIdleTickThreshold) {
+      window_busy_time_ += duration;
+    }
+    if (duration > window_max_tick_) {
+      window_max_tick_ = duration;
+    }
+  }
+
+  /// Render the report. Event loop only.
+  String get_report();
+
+  void add_http_handlers(sensesp::HTTPServer* server);
+
+ protected:
+  // Ticks shorter than this are considered to not run any events (us)
+  static const uint32_t kIdleTickThreshold = 20;
+  static const unsigned int kWindowLength = 10000;  // ms
+
+  void close_window();
+  void render_report();
+
+  struct Entry {
+    String name;
+    const RunningStatistics* statistics;
+    const AgeStatistics* ages;
+  };
+  std::vector<Entry> entries_;
+
+  // Event loop load in the current measurement window
+  uint32_t window_start_ = 0;
+  uint32_t window_ticks_ = 0;
+  uint64_t window_busy_time_ = 0;
+  uint32_t window_max_tick_ = 0;
+
+  // Results of the previous complete window
+  float ticks_per_second_ = 0;
+  float occupancy_ = 0;
+  uint32_t max_tick_ = 0;
+
+  // Latest rendered report, served by the HTTP server task
+  String report_;
+  SemaphoreHandle_t report_mutex_;
+};
+
+inline void AddProfilerStatistics(const String& name,
+                                  const RunningStatistics* statistics) {
+  if (pipeline_profiler != nullptr) {
+    pipeline_profiler->add_statistics(name, statistics);
+  }
+}
+
+}  // namespace halmet
+
+#endif  // HALMET_SRC_PIPELINE_PROFILER_H_
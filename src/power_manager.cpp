@@ -0,0 +1,255 @@
+#include "power_manager.h"
+
+#include <N2kMessages.h>
+#include <esp_sleep.h>
+#include <esp_wifi.h>
+#include <soc/gpio_struct.h>
+
+namespace halmet {
+
+PowerManager* power_manager = nullptr;
+
+namespace {
+
+// Interval for checking the engine-off delay
+const unsigned int kEngineOffCheckInterval = 1000;  // ms
+
+// Interval for checking whether to enter light sleep in low-power mode
+const unsigned int kSleepCheckInterval = 5;  // ms
+
+// Minimum time to stay awake after light sleep. Events that became due
+// during the sleep are handled and queued CAN frames are transmitted
+// before sleeping again; an outgoing frame would otherwise show up on the
+// CAN RX pin and wake the device.
+const unsigned int kAwakeTime = 10;  // ms
+
+// Time to stay awake after a wakeup pin edge that didn't restore full power
+// by itself: long enough to count a few tacho pulses and to receive the
+// next engine speed from the bus, which is sent every 100 ms.
+const unsigned int kListenTime = 250;  // ms
+
+const char* WakeSourceName(PowerManager::WakeSource source) {
+  switch (source) {
+    case PowerManager::WakeSource::kTacho:
+      return "tacho input";
+    case PowerManager::WakeSource::kAlarm:
+      return "alarm input";
+    default:
+      return "CAN bus";
+  }
+}
+
+}  // namespace
+
+PowerManager::PowerManager(const String& config_path)
+    : sensesp::FileSystemSaveable{config_path},
+      sensesp::ValueProducer<bool>(false) {
+  load();
+  params_.update();
+
+  full_power_cpu_frequency_ = getCpuFrequencyMhz();
+  last_activity_ = millis();
+
+  sensesp::event_loop()->onRepeat(kEngineOffCheckInterval,
+                                  [this]() { this->check_engine_off(); });
+  sensesp::event_loop()->onRepeat(kSleepCheckInterval,
+                                  [this]() { this->sleep(); });
+}
+
+sensesp::ValueConsumer<bool>* PowerManager::alarm_input() {
+  return new AlarmInput(this);
+}
+
+void PowerManager::add_wakeup_pin(gpio_num_t pin, WakeSource source) {
+  if (num_wakeup_pins_ == kMaxWakeupPins) {
+    debugE("PowerManager: Too many wakeup pins");
+    return;
+  }
+  wakeup_pins_[num_wakeup_pins_++] = {pin, source, 0, GPIO_INTR_DISABLE, 0};
+}
+
+void PowerManager::handle_can_message(const tN2kMsg& msg) {
+  if (msg.PGN != 127488L || !params_.get().wake_on_can) {
+    return;
+  }
+  unsigned char instance;
+  double speed;
+  double boost_pressure;
+  int8_t tilt_trim;
+  if (ParseN2kEngineParamRapid(msg, instance, speed, boost_pressure,
+                               tilt_trim) &&
+      !N2kIsNA(speed) && speed > 0) {
+    wake("engine speed on CAN bus");
+  }
+}
+
+void PowerManager::TachoInput::set(const float& value) {
+  if (value > 0) {
+    manager_->wake("tacho");
+  }
+}
+
+void PowerManager::AlarmInput::set(const bool& value) {
+  if (initialized_ && value != state_) {
+    manager_->wake("alarm");
+  }
+  initialized_ = true;
+  state_ = value;
+}
+
+void PowerManager::check_engine_off() {
+  if (params_.update() && !params_.get().enabled) {
+    wake("configuration change");
+  }
+  const Parameters& params = params_.get();
+  if (!params.enabled || low_power_) {
+    return;
+  }
+  if (millis() - last_activity_ >= 1000 * params.engine_off_delay) {
+    enter_low_power();
+  }
+}
+
+void PowerManager::enter_low_power() {
+  debugI("PowerManager: Engine off, entering low-power mode");
+  low_power_ = true;
+  setCpuFrequencyMhz(params_.get().cpu_frequency);
+  esp_wifi_set_ps(WIFI_PS_MAX_MODEM);
+  this->emit(true);
+}
+
+void PowerManager::wake(const char* reason) {
+  last_activity_ = millis();
+  if (!low_power_) {
+    return;
+  }
+  low_power_ = false;
+  setCpuFrequencyMhz(full_power_cpu_frequency_);
+  esp_wifi_set_ps(WIFI_PS_MIN_MODEM);
+  debugI("PowerManager: Woken up by %s, full power restored", reason);
+  this->emit(false);
+}
+
+void PowerManager::sleep() {
+  const Parameters& params = params_.get();
+  if (!low_power_ || !params.light_sleep ||
+      millis() - wake_time_ < awake_time_) {
+    return;
+  }
+
+  // Wake up on the opposite of the current level of each pin, which
+  // catches the next edge in either direction. gpio_wakeup_enable()
+  // replaces the interrupt type of the pin with a level interrupt, which
+  // would call an attached edge interrupt handler, like PulseCounter's,
+  // over and over. The interrupt is disabled while sleeping, and the type
+  // and enable bits set up by the owner of the pin are restored afterwards.
+  for (int i = 0; i < num_wakeup_pins_; i++) {
+    WakeupPin& wakeup_pin = wakeup_pins_[i];
+    wakeup_pin.level = digitalRead(wakeup_pin.pin);
+    wakeup_pin.interrupt_type = GPIO.pin[wakeup_pin.pin].int_type;
+    wakeup_pin.interrupt_enable = GPIO.pin[wakeup_pin.pin].int_ena;
+    gpio_intr_disable(wakeup_pin.pin);
+    if (wakeup_pin.source == WakeSource::kCAN && !params.wake_on_can) {
+      continue;
+    }
+    gpio_wakeup_enable(wakeup_pin.pin, wakeup_pin.level ? GPIO_INTR_LOW_LEVEL
+                                                        : GPIO_INTR_HIGH_LEVEL);
+  }
+  esp_sleep_enable_gpio_wakeup();
+  esp_sleep_enable_timer_wakeup(1000ULL * params.sleep_duration);
+
+  esp_light_sleep_start();
+  wake_time_ = millis();
+  awake_time_ = kAwakeTime;
+
+  for (int i = 0; i < num_wakeup_pins_; i++) {
+    const WakeupPin& wakeup_pin = wakeup_pins_[i];
+    gpio_wakeup_disable(wakeup_pin.pin);
+    gpio_set_intr_type(wakeup_pin.pin,
+                       (gpio_int_type_t)wakeup_pin.interrupt_type);
+    if (wakeup_pin.interrupt_enable) {
+      gpio_intr_enable(wakeup_pin.pin);
+    }
+  }
+
+  if (esp_sleep_get_wakeup_cause() != ESP_SLEEP_WAKEUP_GPIO) {
+    return;
+  }
+  // An alarm input or a tacho input still held at its new level restores
+  // full power right away. Otherwise the edge was a short tacho pulse or a
+  // CAN frame, which is not activity by itself: stay awake for a while, so
+  // that tacho_input() sees the counted pulses of a running engine and
+  // handle_can_message() the engine speeds on the bus.
+  for (int i = 0; i < num_wakeup_pins_; i++) {
+    const WakeupPin& wakeup_pin = wakeup_pins_[i];
+    if (wakeup_pin.source != WakeSource::kCAN &&
+        digitalRead(wakeup_pin.pin) != wakeup_pin.level) {
+      wake(WakeSourceName(wakeup_pin.source));
+      return;
+    }
+  }
+  awake_time_ = kListenTime;
+}
+
+bool PowerManager::to_json(JsonObject& config) {
+  Parameters params = params_.get_latest();
+  config["enabled"] = params.enabled;
+  config["engine_off_delay"] = params.engine_off_delay;
+  config["cpu_frequency"] = params.cpu_frequency;
+  config["sample_interval"] = params.sample_interval;
+  config["light_sleep"] = params.light_sleep;
+  config["sleep_duration"] = params.sleep_duration;
+  config["wake_on_can"] = params.wake_on_can;
+  return true;
+}
+
+bool PowerManager::from_json(const JsonObject& config) {
+  if (!config["enabled"].is<bool>() || !config["engine_off_delay"].is<int>() ||
+      !config["cpu_frequency"].is<int>() ||
+      !config["sample_interval"].is<int>() ||
+      !config["light_sleep"].is<bool>() ||
+      !config["sleep_duration"].is<int>() ||
+      !config["wake_on_can"].is<bool>()) {
+    debugE("PowerManager: Invalid configuration");
+    return false;
+  }
+  Parameters params;
+  params.enabled = config["enabled"];
+  params.engine_off_delay = config["engine_off_delay"];
+  params.cpu_frequency = config["cpu_frequency"];
+  params.sample_interval = config["sample_interval"];
+  params.light_sleep = config["light_sleep"];
+  params.sleep_duration = config["sleep_duration"];
+  params.wake_on_can = config["wake_on_can"];
+
+  // WiFi requires at least 80 MHz
+  if (params.cpu_frequency != 160 && params.cpu_frequency != 240) {
+    params.cpu_frequency = 80;
+  }
+  if (params.sample_interval == 0) {
+    params.sample_interval = 1;
+  } else if (params.sample_interval > kMaxSampleInterval) {
+    params.sample_interval = kMaxSampleInterval;
+  }
+  // Applied by check_engine_off() in the event loop, which also restores
+  // full power if power management was disabled
+  params_.set(params);
+  return true;
+}
+
+const String ConfigSchema(const PowerManager& obj) {
+  return R"###({
+    "type": "object",
+    "properties": {
+      "enabled": { "title": "Enabled", "type": "boolean", "description": "Enter low-power mode when the engine is off" },
+      "engine_off_delay": { "title": "Engine-off delay", "type": "integer", "description": "Time without tacho pulses or other activity before entering low-power mode (s)" },
+      "cpu_frequency": { "title": "CPU frequency", "type": "integer", "description": "CPU clock in low-power mode: 80, 160 or 240 MHz" },
+      "sample_interval": { "title": "Analog sample interval", "type": "integer", "description": "Analog input read interval in low-power mode, at most 8 s (s)" },
+      "light_sleep": { "title": "Light sleep", "type": "boolean", "description": "Sleep between event loop rounds in low-power mode. WiFi connections are not maintained during light sleep." },
+      "sleep_duration": { "title": "Sleep duration", "type": "integer", "description": "Maximum light sleep duration (ms)" },
+      "wake_on_can": { "title": "Wake on CAN", "type": "boolean", "description": "Restore full power when another device on the NMEA 2000 bus reports a running engine" }
+    }
+  })###";
+}
+
+}  // namespace halmet
@@ -0,0 +1,136 @@
+#ifndef HALMET_SRC_POWER_MANAGER_H_
+#define HALMET_SRC_POWER_MANAGER_H_
+
+#include <N2kMsg.h>
+#include <driver/gpio.h>
+
+#include "live_config.h"
+#include "sensesp/system/saveable.h"
+#include "sensesp/system/valueconsumer.h"
+#include "sensesp/system/valueproducer.h"
+#include "sensesp_base_app.h"
+
+namespace halmet {
+
+/**
+ * @brief Engine-off low-power mode.
+ *
+ * When no tacho input has reported a non-zero engine speed for the
+ * configured delay, the device enters low-power mode: the CPU clock is
+ * reduced, WiFi modem sleep is maximized, the analog inputs are sampled at
+ * a long interval and the display is switched off. With light sleep
+ * enabled, the device additionally sleeps between event loop rounds.
+ *
+ * A non-zero engine speed, an alarm change or, optionally, an engine speed
+ * reported by another device on the NMEA 2000 bus restores full power.
+ * Other bus traffic doesn't count as activity. While in light sleep, edges
+ * on the registered wakeup pins wake the CPU directly.
+ *
+ * The producer emits true when entering and false when leaving low-power
+ * mode.
+ */
+class PowerManager : public sensesp::FileSystemSaveable,
+                     public sensesp::ValueProducer<bool> {
+ public:
+  enum class WakeSource { kTacho, kAlarm, kCAN };
+
+  /// Longest analog read interval in low-power mode (s). Kept below the
+  /// expiry of the NMEA 2000 fluid level inputs, so that the tank levels
+  /// don't turn "not available" between samples.
+  static const unsigned int kMaxSampleInterval = 8;
+
+  PowerManager(const String& config_path);
+
+  /// Consumer for an engine speed; connect every tacho output.
+  sensesp::ValueConsumer<float>* tacho_input() { return &tacho_input_; }
+
+  /// Consumer for an alarm state. Any change restores full power.
+  sensesp::ValueConsumer<bool>* alarm_input();
+
+  /// Wake the CPU from light sleep on level changes of the pin. An
+  /// interrupt handler attached to the pin is disabled during light sleep
+  /// and its interrupt type restored afterwards.
+  void add_wakeup_pin(gpio_num_t pin, WakeSource source);
+
+  /// Handle a message received from the NMEA 2000 bus. Only engine speeds
+  /// above zero are treated as activity.
+  void handle_can_message(const tN2kMsg& msg);
+
+  bool is_low_power() const { return low_power_; }
+
+  /// Read interval of the analog inputs in low-power mode (ms)
+  unsigned int get_sample_interval() const {
+    return 1000 * params_.get().sample_interval;
+  }
+
+  virtual bool to_json(JsonObject& config) override;
+  virtual bool from_json(const JsonObject& config) override;
+
+ protected:
+  class TachoInput : public sensesp::ValueConsumer<float> {
+   public:
+    TachoInput(PowerManager* manager) : manager_{manager} {}
+    void set(const float& value) override;
+
+   private:
+    PowerManager* manager_;
+  };
+
+  class AlarmInput : public sensesp::ValueConsumer<bool> {
+   public:
+    AlarmInput(PowerManager* manager) : manager_{manager} {}
+    void set(const bool& value) override;
+
+   private:
+    PowerManager* manager_;
+    bool initialized_ = false;
+    bool state_ = false;
+  };
+
+  struct Parameters {
+    bool enabled = true;
+    unsigned int engine_off_delay = 600;      // s
+    unsigned int cpu_frequency = 80;          // MHz
+    unsigned int sample_interval = kMaxSampleInterval;  // s
+    bool light_sleep = false;
+    unsigned int sleep_duration = 1000;       // ms
+    bool wake_on_can = false;
+  };
+
+  struct WakeupPin {
+    gpio_num_t pin;
+    WakeSource source;
+    // Saved while in light sleep
+    int level;
+    uint32_t interrupt_type;
+    uint32_t interrupt_enable;
+  };
+  static const int kMaxWakeupPins = 8;
+
+  void check_engine_off();
+  void enter_low_power();
+  void wake(const char* reason);
+  void sleep();
+
+  LiveConfig<Parameters> params_;
+
+  TachoInput tacho_input_{this};
+
+  WakeupPin wakeup_pins_[kMaxWakeupPins];
+  int num_wakeup_pins_ = 0;
+
+  bool low_power_ = false;
+  uint32_t last_activity_ = 0;
+  uint32_t wake_time_ = 0;
+  unsigned int awake_time_ = 0;  // ms
+  uint32_t full_power_cpu_frequency_ = 240;  // MHz
+};
+
+const String ConfigSchema(const PowerManager& obj);
+
+/// Global power manager instance. Null if power management is not enabled.
+extern PowerManager* power_manager;
+
+}  // namespace halmet
+
+#endif  // HALMET_SRC_POWER_MANAGER_H_
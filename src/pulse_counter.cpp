@@ -0,0 +1,106 @@
+#include "pulse_counter.h"
+
+#include <driver/gpio.h>
+#include <esp_intr_alloc.h>
+
+namespace halmet {
+
+namespace {
+
+gpio_int_type_t InterruptType(int interrupt_type) {
+  switch (interrupt_type) {
+    case FALLING:
+      return GPIO_INTR_NEGEDGE;
+    case CHANGE:
+      return GPIO_INTR_ANYEDGE;
+    default:
+      return GPIO_INTR_POSEDGE;
+  }
+}
+
+}  // namespace
+
+// The Arduino core installs the service without ESP_INTR_FLAG_IRAM on the
+// first attachInterrupt(), so it has to be installed before that.
+void InstallGpioInterruptService() {
+  static bool installed = false;
+  if (installed) {
+    return;
+  }
+  installed = true;
+  if (gpio_install_isr_service(ESP_INTR_FLAG_IRAM) == ESP_ERR_INVALID_STATE) {
+    debugW(
+        "GPIO interrupt service already installed; interrupts may be "
+        "delayed during flash writes");
+  }
+}
+
+PulseCounter::PulseCounter(uint8_t pin, int pin_mode, int interrupt_type,
+                           unsigned int read_delay,
+                           const String& config_path)
+    : sensesp::IntSensor(config_path), pin_{pin}, read_delay_{read_delay} {
+  load();
+
+  InstallGpioInterruptService();
+  pinMode(pin_, pin_mode);
+  gpio_set_intr_type((gpio_num_t)pin_, InterruptType(interrupt_type));
+  gpio_isr_handler_add((gpio_num_t)pin_, isr, this);
+  gpio_intr_enable((gpio_num_t)pin_);
+
+  repeat_event_ = sensesp::event_loop()->onRepeat(
+      read_delay_, [this]() { this->read(); });
+}
+
+void PulseCounter::set_triggered() {
+  if (repeat_event_ != nullptr) {
+    repeat_event_->remove(sensesp::event_loop());
+    repeat_event_ = nullptr;
+  }
+}
+
+void IRAM_ATTR PulseCounter::isr(void* arg) {
+  PulseCounter* counter = static_cast<PulseCounter*>(arg);
+  portENTER_CRITICAL_ISR(&counter->lock_);
+  counter->count_++;
+  counter->total_++;
+  portEXIT_CRITICAL_ISR(&counter->lock_);
+}
+
+void PulseCounter::read() {
+  portENTER_CRITICAL(&lock_);
+  int count = count_;
+  count_ = 0;
+  portEXIT_CRITICAL(&lock_);
+  this->emit(count);
+}
+
+uint32_t PulseCounter::get_total() {
+  portENTER_CRITICAL(&lock_);
+  uint32_t total = total_;
+  portEXIT_CRITICAL(&lock_);
+  return total;
+}
+
+bool PulseCounter::to_json(JsonObject& config) {
+  config["read_delay"] = read_delay_;
+  return true;
+}
+
+bool PulseCounter::from_json(const JsonObject& config) {
+  if (!config["read_delay"].is<int>()) {
+    return false;
+  }
+  read_delay_ = config["read_delay"];
+  return true;
+}
+
+const String ConfigSchema(const PulseCounter& obj) {
+  return R"###({
+    "type": "object",
+    "properties": {
+      "read_delay": { "title": "Read delay", "type": "number", "description": "The time, in milliseconds, between each read of the input" }
+    }
+  })###";
+}
+
+}  // namespace halmet
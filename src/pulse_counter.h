@@ -0,0 +1,74 @@
+#ifndef HALMET_SRC_PULSE_COUNTER_H_
+#define HALMET_SRC_PULSE_COUNTER_H_
+
+#include <esp_attr.h>
+#include <freertos/FreeRTOS.h>
+
+#include "sensesp/sensors/sensor.h"
+#include "sensesp_base_app.h"
+
+namespace halmet {
+
+/**
+ * @brief Install the GPIO interrupt service shared by all GPIO interrupts as
+ * IRAM-safe, unless it is already installed.
+ */
+void InstallGpioInterruptService();
+
+/**
+ * @brief Count the pulses on a digital input, also while the flash is being
+ * written.
+ *
+ * Writing the flash, for example when a configuration is saved or an OTA
+ * update is received, disables the flash cache. Interrupts whose handlers
+ * run from flash, like that of SensESP's DigitalInputCounter, are held off
+ * meanwhile, and of the edges arriving during a write only one is counted.
+ * PulseCounter installs the GPIO interrupt service as IRAM-safe and keeps
+ * its handler in IRAM and the counters in internal RAM, so edges are
+ * counted during flash writes as well.
+ *
+ * Like DigitalInputCounter, the count is emitted and reset every read_delay
+ * ms.
+ */
+class PulseCounter : public sensesp::IntSensor {
+ public:
+  PulseCounter(uint8_t pin, int pin_mode, int interrupt_type,
+               unsigned int read_delay, const String& config_path = "");
+
+  virtual bool to_json(JsonObject& config) override;
+  virtual bool from_json(const JsonObject& config) override;
+
+  /// Pulses counted since startup
+  uint32_t get_total();
+
+  /// Emit and reset the count only when sample() is called, for example at
+  /// the start of the NMEA 2000 transmission using it, instead of every
+  /// read_delay ms.
+  void set_triggered();
+
+  /// Emit and reset the count in triggered mode.
+  void sample() { read(); }
+
+ protected:
+  static void isr(void* arg);
+  void read();
+
+  uint8_t pin_;
+  unsigned int read_delay_;
+  reactesp::RepeatEvent* repeat_event_ = nullptr;
+
+  // Updated by the interrupt handler
+  uint32_t count_ = 0;
+  uint32_t total_ = 0;
+  portMUX_TYPE lock_ = portMUX_INITIALIZER_UNLOCKED;
+};
+
+const String ConfigSchema(const PulseCounter& obj);
+
+inline const bool ConfigRequiresRestart(const PulseCounter& obj) {
+  return true;
+}
+
+}  // namespace halmet
+
+#endif  // HALMET_SRC_PULSE_COUNTER_H_
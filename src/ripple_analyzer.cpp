@@ -0,0 +1,390 @@
+#include "ripple_analyzer.h"
+
+#include <algorithm>
+#include <cmath>
+
+#if __has_include(<esp_dsp.h>)
+#include <esp_dsp.h>
+#define HALMET_RIPPLE_USE_ESP_DSP
+#endif
+
+#include "deferred_log.h"
+#include "sensesp/signalk/signalk_output.h"
+#include "sensesp/ui/config_item.h"
+#include "setup_arena.h"
+
+namespace halmet {
+
+namespace {
+
+static_assert((RippleAnalyzer::kBurstSize &
+               (RippleAnalyzer::kBurstSize - 1)) == 0,
+              "HALMET_RIPPLE_BURST_SIZE must be a power of two");
+
+// Interval for checking whether a burst is due or finished
+const unsigned int kPollInterval = 10;  // ms
+
+// The capture task preempts the event loop on the same core, so that the
+// conversions are started on time
+const UBaseType_t kTaskPriority = 5;
+const BaseType_t kTaskCore = 1;
+const uint32_t kTaskStackSize = 4096;
+
+// Sample rate limits. A sample period has to fit the conversion at
+// 860 SPS (up to 1.28 ms with the oscillator tolerance) and the I2C
+// transfers at the default 100 kHz bus clock.
+const unsigned int kMinSampleRate = 10;   // Hz
+const unsigned int kMaxSampleRate = 500;  // Hz
+
+// Largest deviation of a sample instant from the sample period, as a
+// fraction of the period. At 500 Hz, a sample an eighth of a period early
+// still leaves the 1.28 ms for the previous conversion.
+const int kMaxJitterDivisor = 8;
+
+// Lowest FFT bin considered for the dominant frequency. Bins 0 and 1
+// contain the leakage of the mean and of slow voltage drift.
+const int kMinPeakBin = 2;
+
+#ifndef HALMET_RIPPLE_USE_ESP_DSP
+
+void HannWindow(float* window, int n) {
+  for (int i = 0; i < n; i++) {
+    window[i] = 0.5f * (1 - cosf(2 * M_PI * i / (n - 1)));
+  }
+}
+
+// In-place radix-2 FFT of n interleaved complex values
+void Fft(float* data, int n) {
+  for (int i = 1, j = 0; i < n; i++) {
+    int bit = n >> 1;
+    for (; j & bit; bit >>= 1) {
+      j ^= bit;
+    }
+    j ^= bit;
+    if (i < j) {
+      std::swap(data[2 * i], data[2 * j]);
+      std::swap(data[2 * i + 1], data[2 * j + 1]);
+    }
+  }
+
+  for (int length = 2; length <= n; length <<= 1) {
+    float angle = -2 * M_PI / length;
+    float w_re = cosf(angle);
+    float w_im = sinf(angle);
+    for (int start = 0; start < n; start += length) {
+      float u_re = 1;
+      float u_im = 0;
+      for (int k = 0; k < length / 2; k++) {
+        float* a = &data[2 * (start + k)];
+        float* b = &data[2 * (start + k + length / 2)];
+        float t_re = b[0] * u_re - b[1] * u_im;
+        float t_im = b[0] * u_im + b[1] * u_re;
+        b[0] = a[0] - t_re;
+        b[1] = a[1] - t_im;
+        a[0] += t_re;
+        a[1] += t_im;
+        float next_re = u_re * w_re - u_im * w_im;
+        u_im = u_re * w_im + u_im * w_re;
+        u_re = next_re;
+      }
+    }
+  }
+}
+
+#endif  // HALMET_RIPPLE_USE_ESP_DSP
+
+}  // namespace
+
+RippleAnalyzer::RippleAnalyzer(ADS1115VoltageInput* input,
+                               const String& config_path)
+    : sensesp::FileSystemSaveable{config_path}, input_{input} {
+  load();
+  params_.update();
+
+#ifdef HALMET_RIPPLE_USE_ESP_DSP
+  // The FFT tables are shared by all analyzers
+  static bool fft_initialized = false;
+  if (!fft_initialized) {
+    esp_err_t err = dsps_fft2r_init_fc32(nullptr, kBurstSize);
+    if (err != ESP_OK) {
+      debugE("RippleAnalyzer: FFT initialization failed: %d", err);
+    }
+    fft_initialized = true;
+  }
+  dsps_wind_hann_f32(window_, kBurstSize);
+#else
+  HannWindow(window_, kBurstSize);
+#endif
+
+  if (!config_path.isEmpty()) {
+    AddProfilerStatistics(config_path + " analysis time", &analysis_time_);
+  }
+
+  xTaskCreatePinnedToCore(task_function, "ripple", kTaskStackSize, this,
+                          kTaskPriority, &task_, kTaskCore);
+
+  esp_timer_create_args_t timer_args = {};
+  timer_args.callback = timer_callback;
+  timer_args.arg = this;
+  timer_args.name = "ripple";
+  esp_timer_create(&timer_args, &timer_);
+
+  sensesp::event_loop()->onRepeat(kPollInterval, [this]() { this->poll(); });
+}
+
+void RippleAnalyzer::task_function(void* arg) {
+  auto analyzer = static_cast<RippleAnalyzer*>(arg);
+  while (true) {
+    uint32_t ticks = ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+    analyzer->sample(ticks);
+  }
+}
+
+void RippleAnalyzer::timer_callback(void* arg) {
+  xTaskNotifyGive(static_cast<RippleAnalyzer*>(arg)->task_);
+}
+
+void RippleAnalyzer::poll() {
+  params_.update();
+  State state = state_;
+  if (state == State::kDone || state == State::kFailed) {
+    finish_burst(state);
+  } else if (state == State::kIdle && params_.get().enabled &&
+             millis() - last_burst_ >= 1000 * params_.get().interval) {
+    start_burst();
+  }
+}
+
+void RippleAnalyzer::start_burst() {
+  last_burst_ = millis();
+  state_ = State::kWaiting;
+  bool acquired = input_->get_scanner()->acquire(
+      input_->get_input(), [this](Adafruit_ADS1115* ads1115) {
+        ads1115_ = ads1115;
+        ads1115_->setDataRate(RATE_ADS1115_860SPS);
+        burst_sample_rate_ = params_.get().sample_rate;
+        // The conversion to volts is linear. Take the factor here, as the
+        // input parameters may only be read from the event loop.
+        volts_per_code_ = input_->to_volts(1);
+        sample_index_ = 0;
+        previous_sample_time_ = 0;
+        // TwoWire serializes the transfers, so a sample waiting for a
+        // transfer of the event loop would be late. Keep the bus free.
+        input_->get_scanner()->pause();
+        capturing_.set(true);
+        state_ = State::kCapturing;
+        esp_timer_start_periodic(timer_, 1000000 / burst_sample_rate_);
+      });
+  if (!acquired) {
+    // The converter is missing; try again at the next interval
+    state_ = State::kIdle;
+  }
+}
+
+void RippleAnalyzer::sample(uint32_t ticks) {
+  if (state_ != State::kCapturing) {
+    return;
+  }
+  // Reject the burst if a sample instant was missed or the task ran late,
+  // for example while a higher priority task was running. The burst
+  // would no longer be evenly spaced, and a sample following a late one
+  // too closely could read the conversion before it has finished.
+  int64_t now = esp_timer_get_time();
+  int64_t period = 1000000 / burst_sample_rate_;
+  int64_t jitter = now - previous_sample_time_ - period;
+  if (ticks > 1 || (previous_sample_time_ != 0 &&
+                    std::abs(jitter) > period / kMaxJitterDivisor)) {
+    esp_timer_stop(timer_);
+    state_ = State::kFailed;
+    return;
+  }
+  previous_sample_time_ = now;
+
+  // The conversion started at the previous tick has completed
+  if (sample_index_ > 0) {
+    samples_[sample_index_ - 1] = ads1115_->getLastConversionResults();
+  }
+  if (sample_index_ < kBurstSize) {
+    ads1115_->startADCReading(ADS1115Scanner::mux(input_->get_input()),
+                              /*continuous=*/false);
+    sample_index_++;
+    return;
+  }
+
+  esp_timer_stop(timer_);
+  analyze();
+  state_ = State::kDone;
+}
+
+void RippleAnalyzer::analyze() {
+  int64_t start = esp_timer_get_time();
+
+  float sum = 0;
+  for (int i = 0; i < kBurstSize; i++) {
+    float volts = volts_per_code_ * samples_[i];
+    data_[2 * i] = volts;
+    sum += volts;
+  }
+  float mean = sum / kBurstSize;
+  float sum_sq = 0;
+  for (int i = 0; i < kBurstSize; i++) {
+    float ac = data_[2 * i] - mean;
+    data_[2 * i] = ac;
+    data_[2 * i + 1] = 0;
+    sum_sq += ac * ac;
+  }
+  amplitude_result_ = sqrtf(sum_sq / kBurstSize);
+
+#ifdef HALMET_RIPPLE_USE_ESP_DSP
+  dsps_mul_f32(data_, window_, data_, kBurstSize, 2, 1, 2);
+  dsps_fft2r_fc32(data_, kBurstSize);
+  dsps_bit_rev_fc32(data_, kBurstSize);
+#else
+  for (int i = 0; i < kBurstSize; i++) {
+    data_[2 * i] *= window_[i];
+  }
+  Fft(data_, kBurstSize);
+#endif
+
+  // Magnitudes of the bins below the Nyquist frequency, in place
+  for (int k = 0; k < kBurstSize / 2; k++) {
+    data_[k] = sqrtf(data_[2 * k] * data_[2 * k] +
+                     data_[2 * k + 1] * data_[2 * k + 1]);
+  }
+  int peak = kMinPeakBin;
+  for (int k = kMinPeakBin + 1; k < kBurstSize / 2 - 1; k++) {
+    if (data_[k] > data_[peak]) {
+      peak = k;
+    }
+  }
+  // Parabolic interpolation between the neighbouring bins
+  float offset = 0;
+  float denominator = data_[peak - 1] - 2 * data_[peak] + data_[peak + 1];
+  if (denominator < 0) {
+    offset = 0.5f * (data_[peak - 1] - data_[peak + 1]) / denominator;
+  }
+  frequency_result_ =
+      (peak + offset) * (float)burst_sample_rate_ / kBurstSize;
+
+  analysis_time_result_ = esp_timer_get_time() - start;
+}
+
+void RippleAnalyzer::finish_burst(State state) {
+  capturing_.set(false);
+  input_->get_scanner()->resume();
+  input_->get_scanner()->release(input_->get_input());
+  ads1115_ = nullptr;
+
+  if (state == State::kDone) {
+    analysis_time_.add(analysis_time_result_);
+    deferredD("RippleAnalyzer: %.3f V RMS, %.1f Hz, analysis %.0f us",
+              amplitude_result_, frequency_result_, analysis_time_result_);
+    amplitude_.set(amplitude_result_);
+    frequency_.set(frequency_result_);
+  } else {
+    discarded_++;
+    debugW("RippleAnalyzer: Burst discarded, sampling was delayed (%u)",
+           discarded_);
+  }
+  state_ = State::kIdle;
+}
+
+bool RippleAnalyzer::to_json(JsonObject& config) {
+  Parameters params = params_.get_latest();
+  config["enabled"] = params.enabled;
+  config["interval"] = params.interval;
+  config["sample_rate"] = params.sample_rate;
+  return true;
+}
+
+bool RippleAnalyzer::from_json(const JsonObject& config) {
+  if (!config["enabled"].is<bool>() || !config["interval"].is<int>() ||
+      !config["sample_rate"].is<int>()) {
+    return false;
+  }
+  Parameters params;
+  params.enabled = config["enabled"];
+  params.interval = config["interval"];
+  params.sample_rate = config["sample_rate"];
+  params.sample_rate = std::min(std::max(params.sample_rate, kMinSampleRate),
+                                kMaxSampleRate);
+  params_.set(params);
+  return true;
+}
+
+const String ConfigSchema(const RippleAnalyzer& obj) {
+  return R"###({
+    "type": "object",
+    "properties": {
+      "enabled": { "title": "Enabled", "type": "boolean", "description": "Capture and analyze sample bursts" },
+      "interval": { "title": "Burst interval", "type": "integer", "description": "Time between the starts of two bursts (s)" },
+      "sample_rate": { "title": "Sample rate", "type": "integer", "description": "Sample rate within a burst, 10-500 Hz. The frequency resolution is the sample rate divided by the burst size." }
+    }
+  })###";
+}
+
+RippleAnalyzer* ConnectRippleAnalyzer(ADS1115VoltageInput* input,
+                                      const String& name,
+                                      const String& sk_path_prefix,
+                                      int sort_order) {
+  char config_path[80];
+  char config_title[80];
+  char config_description[80];
+
+  snprintf(config_path, sizeof(config_path), "/Ripple/%s/Analyzer",
+           name.c_str());
+  snprintf(config_title, sizeof(config_title), "%s Ripple", name.c_str());
+  snprintf(config_description, sizeof(config_description),
+           "Ripple and spectrum analysis of %s", name.c_str());
+
+  auto analyzer = ArenaNew<RippleAnalyzer>(input, config_path);
+
+  ConfigItem(analyzer)
+      ->set_title(config_title)
+      ->set_description(config_description)
+      ->set_sort_order(sort_order);
+
+#ifdef ENABLE_SIGNALK
+  struct {
+    const char* key;
+    const char* title;
+    sensesp::ObservableValue<float>* producer;
+    const char* units;
+  } outputs[] = {
+      {"amplitude", "Amplitude", &analyzer->amplitude_, "V"},
+      {"frequency", "Frequency", &analyzer->frequency_, "Hz"},
+  };
+
+  char sk_path[80];
+  char meta_display_name[80];
+  int output_sort_order = sort_order;
+  for (auto& output : outputs) {
+    snprintf(config_path, sizeof(config_path), "/Ripple/%s/%s SK Path",
+             name.c_str(), output.title);
+    snprintf(sk_path, sizeof(sk_path), "%s.%s", sk_path_prefix.c_str(),
+             output.key);
+    snprintf(config_title, sizeof(config_title), "%s Ripple %s SK Path",
+             name.c_str(), output.title);
+    snprintf(config_description, sizeof(config_description),
+             "Signal K path for the ripple %s of %s", output.key,
+             name.c_str());
+    snprintf(meta_display_name, sizeof(meta_display_name), "%s Ripple %s",
+             name.c_str(), output.title);
+
+    auto sk_output = ArenaNew<sensesp::SKOutputFloat>(
+        sk_path, config_path,
+        new sensesp::SKMetadata(output.units, meta_display_name));
+
+    ConfigItem(sk_output)
+        ->set_title(config_title)
+        ->set_description(config_description)
+        ->set_sort_order(++output_sort_order);
+
+    output.producer->connect_to(sk_output);
+  }
+#endif
+
+  return analyzer;
+}
+
+}  // namespace halmet
@@ -0,0 +1,135 @@
+#ifndef HALMET_SRC_RIPPLE_ANALYZER_H_
+#define HALMET_SRC_RIPPLE_ANALYZER_H_
+
+#include <esp_timer.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+
+#include <atomic>
+
+#include "halmet_analog.h"
+#include "live_config.h"
+#include "pipeline_profiler.h"
+#include "sensesp/system/observablevalue.h"
+#include "sensesp/system/saveable.h"
+#include "sensesp_base_app.h"
+
+#ifndef HALMET_RIPPLE_BURST_SIZE
+#define HALMET_RIPPLE_BURST_SIZE 256
+#endif
+
+namespace halmet {
+
+/**
+ * @brief Ripple and spectrum analysis of a HALMET voltage input.
+ *
+ * The regular samples of an ADS1115VoltageInput are far too sparse to show
+ * the ripple on a charging voltage. At the configured interval, the
+ * analyzer takes over the converter of the input and captures a burst of
+ * HALMET_RIPPLE_BURST_SIZE (a power of two) samples at the fastest data
+ * rate of the ADS1115. The conversions are started by a dedicated task
+ * woken by a periodic esp_timer, so the sample instants don't depend on the
+ * event loop. The I2C bus is shared, and a conversion has to wait for any
+ * transfer in progress, so the scanner is paused and capturing_ is true for
+ * the duration of the burst; connect the other devices on the bus, such as
+ * the display, to it. A burst with any sample more than an eighth of the
+ * sample period off schedule, for example delayed by other tasks, is
+ * discarded.
+ *
+ * The burst is analyzed in the same task. The mean, i.e. the charging
+ * voltage, is removed and the RMS of the remainder is the ripple amplitude.
+ * The dominant frequency is the largest peak of the Hann-windowed FFT,
+ * interpolated between bins. The FFT and the windowing use the esp-dsp
+ * library, which has optimized ESP32 kernels, if it is available, and
+ * portable C++ otherwise.
+ *
+ * The ADS1115 digital filter attenuates components above a few hundred Hz
+ * and anything above half the sample rate is aliased, so diode ripple at
+ * typical alternator speeds does not show up at its true frequency. The
+ * amplitude still rises with a failed diode, and slower oscillations such
+ * as regulator hunting are resolved directly.
+ */
+class RippleAnalyzer : public sensesp::FileSystemSaveable {
+ public:
+  static const int kBurstSize = HALMET_RIPPLE_BURST_SIZE;
+
+  RippleAnalyzer(ADS1115VoltageInput* input, const String& config_path = "");
+
+  virtual bool to_json(JsonObject& config) override;
+  virtual bool from_json(const JsonObject& config) override;
+
+  sensesp::ObservableValue<float> amplitude_;  // RMS ripple voltage (V)
+  sensesp::ObservableValue<float> frequency_;  // Dominant frequency (Hz)
+  /// True while a burst holds the I2C bus
+  sensesp::ObservableValue<bool> capturing_{false};
+
+  /// CPU time spent analyzing a burst (us)
+  const RunningStatistics& get_analysis_time_statistics() const {
+    return analysis_time_;
+  }
+
+ protected:
+  enum class State { kIdle, kWaiting, kCapturing, kDone, kFailed };
+
+  static void task_function(void* arg);
+  static void timer_callback(void* arg);
+
+  // Event loop side
+  void poll();
+  void start_burst();
+  void finish_burst(State state);
+
+  // Capture task side
+  void sample(uint32_t ticks);
+  void analyze();
+
+  struct Parameters {
+    bool enabled = true;
+    unsigned int interval = 10;      // s
+    unsigned int sample_rate = 400;  // Hz
+  };
+
+  ADS1115VoltageInput* input_;
+  Adafruit_ADS1115* ads1115_ = nullptr;
+
+  LiveConfig<Parameters> params_;
+
+  TaskHandle_t task_ = nullptr;
+  esp_timer_handle_t timer_ = nullptr;
+  std::atomic<State> state_{State::kIdle};
+  uint32_t last_burst_ = 0;  // ms
+
+  // Owned by the capture task while a burst is running
+  unsigned int burst_sample_rate_ = 0;  // Hz
+  float volts_per_code_ = 0;
+  int sample_index_ = 0;
+  int64_t previous_sample_time_ = 0;  // us
+  int16_t samples_[kBurstSize];
+  alignas(16) float data_[2 * kBurstSize];  // Interleaved complex values
+  alignas(16) float window_[kBurstSize];
+  float amplitude_result_ = 0;
+  float frequency_result_ = 0;
+  float analysis_time_result_ = 0;
+
+  RunningStatistics analysis_time_;
+  uint32_t discarded_ = 0;
+};
+
+const String ConfigSchema(const RippleAnalyzer& obj);
+
+/**
+ * @brief Analyze the ripple of a voltage input and output the amplitude and
+ * the dominant frequency to Signal K.
+ *
+ * The Signal K paths are formed from sk_path_prefix, for example
+ * "sensors.a2.ripple" gives "sensors.a2.ripple.amplitude" and
+ * "sensors.a2.ripple.frequency".
+ */
+RippleAnalyzer* ConnectRippleAnalyzer(ADS1115VoltageInput* input,
+                                      const String& name,
+                                      const String& sk_path_prefix,
+                                      int sort_order);
+
+}  // namespace halmet
+
+#endif  // HALMET_SRC_RIPPLE_ANALYZER_H_
@@ -0,0 +1,7 @@
+#include "sample_age.h"
+
+namespace halmet {
+
+uint32_t current_sample_time = 0;
+
+}  // namespace halmet
@@ -0,0 +1,112 @@
+#ifndef HALMET_SRC_SAMPLE_AGE_H_
+#define HALMET_SRC_SAMPLE_AGE_H_
+
+#include "pipeline_profiler.h"
+#include "sensesp/system/lambda_consumer.h"
+#include "sensesp/system/valueproducer.h"
+
+namespace halmet {
+
+/**
+ * Acquisition time (ms) of the sample currently propagating through the
+ * pipelines.
+ *
+ * Transforms pass values on synchronously, so everything downstream of a
+ * sensor sees the acquisition time set by that sensor until the emit call
+ * returns. Consumers that cache values (such as RepeatExpiring or the N2k
+ * senders) must copy the time when the value arrives.
+ */
+extern uint32_t current_sample_time;
+
+inline void MarkSampleAcquired(uint32_t acquisition_time = millis()) {
+  current_sample_time = acquisition_time;
+}
+
+/**
+ * @brief Age statistics with percentiles.
+ *
+ * Ages are counted in a log-linear histogram: exact up to 15 ms, then four
+ * buckets per power of two, which bounds the percentile error to 25 %
+ * with constant memory and O(1) updates.
+ */
+class AgeStatistics : public RunningStatistics {
+ public:
+  static const int kNumBuckets = 64;
+
+  void add(uint32_t age) {
+    RunningStatistics::add(age);
+    buckets_[bucket(age)]++;
+  }
+
+  /// Upper bound of the age at the given quantile (0-1), in ms.
+  uint32_t percentile(float quantile) const {
+    uint32_t target = ceilf(quantile * count_);
+    uint32_t cumulative = 0;
+    for (int i = 0; i < kNumBuckets; i++) {
+      cumulative += buckets_[i];
+      if (cumulative >= target && cumulative > 0) {
+        return upper_bound(i);
+      }
+    }
+    return 0;
+  }
+
+ protected:
+  static int bucket(uint32_t age) {
+    if (age < 16) {
+      return age;
+    }
+    int msb = 31 - __builtin_clz(age);
+    int index = 16 + (msb - 4) * 4 + ((age >> (msb - 2)) & 3);
+    return index < kNumBuckets ? index : kNumBuckets - 1;
+  }
+
+  static uint32_t upper_bound(int index) {
+    if (index < 16) {
+      return index;
+    }
+    int msb = (index - 16) / 4 + 4;
+    int sub = (index - 16) % 4;
+    return ((5 + sub) << (msb - 2)) - 1;
+  }
+
+  uint32_t buckets_[kNumBuckets] = {};
+};
+
+/// Register age statistics with the global profiler, if enabled.
+inline void AddProfilerStatistics(const String& name,
+                                  const AgeStatistics* statistics) {
+  if (pipeline_profiler != nullptr) {
+    pipeline_profiler->add_statistics(name, statistics);
+  }
+}
+
+/**
+ * @brief Consumer that records the pipeline age of the received samples.
+ *
+ * Connected next to an output, it measures how old the samples are when
+ * they are handed over to the output, which covers the filters and
+ * transforms that hold values back. It does not cover the time the
+ * output takes to send them: Signal K deltas are queued and serialized
+ * later by SensESP, and that delay is not included.
+ */
+template <typename T>
+class PipelineAgeProbe : public sensesp::ValueConsumer<T> {
+ public:
+  PipelineAgeProbe(const String& name) {
+    AddProfilerStatistics(name, &statistics_);
+  }
+
+  void set(const T& value) override {
+    statistics_.add(millis() - current_sample_time);
+  }
+
+  const AgeStatistics& get_statistics() const { return statistics_; }
+
+ private:
+  AgeStatistics statistics_;
+};
+
+}  // namespace halmet
+
+#endif  // HALMET_SRC_SAMPLE_AGE_H_
@@ -0,0 +1,97 @@
+#include "sender_fault.h"
+
+#include <cmath>
+
+namespace halmet {
+
+const char* SenderFaultDescription(SenderFault fault) {
+  switch (fault) {
+    case SenderFault::kOpen:
+      return "open circuit";
+    case SenderFault::kShort:
+      return "short circuit";
+    case SenderFault::kOutOfRange:
+      return "reading out of range";
+    default:
+      return "ok";
+  }
+}
+
+SenderFaultDetector::SenderFaultDetector(const String& config_path)
+    : sensesp::FloatTransform(config_path), fault_{false} {
+  this->load();
+  params_.update();
+}
+
+SenderFault SenderFaultDetector::classify(const Parameters& params,
+                                          float resistance) const {
+  if (std::isnan(resistance) || resistance > params.open_above) {
+    return SenderFault::kOpen;
+  }
+  if (resistance < params.short_below) {
+    return SenderFault::kShort;
+  }
+  if (resistance < params.valid_min || resistance > params.valid_max) {
+    return SenderFault::kOutOfRange;
+  }
+  return SenderFault::kNone;
+}
+
+void SenderFaultDetector::set(const float& resistance) {
+  params_.update();
+  SenderFault fault = classify(params_.get(), resistance);
+  if (fault != fault_type_) {
+    if (fault != SenderFault::kNone) {
+      debugW("Sender fault: %s (%.0f ohm)", SenderFaultDescription(fault),
+             resistance);
+    }
+    fault_type_ = fault;
+    fault_.set(fault != SenderFault::kNone);
+  }
+  if (fault == SenderFault::kNone) {
+    this->emit(resistance);
+  }
+}
+
+bool SenderFaultDetector::to_json(JsonObject& config) {
+  Parameters params = params_.get_latest();
+  config["open_above"] = params.open_above;
+  config["short_below"] = params.short_below;
+  config["valid_min"] = params.valid_min;
+  config["valid_max"] = params.valid_max;
+  return true;
+}
+
+bool SenderFaultDetector::from_json(const JsonObject& config) {
+  if (!config["open_above"].is<float>() || !config["short_below"].is<float>() ||
+      !config["valid_min"].is<float>() || !config["valid_max"].is<float>()) {
+    return false;
+  }
+  Parameters params;
+  params.open_above = config["open_above"];
+  params.short_below = config["short_below"];
+  params.valid_min = config["valid_min"];
+  params.valid_max = config["valid_max"];
+  if (params.short_below > params.valid_min ||
+      params.valid_min > params.valid_max ||
+      params.valid_max > params.open_above) {
+    debugE("SenderFaultDetector: Thresholds must be in increasing order");
+    return false;
+  }
+  params_.set(params);
+  return true;
+}
+
+const String ConfigSchema(const SenderFaultDetector& obj) {
+  return R"###({
+    "type": "object",
+    "properties": {
+      "open_above": { "title": "Open circuit above", "type": "number", "description": "Resistance indicating a broken wire or disconnected sender (ohm)" },
+      "short_below": { "title": "Short circuit below", "type": "number", "description": "Resistance indicating a short circuit (ohm). Must not be above the valid range minimum. Set both to 0 for senders that read 0 ohm at one end of the scale." },
+      "valid_min": { "title": "Valid range minimum", "type": "number", "description": "Lowest plausible sender resistance (ohm)" },
+      "valid_max": { "title": "Valid range maximum", "type": "number", "description": "Highest plausible sender resistance (ohm)" }
+    }
+  })###";
+}
+
+}  // namespace halmet
@@ -0,0 +1,61 @@
+#ifndef HALMET_SRC_SENDER_FAULT_H_
+#define HALMET_SRC_SENDER_FAULT_H_
+
+#include "live_config.h"
+#include "sensesp/system/observablevalue.h"
+#include "sensesp/transforms/transform.h"
+#include "sensesp_base_app.h"
+
+namespace halmet {
+
+enum class SenderFault {
+  kNone,
+  kOpen,        // Broken wire or disconnected sender
+  kShort,       // Sender or wire shorted to ground
+  kOutOfRange,  // Outside the resistance range of the sender
+};
+
+const char* SenderFaultDescription(SenderFault fault);
+
+/**
+ * @brief Plausibility check of a resistive sender reading.
+ *
+ * Every resistance sample is classified as valid, open circuit, short
+ * circuit or out of range. Valid samples are passed on unchanged. Faulty
+ * samples are dropped, so that an open circuit does not show up as a full
+ * tank downstream, and fault_ changes state on the very same sample.
+ */
+class SenderFaultDetector : public sensesp::FloatTransform {
+ public:
+  SenderFaultDetector(const String& config_path = "");
+
+  void set(const float& resistance) override;
+
+  SenderFault get_fault() const { return fault_type_; }
+
+  virtual bool to_json(JsonObject& config) override;
+  virtual bool from_json(const JsonObject& config) override;
+
+  /// True while the sender reading is implausible. Emitted on changes.
+  sensesp::ObservableValue<bool> fault_;
+
+ protected:
+  struct Parameters {
+    float open_above = 1000;  // ohm
+    float short_below = 3;    // ohm
+    float valid_min = 5;      // ohm
+    float valid_max = 400;    // ohm
+  };
+
+  SenderFault classify(const Parameters& params, float resistance) const;
+
+  LiveConfig<Parameters> params_;
+
+  SenderFault fault_type_ = SenderFault::kNone;
+};
+
+const String ConfigSchema(const SenderFaultDetector& obj);
+
+}  // namespace halmet
+
+#endif  // HALMET_SRC_SENDER_FAULT_H_
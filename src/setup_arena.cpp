@@ -0,0 +1,69 @@
+#include "setup_arena.h"
+
+#include <stdint.h>
+
+#include <cstddef>
+
+#include "sensesp_base_app.h"
+
+namespace halmet {
+
+namespace {
+
+#ifdef ENABLE_SETUP_ARENA
+// Covers the alignment of the members declared alignas(16)
+const size_t kArenaAlignment = alignof(std::max_align_t) > 16
+                                   ? alignof(std::max_align_t)
+                                   : 16;
+
+alignas(kArenaAlignment) uint8_t arena[HALMET_ARENA_SIZE];
+#endif
+
+size_t arena_used = 0;
+size_t arena_allocations = 0;
+size_t heap_fallbacks = 0;
+size_t heap_fallback_bytes = 0;
+
+}  // namespace
+
+void* ArenaAllocate(size_t size, size_t alignment) {
+#ifdef ENABLE_SETUP_ARENA
+  // Align the address rather than the offset, so that types aligned beyond
+  // the arena itself are placed correctly too
+  uintptr_t base = reinterpret_cast<uintptr_t>(arena);
+  size_t start =
+      ((base + arena_used + alignment - 1) & ~(alignment - 1)) - base;
+  if (start + size <= HALMET_ARENA_SIZE) {
+    arena_used = start + size;
+    arena_allocations++;
+    return &arena[start];
+  }
+  if (heap_fallbacks == 0) {
+    debugW("Setup arena full; increase HALMET_ARENA_SIZE");
+  }
+  heap_fallbacks++;
+  heap_fallback_bytes += size;
+#endif
+  return ::operator new(size, std::align_val_t(alignment));
+}
+
+bool ArenaContains(const void* ptr) {
+#ifdef ENABLE_SETUP_ARENA
+  const uint8_t* p = static_cast<const uint8_t*>(ptr);
+  return p >= arena && p < arena + HALMET_ARENA_SIZE;
+#else
+  return false;
+#endif
+}
+
+ArenaUsage GetArenaUsage() {
+#ifdef ENABLE_SETUP_ARENA
+  size_t capacity = HALMET_ARENA_SIZE;
+#else
+  size_t capacity = 0;
+#endif
+  return {capacity, arena_used, arena_allocations, heap_fallbacks,
+          heap_fallback_bytes};
+}
+
+}  // namespace halmet
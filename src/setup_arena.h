@@ -0,0 +1,100 @@
+#ifndef HALMET_SRC_SETUP_ARENA_H_
+#define HALMET_SRC_SETUP_ARENA_H_
+
+#include <stddef.h>
+
+#include <memory>
+#include <new>
+#include <utility>
+
+// Size of the static arena for objects created at setup, in bytes. Check
+// the usage reported at the end of setup() when adding pipelines.
+#ifndef HALMET_ARENA_SIZE
+#define HALMET_ARENA_SIZE 16384
+#endif
+
+namespace halmet {
+
+/**
+ * Objects created in setup() live until the device restarts. With
+ * ENABLE_SETUP_ARENA defined, they are placed in a statically allocated
+ * bump-pointer arena instead of the heap: allocation is a pointer increment
+ * without per-block heap headers, and the long-lived objects no longer sit
+ * between the WiFi and TCP buffers, fragmenting the heap.
+ *
+ * Arena memory is never freed, so only objects that are never deleted may
+ * be allocated with ArenaNew. Objects whose ownership passes to SensESP
+ * (such as SKMetadata) must use plain new. Members allocated internally by
+ * the objects (strings, vectors) still come from the heap. When the arena
+ * is full, allocations fall back to the heap and are counted. Both honour
+ * the alignment of the type, including alignas() beyond the default.
+ *
+ * Without ENABLE_SETUP_ARENA, all allocations go to the heap as usual.
+ */
+void* ArenaAllocate(size_t size, size_t alignment);
+
+/// True if the pointer points into the arena.
+bool ArenaContains(const void* ptr);
+
+struct ArenaUsage {
+  size_t capacity;        // bytes; 0 if the arena is disabled
+  size_t used;            // bytes, including alignment padding
+  size_t allocations;     // allocations served from the arena
+  size_t heap_fallbacks;  // allocations that did not fit
+  size_t heap_fallback_bytes;
+};
+
+ArenaUsage GetArenaUsage();
+
+/// Create a permanent object, in the arena if enabled.
+template <typename T, typename... Args>
+T* ArenaNew(Args&&... args) {
+  void* ptr = ArenaAllocate(sizeof(T), alignof(T));
+  return new (ptr) T(std::forward<Args>(args)...);
+}
+
+/// Standard allocator drawing from the arena, for std::allocate_shared.
+template <typename T>
+struct ArenaAllocator {
+  using value_type = T;
+
+  ArenaAllocator() = default;
+  template <typename U>
+  ArenaAllocator(const ArenaAllocator<U>&) {}
+
+  T* allocate(size_t n) {
+    return static_cast<T*>(ArenaAllocate(n * sizeof(T), alignof(T)));
+  }
+
+  void deallocate(T* ptr, size_t n) {
+    if (!ArenaContains(ptr)) {
+      ::operator delete(ptr, std::align_val_t(alignof(T)));
+    }
+  }
+};
+
+template <typename T, typename U>
+bool operator==(const ArenaAllocator<T>&, const ArenaAllocator<U>&) {
+  return true;
+}
+
+template <typename T, typename U>
+bool operator!=(const ArenaAllocator<T>&, const ArenaAllocator<U>&) {
+  return false;
+}
+
+/// Like std::make_shared, with the object and its control block in the
+/// arena if enabled.
+template <typename T, typename... Args>
+std::shared_ptr<T> ArenaMakeShared(Args&&... args) {
+#ifdef ENABLE_SETUP_ARENA
+  return std::allocate_shared<T>(ArenaAllocator<T>(),
+                                 std::forward<Args>(args)...);
+#else
+  return std::make_shared<T>(std::forward<Args>(args)...);
+#endif
+}
+
+}  // namespace halmet
+
+#endif  // HALMET_SRC_SETUP_ARENA_H_
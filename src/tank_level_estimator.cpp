@@ -0,0 +1,150 @@
+#include "tank_level_estimator.h"
+
+#include <algorithm>
+#include <cmath>
+
+#include "deferred_log.h"
+
+namespace halmet {
+
+namespace {
+
+// Number of samples before outliers are rejected. The first samples define
+// the prediction, so they can't be checked against it.
+const uint32_t kMinSamplesForGating = 10;
+
+}  // namespace
+
+TankLevelEstimator::TankLevelEstimator(const String& config_path)
+    : sensesp::FloatTransform(config_path) {
+  this->load();
+  params_.update();
+}
+
+void TankLevelEstimator::restart(float level) {
+  level_ = level;
+  rate_estimate_ = 0;
+  samples_ = 1;
+  outliers_ = 0;
+  start_time_ = millis();
+  previous_time_ = start_time_;
+  // The rate of the previous fit no longer applies
+  if (!std::isnan(rate_.get())) {
+    rate_.set(NAN);
+    time_to_empty_.set(NAN);
+  }
+}
+
+void TankLevelEstimator::set(const float& level) {
+  if (params_.update()) {
+    // Start over with the new parameters
+    samples_ = 0;
+  }
+  const Parameters& params = params_.get();
+  if (!params.enabled) {
+    this->emit(level);
+    return;
+  }
+  if (samples_ == 0) {
+    restart(level);
+    this->emit(level);
+    return;
+  }
+
+  uint32_t now = millis();
+  double dt = (now - previous_time_) / 1000.;
+  if (dt <= 0) {
+    return;
+  }
+  previous_time_ = now;
+
+  double predicted = level_ + rate_estimate_ * dt;
+  double residual = level - predicted;
+
+  if (samples_ >= kMinSamplesForGating &&
+      std::fabs(residual) > params.outlier_threshold) {
+    if (++outliers_ >= params.max_outliers) {
+      deferredD("TankLevelEstimator: Level jump to %.3f, restarting", level);
+      restart(level);
+      this->emit(level);
+      return;
+    }
+    // Coast on the prediction
+    level_ = predicted;
+    this->emit(level_);
+    return;
+  }
+  outliers_ = 0;
+
+  // Steady-state gains of a critically damped filter with the configured
+  // response time
+  double wt = dt / params.response_time;
+  double alpha = std::min(1., 2 * wt);
+  double beta = std::min(1., wt * wt);
+
+  // Expanding-memory gains, equivalent to a least squares line fit through
+  // all samples so far, including this one. These are used until they fall
+  // below the steady-state gains.
+  double k = samples_ + 1;
+  double fit_alpha = 2 * (2 * k - 1) / (k * (k + 1));
+  double fit_beta = 6 / (k * (k + 1));
+  alpha = std::max(alpha, fit_alpha);
+  beta = std::max(beta, fit_beta);
+  samples_++;
+
+  level_ = predicted + alpha * residual;
+  rate_estimate_ += beta * residual / dt;
+
+  this->emit(level_);
+
+  // The rate is emitted once the fit spans the response time. Until the
+  // gains reach their steady-state values, after about 2.5 response times,
+  // the least squares fit is the best rate estimate available.
+  if (now - start_time_ >= 1000 * params.response_time) {
+    rate_.set(rate_estimate_);
+    time_to_empty_.set(rate_estimate_ < 0 && level_ > 0
+                           ? level_ / -rate_estimate_
+                           : NAN);
+  }
+}
+
+bool TankLevelEstimator::to_json(JsonObject& config) {
+  Parameters params = params_.get_latest();
+  config["enabled"] = params.enabled;
+  config["response_time"] = params.response_time;
+  config["outlier_threshold"] = params.outlier_threshold;
+  config["max_outliers"] = params.max_outliers;
+  return true;
+}
+
+bool TankLevelEstimator::from_json(const JsonObject& config) {
+  if (!config["enabled"].is<bool>() || !config["response_time"].is<int>() ||
+      !config["outlier_threshold"].is<float>() ||
+      !config["max_outliers"].is<int>()) {
+    return false;
+  }
+  Parameters params;
+  params.enabled = config["enabled"];
+  params.response_time = config["response_time"];
+  params.outlier_threshold = config["outlier_threshold"];
+  params.max_outliers = config["max_outliers"];
+  if (params.response_time == 0) {
+    params.response_time = 1;
+  }
+  params_.set(params);
+  return true;
+}
+
+const String ConfigSchema(const TankLevelEstimator& obj) {
+  return R"###({
+    "type": "object",
+    "properties": {
+      "enabled": { "title": "Enabled", "type": "boolean", "description": "Filter the tank level. If disabled, the raw level is output and no rate or time to empty is calculated." },
+      "response_time": { "title": "Response time", "type": "integer", "description": "Time over which sender noise and slosh are averaged out (s). Longer times give a steadier level and rate." },
+      "outlier_threshold": { "title": "Outlier threshold", "type": "number", "description": "Samples deviating from the estimated level by more than this are ignored (ratio)" },
+      "max_outliers": { "title": "Maximum consecutive outliers", "type": "integer", "description": "Number of consecutive outliers after which the level is taken as changed, e.g. after refuelling" }
+    }
+  })###";
+}
+
+}  // namespace halmet
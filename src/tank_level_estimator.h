@@ -0,0 +1,76 @@
+#ifndef HALMET_SRC_TANK_LEVEL_ESTIMATOR_H_
+#define HALMET_SRC_TANK_LEVEL_ESTIMATOR_H_
+
+#include <cmath>
+
+#include "live_config.h"
+#include "sensesp/system/observablevalue.h"
+#include "sensesp/transforms/transform.h"
+#include "sensesp_base_app.h"
+
+namespace halmet {
+
+/**
+ * @brief Alpha-beta filter tracking a tank level and its rate of change.
+ *
+ * The level is modelled as changing at a slowly varying rate. Each sample
+ * updates the predicted level with a fraction alpha of the prediction error
+ * and the rate with a fraction beta, so a steadily falling level is tracked
+ * without lag while sender noise and slosh are averaged out over the
+ * configured response time. A stable level therefore does not depend on
+ * sampling the sender fast and averaging heavily.
+ *
+ * The gains start from a least squares fit of the first samples and narrow
+ * down to the steady-state values given by the response time, so the
+ * estimate settles quickly after boot. Samples deviating from the
+ * prediction by more than the outlier threshold are ignored; if several
+ * consecutive samples do, the level has really jumped (e.g. the tank was
+ * filled up) and the filter starts over.
+ *
+ * The estimated level (ratio) is emitted for every sample. rate_ (ratio/s,
+ * negative when the level falls) and time_to_empty_ (s) are emitted once
+ * the samples since the last (re)start span the response time; a fit over
+ * a shorter time mostly measures slosh. Both are set to NaN on a restart.
+ * time_to_empty_ is NaN while the level is not falling.
+ *
+ * If disabled, the input is passed on unchanged.
+ */
+class TankLevelEstimator : public sensesp::FloatTransform {
+ public:
+  TankLevelEstimator(const String& config_path = "");
+
+  void set(const float& level) override;
+
+  virtual bool to_json(JsonObject& config) override;
+  virtual bool from_json(const JsonObject& config) override;
+
+  sensesp::ObservableValue<float> rate_{NAN};           // ratio/s
+  sensesp::ObservableValue<float> time_to_empty_{NAN};  // s
+
+ protected:
+  struct Parameters {
+    bool enabled = true;
+    unsigned int response_time = 1800;  // s
+    float outlier_threshold = 0.15;     // ratio
+    unsigned int max_outliers = 10;
+  };
+
+  void restart(float level);
+
+  LiveConfig<Parameters> params_;
+
+  // Filter state. The rate of a real tank is tiny compared to the level,
+  // so the state is kept in double precision.
+  double level_ = 0;          // ratio
+  double rate_estimate_ = 0;  // ratio/s
+  uint32_t samples_ = 0;  // Samples since the last restart
+  uint32_t start_time_ = 0;     // ms
+  uint32_t previous_time_ = 0;  // ms
+  unsigned int outliers_ = 0;
+};
+
+const String ConfigSchema(const TankLevelEstimator& obj);
+
+}  // namespace halmet
+
+#endif  // HALMET_SRC_TANK_LEVEL_ESTIMATOR_H_
@@ -0,0 +1,170 @@
+#include "telemetry_stream.h"
+
+#include <WiFi.h>
+
+namespace halmet {
+
+namespace {
+
+// Interval for logging the average datagram cost
+const unsigned int kStatsLogInterval = 60000;  // ms
+
+void PutUint16(uint8_t* buf, uint16_t value) {
+  buf[0] = value & 0xff;
+  buf[1] = value >> 8;
+}
+
+void PutUint32(uint8_t* buf, uint32_t value) {
+  for (int i = 0; i < 4; i++) {
+    buf[i] = (value >> (8 * i)) & 0xff;
+  }
+}
+
+}  // namespace
+
+TelemetryStream::TelemetryStream(const String& config_path)
+    : sensesp::FileSystemSaveable{config_path},
+      params_{{false, "239.255.72.77", 7277, 20}} {
+  load();
+  params_.update();
+  set_send_event();
+
+  sensesp::event_loop()->onRepeat(kStatsLogInterval, [this]() {
+    if (this->send_count_ > 0) {
+      debugD("Telemetry: %u datagrams, %u us average send time",
+             this->send_count_,
+             (unsigned int)(this->send_time_total_ / this->send_count_));
+    }
+  });
+}
+
+sensesp::ValueConsumer<float>* TelemetryStream::channel(uint8_t id) {
+  for (int i = 0; i < num_channels_; i++) {
+    if (channels_[i].id_ == id) {
+      return &channels_[i];
+    }
+  }
+  if (num_channels_ == kMaxChannels) {
+    debugE("TelemetryStream: Too many channels, channel %u not sent", id);
+    return &discard_;
+  }
+  channels_[num_channels_].id_ = id;
+  return &channels_[num_channels_++];
+}
+
+void TelemetryStream::set_send_event() {
+  if (send_event_ != nullptr) {
+    send_event_->remove(sensesp::event_loop());
+    send_event_ = nullptr;
+  }
+  const Parameters& params = params_.get();
+  if (!params.enabled || params.rate == 0) {
+    return;
+  }
+  send_event_ = sensesp::event_loop()->onRepeat(1000 / params.rate,
+                                                [this]() { this->send(); });
+}
+
+void TelemetryStream::send() {
+  if (num_channels_ == 0 || !WiFi.isConnected()) {
+    return;
+  }
+  uint32_t start = micros();
+
+  // Event loop only, so a single buffer will do
+  static uint8_t datagram[kHeaderSize +
+                          kMaxChannels * kQueueLength * kSampleSize];
+  uint32_t now = millis();
+
+  int count = 0;
+  uint8_t* sample = &datagram[kHeaderSize];
+  for (int i = 0; i < num_channels_; i++) {
+    ChannelInput& input = channels_[i];
+    while (input.count_ > 0) {
+      const Sample& queued = input.queue_[input.head_];
+      uint32_t age = now - queued.timestamp;
+      sample[0] = input.id_;
+      sample[1] = input.dropped_ ? 1 : 0;
+      PutUint16(&sample[2], age > 0xffff ? 0xffff : age);
+      memcpy(&sample[4], &queued.value, sizeof(float));
+      input.dropped_ = false;
+      input.head_ = (input.head_ + 1) % kQueueLength;
+      input.count_--;
+      count++;
+      sample += kSampleSize;
+    }
+  }
+  if (count == 0) {
+    return;
+  }
+
+  datagram[0] = 'H';
+  datagram[1] = 'T';
+  datagram[2] = kVersion;
+  datagram[3] = count;
+  PutUint32(&datagram[4], sequence_++);
+  PutUint32(&datagram[8], now);
+
+  const Parameters& params = params_.get();
+  IPAddress group;
+  group.fromString(params.group);
+  udp_.beginPacket(group, params.port);
+  udp_.write(datagram, sample - datagram);
+  udp_.endPacket();
+
+  send_count_++;
+  send_time_total_ += micros() - start;
+}
+
+bool TelemetryStream::to_json(JsonObject& config) {
+  Parameters params = params_.get_latest();
+  config["enabled"] = params.enabled;
+  config["group"] = params.group;
+  config["port"] = params.port;
+  config["rate"] = params.rate;
+  return true;
+}
+
+bool TelemetryStream::from_json(const JsonObject& config) {
+  if (!config["enabled"].is<bool>() || !config["group"].is<String>() ||
+      !config["port"].is<int>() || !config["rate"].is<int>()) {
+    debugE("TelemetryStream: Invalid configuration");
+    return false;
+  }
+  String group = config["group"].as<String>();
+  Parameters params;
+  if (group.length() >= sizeof(params.group)) {
+    debugE("TelemetryStream: Invalid multicast group");
+    return false;
+  }
+  params.enabled = config["enabled"];
+  snprintf(params.group, sizeof(params.group), "%s", group.c_str());
+  params.port = config["port"];
+  params.rate = config["rate"];
+  if (params.rate > 50) {
+    params.rate = 50;
+  }
+  params_.set(params);
+  // Apply the new rate without a restart. This runs in the HTTP server
+  // task, so the timer is re-armed by the event loop.
+  sensesp::event_loop()->onDelay(0, [this]() {
+    if (this->params_.update()) {
+      this->set_send_event();
+    }
+  });
+  return true;
+}
+
+const String ConfigSchema(const TelemetryStream& obj) {
+  return R"###({
+    "type": "object",
+    "properties": {
+      "enabled": { "title": "Enabled", "type": "boolean", "description": "Send the binary telemetry stream" },
+      "group": { "title": "Multicast group", "type": "string", "description": "Destination multicast address" },
+      "port": { "title": "UDP port", "type": "integer", "description": "Destination UDP port" },
+      "rate": { "title": "Rate", "type": "integer", "description": "Datagrams per second (1-50)" }
+    }
+  })###";
+}
+
+}  // namespace halmet
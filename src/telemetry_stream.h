@@ -0,0 +1,110 @@
+#ifndef HALMET_SRC_TELEMETRY_STREAM_H_
+#define HALMET_SRC_TELEMETRY_STREAM_H_
+
+#include <WiFiUdp.h>
+
+#include "live_config.h"
+#include "sensesp/system/saveable.h"
+#include "sensesp/system/valueconsumer.h"
+#include "sensesp_base_app.h"
+
+namespace halmet {
+
+/**
+ * @brief High-rate binary telemetry output over UDP multicast.
+ *
+ * Any float producer can be connected to a numbered channel. Each value
+ * is queued with its acquisition time, and at the configured rate the
+ * samples queued on all channels are packed into a single datagram with a
+ * fixed little-endian layout:
+ *
+ *   Header, 12 bytes:
+ *     magic "HT" (2), version (1), sample count (1),
+ *     sequence number (uint32), sender time in ms (uint32)
+ *   Sample, 8 bytes each:
+ *     channel (uint8), flags (uint8, bit 0: earlier samples of the channel
+ *     were dropped), sample age in ms relative to the sender time
+ *     (uint16), value (float32)
+ *
+ * Every sample is sent once. A channel queues up to kQueueLength samples
+ * between two datagrams and drops the oldest ones beyond that. No datagram
+ * is sent while nothing is queued.
+ *
+ * Configuration changes arrive in the HTTP server task and are applied by
+ * the event loop. tools/telemetry_decode.py decodes the stream on the
+ * host.
+ */
+class TelemetryStream : public sensesp::FileSystemSaveable {
+ public:
+  static const int kMaxChannels = 16;
+  static const int kQueueLength = 8;
+  static const uint8_t kVersion = 2;
+  static const int kHeaderSize = 12;
+  static const int kSampleSize = 8;
+
+  TelemetryStream(const String& config_path);
+
+  /// Get the consumer feeding the given channel number. If there are too
+  /// many channels, the values are discarded.
+  sensesp::ValueConsumer<float>* channel(uint8_t id);
+
+  virtual bool to_json(JsonObject& config) override;
+  virtual bool from_json(const JsonObject& config) override;
+
+ protected:
+  struct Parameters {
+    bool enabled;
+    char group[16];  // Dotted IPv4 address
+    uint16_t port;
+    unsigned int rate;  // Hz
+  };
+
+  struct Sample {
+    uint32_t timestamp;  // ms
+    float value;
+  };
+
+  class ChannelInput : public sensesp::ValueConsumer<float> {
+   public:
+    void set(const float& value) override {
+      if (count_ == kQueueLength) {
+        head_ = (head_ + 1) % kQueueLength;
+        count_--;
+        dropped_ = true;
+      }
+      Sample& sample = queue_[(head_ + count_) % kQueueLength];
+      sample.timestamp = millis();
+      sample.value = value;
+      count_++;
+    }
+
+    uint8_t id_ = 0;
+    Sample queue_[kQueueLength];
+    int head_ = 0;  // Oldest queued sample
+    int count_ = 0;
+    bool dropped_ = false;
+  };
+
+  void set_send_event();
+  void send();
+
+  LiveConfig<Parameters> params_;
+
+  ChannelInput channels_[kMaxChannels];
+  int num_channels_ = 0;
+  ChannelInput discard_;  // Not sent
+
+  WiFiUDP udp_;
+  reactesp::RepeatEvent* send_event_ = nullptr;
+  uint32_t sequence_ = 0;
+
+  // Running cost of packing and sending a datagram
+  uint32_t send_count_ = 0;
+  uint64_t send_time_total_ = 0;  // us
+};
+
+const String ConfigSchema(const TelemetryStream& obj);
+
+}  // namespace halmet
+
+#endif  // HALMET_SRC_TELEMETRY_STREAM_H_
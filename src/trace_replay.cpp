@@ -0,0 +1,235 @@
+#include "trace_replay.h"
+
+#include <SPIFFS.h>
+
+namespace halmet {
+
+TraceReplay* trace_replay = nullptr;
+
+namespace {
+
+const char kTracePath[] = "/replay.bin";
+const char kRecordingPath[] = "/recorder.bin";
+const char kOutputPath[] = "/replay_out.csv";
+
+const int kTransferChunkSize = 512;
+
+bool DecodeVarint(const uint8_t* buf, int size, int* pos, uint32_t* value) {
+  uint32_t result = 0;
+  for (int shift = 0; *pos < size && shift < 35; shift += 7) {
+    uint8_t byte = buf[(*pos)++];
+    result |= static_cast<uint32_t>(byte & 0x7f) << shift;
+    if ((byte & 0x80) == 0) {
+      *value = result;
+      return true;
+    }
+  }
+  return false;
+}
+
+int32_t UnZigZag(uint32_t value) {
+  return static_cast<int32_t>(value >> 1) ^ -static_cast<int32_t>(value & 1);
+}
+
+}  // namespace
+
+TraceReplay::TraceReplay() {}
+
+bool TraceReplay::start() {
+  if (active_) {
+    return false;
+  }
+
+  // Replay an uploaded trace, or else the latest flight recording
+  const char* path = SPIFFS.exists(kTracePath) ? kTracePath : kRecordingPath;
+  trace_file_ = SPIFFS.open(path, FILE_READ);
+  if (!trace_file_) {
+    debugE("TraceReplay: No trace to replay");
+    return false;
+  }
+  // Channels whose first record is a delta start from zero, as when
+  // recording, and not from the end of a previous replay
+  memset(values_, 0, sizeof(values_));
+  memset(replayed_, 0, sizeof(replayed_));
+  if (!load_block()) {
+    debugE("TraceReplay: Invalid trace file %s", path);
+    trace_file_.close();
+    return false;
+  }
+  trace_start_ = record_time_;
+  pending_ = read_record();
+
+  output_file_ = SPIFFS.open(kOutputPath, FILE_WRITE);
+  output_file_.print("time_ms,name,value\n");
+
+  debugI("TraceReplay: Replaying %s", path);
+  active_ = true;
+  replay_start_ = millis();
+  step_event_ = sensesp::event_loop()->onRepeat(1, [this]() { this->step(); });
+  return true;
+}
+
+void TraceReplay::stop() {
+  if (!active_) {
+    return;
+  }
+  step_event_->remove(sensesp::event_loop());
+  step_event_ = nullptr;
+  trace_file_.close();
+  output_file_.close();
+  active_ = false;
+  debugI("TraceReplay: Replay finished");
+}
+
+bool TraceReplay::load_block() {
+  if (trace_file_.read(block_, sizeof(block_)) != sizeof(block_) ||
+      block_[0] != FlightRecorder::kBlockMagic) {
+    return false;
+  }
+  record_time_ = block_[1] | (block_[2] << 8) | (block_[3] << 16) |
+                 (block_[4] << 24);
+
+  // The keyframe holds the values of all channels at the block start
+  int num_channels = block_[5];
+  pos_ = 6;
+  for (int i = 0; i < num_channels; i++) {
+    uint8_t channel = block_[pos_++];
+    uint32_t value;
+    if (!DecodeVarint(block_, sizeof(block_), &pos_, &value)) {
+      return false;
+    }
+    values_[channel] = UnZigZag(value);
+    replayed_[channel >> 5] |= 1u << (channel & 0x1f);
+  }
+  return true;
+}
+
+bool TraceReplay::read_record() {
+  while (pos_ >= static_cast<int>(sizeof(block_)) ||
+         block_[pos_] == FlightRecorder::kEndOfBlock) {
+    if (!load_block()) {
+      return false;
+    }
+  }
+  pending_channel_ = block_[pos_++];
+  uint32_t time_delta;
+  uint32_t value_delta;
+  if (!DecodeVarint(block_, sizeof(block_), &pos_, &time_delta) ||
+      !DecodeVarint(block_, sizeof(block_), &pos_, &value_delta)) {
+    return false;
+  }
+  record_time_ += time_delta;
+  pending_delta_ = UnZigZag(value_delta);
+  return true;
+}
+
+void TraceReplay::step() {
+  uint32_t elapsed = millis() - replay_start_;
+  while (pending_ && record_time_ - trace_start_ <= elapsed) {
+    uint8_t channel = pending_channel_;
+    values_[channel] = static_cast<int32_t>(
+        static_cast<uint32_t>(values_[channel]) + pending_delta_);
+    replayed_[channel >> 5] |= 1u << (channel & 0x1f);
+    pending_ = read_record();
+  }
+  if (!pending_) {
+    stop();
+  }
+}
+
+void TraceReplay::CaptureInput::set(const float& value) {
+  if (!replay_->active_) {
+    return;
+  }
+  replay_->output_file_.printf("%lu,%s,%g\n",
+                               millis() - replay_->replay_start_,
+                               name_.c_str(), value);
+}
+
+sensesp::ValueConsumer<float>* TraceReplay::capture(const String& name) {
+  return new CaptureInput(this, name);
+}
+
+void TraceReplay::capture_n2k_message(const tN2kMsg& msg) {
+  if (!active_) {
+    return;
+  }
+  output_file_.printf("%lu,PGN %lu,", millis() - replay_start_, msg.PGN);
+  for (int i = 0; i < msg.DataLen; i++) {
+    output_file_.printf("%02x", msg.Data[i]);
+  }
+  output_file_.print("\n");
+}
+
+esp_err_t TraceReplay::handle_upload(httpd_req_t* req) {
+  if (active_) {
+    httpd_resp_set_status(req, "409 Conflict");
+    return httpd_resp_send(req, "Replay in progress", HTTPD_RESP_USE_STRLEN);
+  }
+  File file = SPIFFS.open(kTracePath, FILE_WRITE);
+  if (!file) {
+    return httpd_resp_send_500(req);
+  }
+
+  char chunk[kTransferChunkSize];
+  int remaining = req->content_len;
+  while (remaining > 0) {
+    int received = httpd_req_recv(
+        req, chunk, remaining < kTransferChunkSize ? remaining : kTransferChunkSize);
+    if (received == HTTPD_SOCK_ERR_TIMEOUT) {
+      continue;
+    }
+    if (received <= 0) {
+      file.close();
+      SPIFFS.remove(kTracePath);
+      return ESP_FAIL;
+    }
+    file.write(reinterpret_cast<uint8_t*>(chunk), received);
+    remaining -= received;
+  }
+  file.close();
+  return httpd_resp_send(req, "OK", HTTPD_RESP_USE_STRLEN);
+}
+
+esp_err_t TraceReplay::handle_output(httpd_req_t* req) {
+  if (active_) {
+    httpd_resp_set_status(req, "503 Service Unavailable");
+    return httpd_resp_send(req, "Replay in progress", HTTPD_RESP_USE_STRLEN);
+  }
+  File file = SPIFFS.open(kOutputPath, FILE_READ);
+  if (!file) {
+    return httpd_resp_send_404(req);
+  }
+
+  httpd_resp_set_type(req, "text/csv");
+  char chunk[kTransferChunkSize];
+  size_t len;
+  while ((len = file.read(reinterpret_cast<uint8_t*>(chunk), sizeof(chunk))) >
+         0) {
+    if (httpd_resp_send_chunk(req, chunk, len) != ESP_OK) {
+      file.close();
+      return ESP_FAIL;
+    }
+  }
+  file.close();
+  return httpd_resp_send_chunk(req, nullptr, 0);
+}
+
+void TraceReplay::add_http_handlers(sensesp::HTTPServer* server) {
+  server->add_handler(new sensesp::HTTPRequestHandler(
+      1 << HTTP_POST, "/api/replay/trace",
+      [this](httpd_req_t* req) { return this->handle_upload(req); }));
+
+  server->add_handler(new sensesp::HTTPRequestHandler(
+      1 << HTTP_POST, "/api/replay/start", [this](httpd_req_t* req) {
+        // The HTTP server runs in its own task; start in the event loop
+        sensesp::event_loop()->onDelay(0, [this]() { this->start(); });
+        return httpd_resp_send(req, "OK", HTTPD_RESP_USE_STRLEN);
+      }));
+
+  server->add_handler(new sensesp::HTTPRequestHandler(
+      1 << HTTP_GET, "/api/replay/output",
+      [this](httpd_req_t* req) { return this->handle_output(req); }));
+}
+
+}  // namespace halmet
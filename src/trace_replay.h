@@ -0,0 +1,117 @@
+#ifndef HALMET_SRC_TRACE_REPLAY_H_
+#define HALMET_SRC_TRACE_REPLAY_H_
+
+#include <FS.h>
+#include <N2kMsg.h>
+#include <esp_http_server.h>
+
+#include "flight_recorder.h"
+#include "sensesp/net/http_server.h"
+#include "sensesp/system/valueconsumer.h"
+#include "sensesp_base_app.h"
+
+namespace halmet {
+
+/**
+ * @brief Replay a recorded trace through the signal pipelines.
+ *
+ * The trace uses the flight recorder block format (see flight_recorder.h),
+ * so a recording downloaded from /api/recorder can be replayed as is, or a
+ * trace can be uploaded to /api/replay/trace. While a replay is running,
+ * the raw ADC codes, tacho counts and alarm states of the channels present
+ * in the trace replace the live readings, at the pace of the recorded
+ * timestamps.
+ *
+ * Values emitted by the connected capture consumers and all transmitted
+ * NMEA 2000 messages are written with their timestamps relative to the
+ * replay start to a CSV file that can be downloaded from
+ * /api/replay/output.
+ *
+ * The replay is not deterministic: the device clock and the timers of the
+ * pipelines keep running in real time, so the output depends on how the
+ * injected samples fall relative to them. Compare outputs with tolerances
+ * rather than byte for byte.
+ */
+class TraceReplay {
+ public:
+  TraceReplay();
+
+  bool start();
+  void stop();
+  bool is_active() const { return active_; }
+
+  /// Replayed value of a channel, or the live value if not replayed.
+  int32_t get_value(uint8_t channel, int32_t live_value) const {
+    if (active_ && (replayed_[channel >> 5] & (1u << (channel & 0x1f)))) {
+      return values_[channel];
+    }
+    return live_value;
+  }
+
+  /// Consumer writing the received values to the capture file.
+  sensesp::ValueConsumer<float>* capture(const String& name);
+
+  void capture_n2k_message(const tN2kMsg& msg);
+
+  void add_http_handlers(sensesp::HTTPServer* server);
+
+ protected:
+  class CaptureInput : public sensesp::ValueConsumer<float> {
+   public:
+    CaptureInput(TraceReplay* replay, const String& name)
+        : replay_{replay}, name_{name} {}
+    void set(const float& value) override;
+
+   private:
+    TraceReplay* replay_;
+    String name_;
+  };
+
+  bool load_block();
+  bool read_record();
+  void step();
+  esp_err_t handle_upload(httpd_req_t* req);
+  esp_err_t handle_output(httpd_req_t* req);
+
+  bool active_ = false;
+  fs::File trace_file_;
+  fs::File output_file_;
+  reactesp::RepeatEvent* step_event_ = nullptr;
+
+  uint8_t block_[FlightRecorder::kBlockSize];
+  int pos_ = 0;
+
+  uint32_t trace_start_ = 0;   // Trace time of the first block
+  uint32_t replay_start_ = 0;  // Device time of the replay start
+  uint32_t record_time_ = 0;   // Trace time of the pending record
+
+  // The next record to be applied
+  bool pending_ = false;
+  uint8_t pending_channel_ = 0;
+  int32_t pending_delta_ = 0;
+
+  int32_t values_[256] = {};
+  uint32_t replayed_[8] = {};
+};
+
+/// Global replay instance. Null if trace replay is not enabled.
+extern TraceReplay* trace_replay;
+
+inline int32_t ReplaySample(RecorderSource source, uint8_t index,
+                            int32_t live_value) {
+  if (trace_replay != nullptr) {
+    return trace_replay->get_value(RecorderChannel(source, index),
+                                   live_value);
+  }
+  return live_value;
+}
+
+inline void CaptureN2kMessage(const tN2kMsg& msg) {
+  if (trace_replay != nullptr) {
+    trace_replay->capture_n2k_message(msg);
+  }
+}
+
+}  // namespace halmet
+
+#endif  // HALMET_SRC_TRACE_REPLAY_H_
@@ -0,0 +1,100 @@
+#include "transform_benchmark.h"
+
+#include "fused_transform.h"
+#include "halmet_analog.h"
+#include "pipeline_profiler.h"
+#include "sensesp/system/lambda_consumer.h"
+#include "sensesp/transforms/curveinterpolator.h"
+#include "sensesp/transforms/frequency.h"
+#include "sensesp/transforms/lambda_transform.h"
+#include "sensesp/transforms/linear.h"
+
+namespace halmet {
+
+namespace {
+
+// Samples per timed batch and number of batches per chain
+const int kBatchSize = 1000;
+const int kNumBatches = 10;
+
+// Keeps the final values from being optimized away
+volatile float benchmark_sink;
+
+// Per-sample time of each chain (us)
+RunningStatistics tank_dynamic_time;
+RunningStatistics tank_fused_time;
+RunningStatistics tacho_dynamic_time;
+RunningStatistics tacho_fused_time;
+
+template <typename T>
+void RunBatches(sensesp::ValueConsumer<T>* input, RunningStatistics* time,
+                T (*make_input)(int)) {
+  for (int batch = 0; batch < kNumBatches; batch++) {
+    uint32_t start = micros();
+    for (int i = 0; i < kBatchSize; i++) {
+      input->set(make_input(i));
+    }
+    time->add(float(micros() - start) / kBatchSize);
+  }
+}
+
+// Sender voltages sweeping the default level curve range (0-2 V)
+float TankInput(int i) { return (i % 200) * 0.01; }
+
+// Tacho pulse counts per counting window
+int TachoInput(int i) { return 1000 + i % 100; }
+
+}  // namespace
+
+void RunTransformBenchmark() {
+  auto sink = new sensesp::LambdaConsumer<float>(
+      [](float value) { benchmark_sink = value; });
+
+  // Tank chain as built by ConnectTankSender
+  auto tank_resistance = new sensesp::LambdaTransform<float, float>(
+      [](float voltage) { return voltage / kMeasurementCurrent; });
+  auto tank_level = new sensesp::CurveInterpolator();
+  tank_level->add_sample(sensesp::CurveInterpolator::Sample(0, 0));
+  tank_level->add_sample(sensesp::CurveInterpolator::Sample(180., 1));
+  tank_level->add_sample(sensesp::CurveInterpolator::Sample(1000., 1));
+  auto tank_volume = new sensesp::Linear(0.12, 0);
+  tank_resistance->connect_to(tank_level)
+      ->connect_to(tank_volume)
+      ->connect_to(sink);
+
+  auto resistance_stage = FunctionStage(
+      [](float voltage) { return voltage / kMeasurementCurrent; });
+  auto tank_fused = new FusedTransform<float, decltype(resistance_stage),
+                                       CurveStage, LinearStage>(
+      "", resistance_stage,
+      CurveStage("curve", "Level Curve", {{0, 0}, {180., 1}, {1000., 1}}),
+      LinearStage("volume", "Total Volume", 0.12, 0));
+  tank_fused->connect_to(sink);
+
+  // Tacho chain with the conversion to rpm
+  auto tacho_frequency = new sensesp::Frequency(1 / 100.);
+  auto tacho_rpm = new sensesp::Linear(60, 0);
+  tacho_frequency->connect_to(tacho_rpm)->connect_to(sink);
+
+  auto tacho_fused = new FusedTransform<int, FrequencyStage, LinearStage>(
+      "", FrequencyStage("frequency", "Frequency", 1 / 100.),
+      LinearStage("rpm", "RPM", 60, 0));
+  tacho_fused->connect_to(sink);
+
+  RunBatches<float>(tank_resistance, &tank_dynamic_time, TankInput);
+  RunBatches<float>(tank_fused, &tank_fused_time, TankInput);
+  RunBatches<int>(tacho_frequency, &tacho_dynamic_time, TachoInput);
+  RunBatches<int>(tacho_fused, &tacho_fused_time, TachoInput);
+
+  debugI("Transform benchmark (us/sample): tank dynamic %.3f, fused %.3f; "
+         "tacho dynamic %.3f, fused %.3f",
+         tank_dynamic_time.mean(), tank_fused_time.mean(),
+         tacho_dynamic_time.mean(), tacho_fused_time.mean());
+
+  AddProfilerStatistics("benchmark tank dynamic", &tank_dynamic_time);
+  AddProfilerStatistics("benchmark tank fused", &tank_fused_time);
+  AddProfilerStatistics("benchmark tacho dynamic", &tacho_dynamic_time);
+  AddProfilerStatistics("benchmark tacho fused", &tacho_fused_time);
+}
+
+}  // namespace halmet
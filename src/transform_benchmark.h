@@ -0,0 +1,23 @@
+#ifndef HALMET_SRC_TRANSFORM_BENCHMARK_H_
+#define HALMET_SRC_TRANSFORM_BENCHMARK_H_
+
+namespace halmet {
+
+/**
+ * @brief Compare the per-sample cost of dynamic and fused transform chains.
+ *
+ * The tank level (resistance, level curve, volume) and tacho (frequency,
+ * rpm) chains are built both from separate SensESP transforms and as
+ * FusedTransforms with identical parameters, and the same input sequence is
+ * pushed through each. The samples of a batch arrive within a few
+ * milliseconds, and both tacho chains compute the frequency of every one of
+ * them. The average time per sample is logged and, if the pipeline
+ * profiler is enabled, included in its report.
+ *
+ * The benchmark blocks the event loop for a few tens of milliseconds.
+ */
+void RunTransformBenchmark();
+
+}  // namespace halmet
+
+#endif  // HALMET_SRC_TRANSFORM_BENCHMARK_H_
@@ -0,0 +1,275 @@
+#include "window_statistics.h"
+
+#include <algorithm>
+#include <limits>
+
+#include "setup_arena.h"
+#include "sensesp/signalk/signalk_output.h"
+#include "sensesp/ui/config_item.h"
+
+namespace halmet {
+
+WindowStatistics::WindowStatistics(unsigned int window,
+                                   const String& config_path)
+    : sensesp::FileSystemSaveable{config_path},
+      window_config_{window},
+      window_{window} {
+  load();
+  window_config_.update();
+  window_ = window_config_.get();
+  slot_length_ = std::max(1u, 1000 * window_ / kSlots);
+}
+
+void WindowStatistics::clear_slot(Slot& slot) {
+  slot = {};
+  slot.min = std::numeric_limits<float>::infinity();
+  slot.max = -std::numeric_limits<float>::infinity();
+}
+
+void WindowStatistics::add_to(Slot& total, const Slot& slot) {
+  total.count += slot.count;
+  total.sum += slot.sum;
+  total.sum_sq += slot.sum_sq;
+  total.sum_t += slot.sum_t;
+  total.sum_tt += slot.sum_tt;
+  total.sum_tx += slot.sum_tx;
+}
+
+void WindowStatistics::subtract_from(Slot& total, const Slot& slot) {
+  total.count -= slot.count;
+  total.sum -= slot.sum;
+  total.sum_sq -= slot.sum_sq;
+  total.sum_t -= slot.sum_t;
+  total.sum_tt -= slot.sum_tt;
+  total.sum_tx -= slot.sum_tx;
+}
+
+void WindowStatistics::reset() {
+  uint32_t now = millis();
+  time_origin_ = now;
+  oldest_seq_ = 0;
+  current_seq_ = 0;
+  current_end_ = now + slot_length_;
+  evictions_ = 0;
+  clear_slot(totals_);
+  clear_slot(slot(current_seq_));
+  min_deque_.clear();
+  max_deque_.clear();
+  started_ = true;
+}
+
+void WindowStatistics::set(const float& value) {
+  uint32_t now = millis();
+  if (window_config_.update()) {
+    window_ = window_config_.get();
+    slot_length_ = std::max(1u, 1000 * window_ / kSlots);
+    started_ = false;
+  }
+  if (!started_) {
+    reset();
+  }
+
+  if ((int32_t)(now - current_end_) >= 0) {
+    uint32_t elapsed_slots = (now - current_end_) / slot_length_ + 1;
+    if (elapsed_slots >= kSlots) {
+      // Nothing received for a whole window
+      reset();
+    } else {
+      // Close the current slot and any empty slots of the gap
+      for (uint32_t i = 0; i < elapsed_slots; i++) {
+        complete_current_slot();
+      }
+      emit_statistics();
+    }
+  }
+
+  double t = (now - time_origin_) / 1000.;
+  Slot& current = slot(current_seq_);
+  current.count++;
+  current.sum += value;
+  current.sum_sq += (double)value * value;
+  current.sum_t += t;
+  current.sum_tt += t * t;
+  current.sum_tx += t * value;
+  current.min = std::min(current.min, value);
+  current.max = std::max(current.max, value);
+}
+
+void WindowStatistics::complete_current_slot() {
+  const Slot& completed = slot(current_seq_);
+  add_to(totals_, completed);
+
+  if (completed.count > 0) {
+    while (!min_deque_.empty() &&
+           slot(min_deque_.back()).min >= completed.min) {
+      min_deque_.pop_back();
+    }
+    min_deque_.push_back(current_seq_);
+    while (!max_deque_.empty() &&
+           slot(max_deque_.back()).max <= completed.max) {
+      max_deque_.pop_back();
+    }
+    max_deque_.push_back(current_seq_);
+  }
+
+  current_seq_++;
+  current_end_ += slot_length_;
+  // The new current slot reuses the ring position of the oldest slot once
+  // the ring is full
+  if (current_seq_ - oldest_seq_ == kSlots) {
+    evict_oldest_slot();
+  }
+  clear_slot(slot(current_seq_));
+}
+
+void WindowStatistics::evict_oldest_slot() {
+  subtract_from(totals_, slot(oldest_seq_));
+  if (!min_deque_.empty() && min_deque_.front() == oldest_seq_) {
+    min_deque_.pop_front();
+  }
+  if (!max_deque_.empty() && max_deque_.front() == oldest_seq_) {
+    max_deque_.pop_front();
+  }
+  oldest_seq_++;
+
+  // Recompute the totals once per window length to stop rounding errors
+  // of the repeated subtractions from accumulating. Amortized, this is
+  // still O(1) per slot.
+  if (++evictions_ % kSlots == 0) {
+    recompute_totals();
+  }
+}
+
+void WindowStatistics::recompute_totals() {
+  clear_slot(totals_);
+  for (uint32_t seq = oldest_seq_; seq != current_seq_; seq++) {
+    add_to(totals_, slot(seq));
+  }
+}
+
+void WindowStatistics::emit_statistics() {
+  Slot window = totals_;
+  const Slot& current = slot(current_seq_);
+  add_to(window, current);
+  if (window.count == 0) {
+    return;
+  }
+
+  float window_min = current.min;
+  if (!min_deque_.empty()) {
+    window_min = std::min(window_min, slot(min_deque_.front()).min);
+  }
+  float window_max = current.max;
+  if (!max_deque_.empty()) {
+    window_max = std::max(window_max, slot(max_deque_.front()).max);
+  }
+
+  double n = window.count;
+  double mean = window.sum / n;
+  double variance = window.sum_sq / n - mean * mean;
+
+  min_.set(window_min);
+  max_.set(window_max);
+  mean_.set(mean);
+  stddev_.set(variance > 0 ? sqrt(variance) : 0);
+
+  double denominator = n * window.sum_tt - window.sum_t * window.sum_t;
+  if (window.count >= 2 && denominator > 0) {
+    rate_.set((n * window.sum_tx - window.sum_t * window.sum) / denominator);
+  }
+}
+
+bool WindowStatistics::to_json(JsonObject& config) {
+  config["window"] = window_config_.get_latest();
+  return true;
+}
+
+bool WindowStatistics::from_json(const JsonObject& config) {
+  if (!config["window"].is<int>()) {
+    return false;
+  }
+  unsigned int window = config["window"];
+  window_config_.set(std::max(1u, window));
+  return true;
+}
+
+const String ConfigSchema(const WindowStatistics& obj) {
+  return R"###({
+    "type": "object",
+    "properties": {
+      "window": { "title": "Window length", "type": "integer", "description": "Length of the statistics window (s)" }
+    }
+  })###";
+}
+
+WindowStatistics* ConnectWindowStatistics(sensesp::FloatProducer* input,
+                                          const String& name,
+                                          const String& sk_path_prefix,
+                                          const String& units,
+                                          unsigned int window, int sort_order) {
+  char config_path[80];
+  char config_title[80];
+  char config_description[80];
+
+  snprintf(config_path, sizeof(config_path), "/Statistics/%s/Window",
+           name.c_str());
+  snprintf(config_title, sizeof(config_title), "%s Statistics", name.c_str());
+  snprintf(config_description, sizeof(config_description),
+           "Sliding window statistics of %s", name.c_str());
+
+  auto statistics = ArenaNew<WindowStatistics>(window, config_path);
+
+  ConfigItem(statistics)
+      ->set_title(config_title)
+      ->set_description(config_description)
+      ->set_sort_order(sort_order);
+
+  input->connect_to(statistics);
+
+#ifdef ENABLE_SIGNALK
+  String rate_units = units + "/s";
+  struct {
+    const char* key;
+    const char* title;
+    sensesp::ObservableValue<float>* producer;
+    const String& units;
+  } outputs[] = {
+      {"min", "Minimum", &statistics->min_, units},
+      {"max", "Maximum", &statistics->max_, units},
+      {"mean", "Mean", &statistics->mean_, units},
+      {"stddev", "Standard Deviation", &statistics->stddev_, units},
+      {"rate", "Rate of Change", &statistics->rate_, rate_units},
+  };
+
+  char sk_path[80];
+  char meta_display_name[80];
+  int output_sort_order = sort_order;
+  for (auto& output : outputs) {
+    snprintf(config_path, sizeof(config_path), "/Statistics/%s/%s SK Path",
+             name.c_str(), output.title);
+    snprintf(sk_path, sizeof(sk_path), "%s.%s", sk_path_prefix.c_str(),
+             output.key);
+    snprintf(config_title, sizeof(config_title), "%s %s SK Path",
+             name.c_str(), output.title);
+    snprintf(config_description, sizeof(config_description),
+             "Signal K path for the %s of %s", output.title, name.c_str());
+    snprintf(meta_display_name, sizeof(meta_display_name), "%s %s",
+             name.c_str(), output.title);
+
+    auto sk_output = ArenaNew<sensesp::SKOutputFloat>(
+        sk_path, config_path,
+        new sensesp::SKMetadata(output.units, meta_display_name));
+
+    ConfigItem(sk_output)
+        ->set_title(config_title)
+        ->set_description(config_description)
+        ->set_sort_order(++output_sort_order);
+
+    output.producer->connect_to(sk_output);
+  }
+#endif
+
+  return statistics;
+}
+
+}  // namespace halmet
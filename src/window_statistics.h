@@ -0,0 +1,128 @@
+#ifndef HALMET_SRC_WINDOW_STATISTICS_H_
+#define HALMET_SRC_WINDOW_STATISTICS_H_
+
+#include "live_config.h"
+#include "sensesp/sensors/sensor.h"
+#include "sensesp/system/observablevalue.h"
+#include "sensesp/system/saveable.h"
+#include "sensesp/system/valueconsumer.h"
+#include "sensesp_base_app.h"
+
+namespace halmet {
+
+/**
+ * @brief Sliding-window statistics of a float input.
+ *
+ * Computes the minimum, maximum, mean, standard deviation and rate of change
+ * (least squares slope, per second) over a configurable time window.
+ *
+ * The window is divided into kSlots time slots. Each slot holds the count,
+ * the running sums needed for the mean, variance and slope, and its
+ * minimum and maximum. The window totals are updated incrementally as
+ * slots enter and leave the window, and the window minimum and maximum are
+ * kept in monotonic deques of slot indices, so each sample costs O(1) time
+ * and nothing is allocated after construction. The window slides by one
+ * slot at a time, i.e. 1/60 of the window length.
+ *
+ * The statistics are emitted whenever a slot is completed. A new window
+ * length takes effect at the next sample, starting the statistics over.
+ */
+class WindowStatistics : public sensesp::ValueConsumer<float>,
+                         public sensesp::FileSystemSaveable {
+ public:
+  static const int kSlots = 60;
+
+  WindowStatistics(unsigned int window, const String& config_path = "");
+
+  void set(const float& value) override;
+
+  virtual bool to_json(JsonObject& config) override;
+  virtual bool from_json(const JsonObject& config) override;
+
+  sensesp::ObservableValue<float> min_;
+  sensesp::ObservableValue<float> max_;
+  sensesp::ObservableValue<float> mean_;
+  sensesp::ObservableValue<float> stddev_;
+  sensesp::ObservableValue<float> rate_;  // per second
+
+ protected:
+  struct Slot {
+    uint32_t count;
+    double sum;     // x
+    double sum_sq;  // x^2
+    double sum_t;   // t, in s relative to time_origin_
+    double sum_tt;  // t^2
+    double sum_tx;  // t * x
+    float min;
+    float max;
+  };
+
+  /// Fixed-capacity deque of slot sequence numbers.
+  class SlotDeque {
+   public:
+    bool empty() const { return size_ == 0; }
+    uint32_t front() const { return items_[head_]; }
+    uint32_t back() const { return items_[(head_ + size_ - 1) % kSlots]; }
+    void push_back(uint32_t seq) { items_[(head_ + size_++) % kSlots] = seq; }
+    void pop_back() { size_--; }
+    void pop_front() {
+      head_ = (head_ + 1) % kSlots;
+      size_--;
+    }
+    void clear() { head_ = size_ = 0; }
+
+   private:
+    uint32_t items_[kSlots];
+    int head_ = 0;
+    int size_ = 0;
+  };
+
+  Slot& slot(uint32_t seq) { return slots_[seq % kSlots]; }
+  static void clear_slot(Slot& slot);
+  static void add_to(Slot& total, const Slot& slot);
+  static void subtract_from(Slot& total, const Slot& slot);
+
+  void reset();
+  void complete_current_slot();
+  void evict_oldest_slot();
+  void recompute_totals();
+  void emit_statistics();
+
+  LiveConfig<unsigned int> window_config_;  // s
+  unsigned int window_;                     // s, in effect
+  uint32_t slot_length_;                    // ms
+  uint32_t time_origin_ = 0;  // ms
+
+  Slot slots_[kSlots];
+  uint32_t oldest_seq_ = 0;   // Oldest completed slot in the window
+  uint32_t current_seq_ = 0;  // Slot receiving samples
+  uint32_t current_end_ = 0;  // End time of the current slot (ms)
+  bool started_ = false;
+
+  // Sums over the completed slots in the window
+  Slot totals_;
+  uint32_t evictions_ = 0;
+
+  SlotDeque min_deque_;
+  SlotDeque max_deque_;
+};
+
+const String ConfigSchema(const WindowStatistics& obj);
+
+/**
+ * @brief Calculate the window statistics of a producer and output each
+ * statistic to its own Signal K path.
+ *
+ * The Signal K paths are formed from sk_path_prefix, for example
+ * "sensors.a2.voltageStatistics.1m" gives "sensors.a2.voltageStatistics.1m.min"
+ * and so on. Each path can be changed in the web UI.
+ */
+WindowStatistics* ConnectWindowStatistics(sensesp::FloatProducer* input,
+                                          const String& name,
+                                          const String& sk_path_prefix,
+                                          const String& units,
+                                          unsigned int window, int sort_order);
+
+}  // namespace halmet
+
+#endif  // HALMET_SRC_WINDOW_STATISTICS_H_
@@ -0,0 +1,88 @@
+#include <Arduino.h>
+#include <unity.h>
+
+#include "adaptive_sampling.h"
+
+using namespace halmet;
+
+namespace {
+
+AdaptiveSamplingParameters Parameters() {
+  AdaptiveSamplingParameters params;
+  params.enabled = true;
+  params.min_interval = 100;
+  params.max_interval = 1000;
+  params.rate_threshold = 0.1;
+  params.deviation_threshold = 0.05;
+  return params;
+}
+
+void test_stable_signal_backs_off() {
+  AdaptiveSampler sampler("");
+  AdaptiveSamplingParameters params = Parameters();
+  TEST_ASSERT_EQUAL_UINT(100, sampler.update(1, params));
+  TEST_ASSERT_EQUAL_UINT(200, sampler.update(1, params));
+  TEST_ASSERT_EQUAL_UINT(400, sampler.update(1, params));
+  TEST_ASSERT_EQUAL_UINT(800, sampler.update(1, params));
+  TEST_ASSERT_EQUAL_UINT(1000, sampler.update(1, params));
+  TEST_ASSERT_EQUAL_UINT(1000, sampler.update(1, params));
+  TEST_ASSERT_EQUAL_UINT32(0,
+                           sampler.get_detection_latency_statistics().count());
+}
+
+void test_step_returns_to_the_minimum_interval() {
+  AdaptiveSampler sampler("");
+  AdaptiveSamplingParameters params = Parameters();
+  unsigned int interval = 0;
+  for (int i = 0; i < 6; i++) {
+    interval = sampler.update(1, params);
+  }
+  TEST_ASSERT_EQUAL_UINT(1000, interval);
+
+  TEST_ASSERT_EQUAL_UINT(100, sampler.update(2, params));
+  TEST_ASSERT_EQUAL_UINT32(1,
+                           sampler.get_detection_latency_statistics().count());
+  // Still active while the deviation decays
+  TEST_ASSERT_EQUAL_UINT(100, sampler.update(2, params));
+  TEST_ASSERT_EQUAL_UINT32(1,
+                           sampler.get_detection_latency_statistics().count());
+}
+
+void test_ramp_is_detected_by_its_rate() {
+  AdaptiveSampler sampler("");
+  AdaptiveSamplingParameters params = Parameters();
+  // Too small a deviation between the samples, but 0.5 units/s
+  params.deviation_threshold = 1;
+  sampler.update(0, params);
+  delay(20);
+  TEST_ASSERT_EQUAL_UINT(100, sampler.update(0.01, params));
+  TEST_ASSERT_EQUAL_UINT32(1,
+                           sampler.get_detection_latency_statistics().count());
+}
+
+void test_reset_starts_fast() {
+  AdaptiveSampler sampler("");
+  AdaptiveSamplingParameters params = Parameters();
+  sampler.update(1, params);
+  sampler.update(1, params);
+  TEST_ASSERT_EQUAL_UINT(400, sampler.update(1, params));
+  sampler.reset();
+  TEST_ASSERT_EQUAL_UINT(100, sampler.update(5, params));
+  TEST_ASSERT_EQUAL_UINT(200, sampler.update(5, params));
+}
+
+}  // namespace
+
+void setup() {
+  // Wait for the serial monitor of the test runner
+  delay(2000);
+
+  UNITY_BEGIN();
+  RUN_TEST(test_stable_signal_backs_off);
+  RUN_TEST(test_step_returns_to_the_minimum_interval);
+  RUN_TEST(test_ramp_is_detected_by_its_rate);
+  RUN_TEST(test_reset_starts_fast);
+  UNITY_END();
+}
+
+void loop() {}
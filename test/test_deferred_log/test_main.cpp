@@ -0,0 +1,94 @@
+#include <Arduino.h>
+#include <unity.h>
+
+#include "deferred_log.h"
+
+using namespace halmet;
+using namespace halmet::deferred_log;
+
+namespace {
+
+template <typename... Args>
+Record MakeRecord(const char* format, Args... args) {
+  Record record;
+  record.format = format;
+  record.time = 0;
+  record.level = ESP_LOG_DEBUG;
+  record.num_args = sizeof...(Args);
+  record.types = 0;
+  EncodeArgs(&record, 0, args...);
+  return record;
+}
+
+template <typename... Args>
+String Format(const char* format, Args... args) {
+  char out[64];
+  Record record = MakeRecord(format, args...);
+  FormatRecord(record, out, sizeof(out));
+  return out;
+}
+
+void test_numbers() {
+  TEST_ASSERT_EQUAL_STRING("-5 ms, 1.50 V, 7",
+                           Format("%d ms, %.2f V, %u", -5, 1.5f, 7u).c_str());
+  TEST_ASSERT_EQUAL_STRING("  42|ff|-1.5e+00",
+                           Format("%4d|%x|%.1e", 42, 255u, -1.5).c_str());
+}
+
+void test_length_modifiers_follow_the_stored_value() {
+  uint64_t big = 10000000000ULL;
+  TEST_ASSERT_EQUAL_STRING("10000000000",
+                           Format("%u", big).c_str());
+  TEST_ASSERT_EQUAL_STRING("-3 7",
+                           Format("%hhd %lu", (int8_t)-3, 7ul).c_str());
+  TEST_ASSERT_EQUAL_STRING("-123456789012",
+                           Format("%lld", -123456789012LL).c_str());
+}
+
+void test_percent() {
+  TEST_ASSERT_EQUAL_STRING("100% 3", Format("100%% %d", 3).c_str());
+}
+
+void test_type_mismatch_is_converted() {
+  TEST_ASSERT_EQUAL_STRING("2 3.0", Format("%d %.1f", 2.7, 3).c_str());
+}
+
+void test_strings_are_not_stored() {
+  TEST_ASSERT_EQUAL_STRING("name: ?", Format("name: %s", 1).c_str());
+}
+
+void test_missing_arguments_end_the_message() {
+  TEST_ASSERT_EQUAL_STRING("a 1 b ", Format("a %d b %d c", 1).c_str());
+}
+
+void test_truncation() {
+  char out[8];
+  Record record = MakeRecord("%d ms, %.2f V", -5, 1.5f);
+  size_t length = FormatRecord(record, out, sizeof(out));
+  TEST_ASSERT_EQUAL_STRING("-5 ms, ", out);
+  TEST_ASSERT_EQUAL_UINT(7, length);
+
+  record = MakeRecord("value %d", 123456);
+  length = FormatRecord(record, out, sizeof(out));
+  TEST_ASSERT_EQUAL_STRING("value 1", out);
+  TEST_ASSERT_EQUAL_UINT(7, length);
+}
+
+}  // namespace
+
+void setup() {
+  // Wait for the serial monitor of the test runner
+  delay(2000);
+
+  UNITY_BEGIN();
+  RUN_TEST(test_numbers);
+  RUN_TEST(test_length_modifiers_follow_the_stored_value);
+  RUN_TEST(test_percent);
+  RUN_TEST(test_type_mismatch_is_converted);
+  RUN_TEST(test_strings_are_not_stored);
+  RUN_TEST(test_missing_arguments_end_the_message);
+  RUN_TEST(test_truncation);
+  UNITY_END();
+}
+
+void loop() {}
@@ -0,0 +1,76 @@
+#include <Arduino.h>
+#include <unity.h>
+
+#include "ads1115_scanner.h"
+#include "halmet_analog.h"
+#include "live_config.h"
+
+using namespace halmet;
+
+namespace {
+
+// Exposes the sampling timer of the input
+class TestVoltageInput : public ADS1115VoltageInput {
+ public:
+  using ADS1115VoltageInput::ADS1115VoltageInput;
+  using ADS1115VoltageInput::get_current_interval;
+
+  // Time until the next sample (ms)
+  int32_t time_to_next_sample() const {
+    return repeat_event_->getTriggerTime() - millis();
+  }
+};
+
+ADS1115Scanner* scanner;
+
+void test_get_does_not_apply_staged_parameters() {
+  LiveConfig<int> config{1};
+  config.set(2);
+
+  TEST_ASSERT_EQUAL(1, config.get());
+  TEST_ASSERT_EQUAL(2, config.get_latest());
+  TEST_ASSERT_TRUE(config.update());
+  TEST_ASSERT_EQUAL(2, config.get());
+  TEST_ASSERT_FALSE(config.update());
+}
+
+void test_read_interval_change_rearms_timer_despite_pending_reads() {
+  auto input = new TestVoltageInput(scanner, 0, "", 500);
+  TEST_ASSERT_INT32_WITHIN(20, 500, input->time_to_next_sample());
+
+  JsonDocument doc;
+  JsonObject config = doc.to<JsonObject>();
+  config["calibration_factor"] = 1.0;
+  config["read_interval"] = 200;
+  TEST_ASSERT_TRUE(input->from_json(config));
+
+  // Reads of the parameters before the next sample, as by the adaptive
+  // sampling summary or a ripple burst, see the old parameters
+  input->to_volts(100);
+  TEST_ASSERT_EQUAL_UINT32(500, input->get_current_interval());
+
+  // The sampling callback applies the change and re-arms the timer from
+  // the event loop
+  input->update();
+  sensesp::event_loop()->tick();
+  TEST_ASSERT_EQUAL_UINT32(200, input->get_current_interval());
+  TEST_ASSERT_INT32_WITHIN(20, 200, input->time_to_next_sample());
+}
+
+}  // namespace
+
+void setup() {
+  // Wait for the serial monitor of the test runner
+  delay(2000);
+
+  auto i2c = new TwoWire(0);
+  // No converters are added; conversion requests fail without blocking
+  scanner = new ADS1115Scanner(i2c, GAIN_ONE);
+
+  UNITY_BEGIN();
+  RUN_TEST(test_get_does_not_apply_staged_parameters);
+  RUN_TEST(test_read_interval_change_rearms_timer_despite_pending_reads);
+  UNITY_END();
+}
+
+void loop() {}
@@ -0,0 +1,97 @@
+#include <Arduino.h>
+#include <unity.h>
+
+#include "n2k_encoders.h"
+
+using namespace halmet;
+
+namespace {
+
+void AssertSameMessage(const tN2kMsg& expected, const tN2kMsg& actual) {
+  TEST_ASSERT_EQUAL_UINT32(expected.PGN, actual.PGN);
+  TEST_ASSERT_EQUAL_UINT8(expected.Priority, actual.Priority);
+  TEST_ASSERT_EQUAL_INT(expected.DataLen, actual.DataLen);
+  TEST_ASSERT_EQUAL_UINT8_ARRAY(expected.Data, actual.Data, expected.DataLen);
+}
+
+void test_verified_against_the_library() {
+  TEST_ASSERT_TRUE(VerifyN2kEncoders());
+  TEST_ASSERT_TRUE(n2k_encoders_verified);
+}
+
+void test_engine_param_rapid() {
+  N2kEngineParamRapidEncoder encoder;
+  tN2kMsg expected;
+  tN2kMsg actual;
+
+  SetN2kEngineParamRapid(expected, 1, 1800);
+  encoder.encode_cached(actual, 1, 1800);
+  AssertSameMessage(expected, actual);
+
+  // Change some fields and then change them back
+  SetN2kEngineParamRapid(expected, 1, 2400.25, 150000, -5);
+  encoder.encode_cached(actual, 1, 2400.25, 150000, -5);
+  AssertSameMessage(expected, actual);
+
+  SetN2kEngineParamRapid(expected, 1, N2kDoubleNA);
+  encoder.encode_cached(actual, 1, N2kDoubleNA);
+  AssertSameMessage(expected, actual);
+}
+
+void test_engine_dynamic_param() {
+  N2kEngineDynamicParamEncoder encoder;
+  tN2kMsg expected;
+  tN2kMsg actual;
+
+  SetN2kEngineDynamicParam(expected, 0, 350000, N2kDoubleNA, 358.15, 14.2,
+                           N2kDoubleNA, 3600 * 1234.);
+  encoder.encode_cached(actual, 0, 350000, N2kDoubleNA, 358.15, 14.2,
+                        N2kDoubleNA, 3600 * 1234.);
+  AssertSameMessage(expected, actual);
+
+  SetN2kEngineDynamicParam(expected, 0, 350000, N2kDoubleNA, 373.15, -0.5,
+                           12.3, 3600 * 1234.);
+  encoder.encode_cached(actual, 0, 350000, N2kDoubleNA, 373.15, -0.5, 12.3,
+                        3600 * 1234.);
+  AssertSameMessage(expected, actual);
+
+  SetN2kEngineDynamicParam(expected, 0, 350000, N2kDoubleNA, 358.15, 14.2,
+                           N2kDoubleNA, 3600 * 1234.);
+  encoder.encode_cached(actual, 0, 350000, N2kDoubleNA, 358.15, 14.2,
+                        N2kDoubleNA, 3600 * 1234.);
+  AssertSameMessage(expected, actual);
+}
+
+void test_fluid_level() {
+  N2kFluidLevelEncoder encoder;
+  tN2kMsg expected;
+  tN2kMsg actual;
+
+  SetN2kFluidLevel(expected, 2, N2kft_Fuel, 73.5, 200);
+  encoder.encode_cached(actual, 2, N2kft_Fuel, 73.5, 200);
+  AssertSameMessage(expected, actual);
+
+  SetN2kFluidLevel(expected, 2, N2kft_Fuel, N2kDoubleNA, 200);
+  encoder.encode_cached(actual, 2, N2kft_Fuel, N2kDoubleNA, 200);
+  AssertSameMessage(expected, actual);
+
+  SetN2kFluidLevel(expected, 2, N2kft_Fuel, 73.5, 200);
+  encoder.encode_cached(actual, 2, N2kft_Fuel, 73.5, 200);
+  AssertSameMessage(expected, actual);
+}
+
+}  // namespace
+
+void setup() {
+  // Wait for the serial monitor of the test runner
+  delay(2000);
+
+  UNITY_BEGIN();
+  RUN_TEST(test_verified_against_the_library);
+  RUN_TEST(test_engine_param_rapid);
+  RUN_TEST(test_engine_dynamic_param);
+  RUN_TEST(test_fluid_level);
+  UNITY_END();
+}
+
+void loop() {}
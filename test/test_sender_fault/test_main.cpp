@@ -0,0 +1,87 @@
+#include <Arduino.h>
+#include <unity.h>
+
+#include <cmath>
+
+#include "sender_fault.h"
+
+using namespace halmet;
+
+namespace {
+
+bool Configure(SenderFaultDetector& detector, float open_above,
+               float short_below, float valid_min, float valid_max) {
+  JsonDocument doc;
+  JsonObject config = doc.to<JsonObject>();
+  config["open_above"] = open_above;
+  config["short_below"] = short_below;
+  config["valid_min"] = valid_min;
+  config["valid_max"] = valid_max;
+  return detector.from_json(config);
+}
+
+void test_default_thresholds() {
+  SenderFaultDetector detector;
+
+  detector.set(100);
+  TEST_ASSERT_TRUE(detector.get_fault() == SenderFault::kNone);
+  TEST_ASSERT_FALSE(detector.fault_.get());
+  TEST_ASSERT_EQUAL_FLOAT(100, detector.get());
+
+  detector.set(2000);
+  TEST_ASSERT_TRUE(detector.get_fault() == SenderFault::kOpen);
+  TEST_ASSERT_TRUE(detector.fault_.get());
+  // Faulty readings are not passed on
+  TEST_ASSERT_EQUAL_FLOAT(100, detector.get());
+
+  detector.set(NAN);
+  TEST_ASSERT_TRUE(detector.get_fault() == SenderFault::kOpen);
+
+  detector.set(1);
+  TEST_ASSERT_TRUE(detector.get_fault() == SenderFault::kShort);
+
+  detector.set(4);
+  TEST_ASSERT_TRUE(detector.get_fault() == SenderFault::kOutOfRange);
+
+  detector.set(450);
+  TEST_ASSERT_TRUE(detector.get_fault() == SenderFault::kOutOfRange);
+  TEST_ASSERT_EQUAL_FLOAT(100, detector.get());
+
+  detector.set(150);
+  TEST_ASSERT_TRUE(detector.get_fault() == SenderFault::kNone);
+  TEST_ASSERT_FALSE(detector.fault_.get());
+  TEST_ASSERT_EQUAL_FLOAT(150, detector.get());
+}
+
+void test_thresholds_must_be_in_increasing_order() {
+  SenderFaultDetector detector;
+  TEST_ASSERT_FALSE(Configure(detector, 1000, 10, 5, 400));
+  TEST_ASSERT_FALSE(Configure(detector, 1000, 3, 500, 400));
+  TEST_ASSERT_FALSE(Configure(detector, 300, 3, 5, 400));
+  TEST_ASSERT_TRUE(Configure(detector, 1000, 3, 5, 400));
+}
+
+void test_short_detection_can_be_disabled() {
+  SenderFaultDetector detector;
+  TEST_ASSERT_TRUE(Configure(detector, 1000, 0, 0, 190));
+  detector.set(0);
+  TEST_ASSERT_TRUE(detector.get_fault() == SenderFault::kNone);
+  TEST_ASSERT_EQUAL_FLOAT(0, detector.get());
+  detector.set(200);
+  TEST_ASSERT_TRUE(detector.get_fault() == SenderFault::kOutOfRange);
+}
+
+}  // namespace
+
+void setup() {
+  // Wait for the serial monitor of the test runner
+  delay(2000);
+
+  UNITY_BEGIN();
+  RUN_TEST(test_default_thresholds);
+  RUN_TEST(test_thresholds_must_be_in_increasing_order);
+  RUN_TEST(test_short_detection_can_be_disabled);
+  UNITY_END();
+}
+
+void loop() {}
@@ -0,0 +1,100 @@
+#include <Arduino.h>
+#include <unity.h>
+
+#include <cmath>
+
+#include "tank_level_estimator.h"
+
+using namespace halmet;
+
+namespace {
+
+const unsigned int kMaxOutliers = 3;
+
+TankLevelEstimator* CreateEstimator(unsigned int response_time) {
+  auto estimator = new TankLevelEstimator();
+  JsonDocument doc;
+  JsonObject config = doc.to<JsonObject>();
+  config["enabled"] = true;
+  config["response_time"] = response_time;
+  config["outlier_threshold"] = 0.15;
+  config["max_outliers"] = kMaxOutliers;
+  TEST_ASSERT_TRUE(estimator->from_json(config));
+  return estimator;
+}
+
+// Feed a level every 20 ms for the given time (ms). The level falls at
+// the given rate (ratio/s) from the start of the feed.
+void Feed(TankLevelEstimator* estimator, float level, float rate,
+          uint32_t duration) {
+  uint32_t start = millis();
+  while (millis() - start < duration) {
+    estimator->set(level + rate * (millis() - start) / 1000.f);
+    delay(20);
+  }
+}
+
+void test_rate_waits_for_the_response_time() {
+  TankLevelEstimator* estimator = CreateEstimator(1);
+  uint32_t start = millis();
+  Feed(estimator, 0.8, -0.05, 500);
+  TEST_ASSERT_TRUE(std::isnan(estimator->rate_.get()));
+  TEST_ASSERT_TRUE(std::isnan(estimator->time_to_empty_.get()));
+
+  // Continue the same ramp past the response time
+  float elapsed = (millis() - start) / 1000.f;
+  Feed(estimator, 0.8 - 0.05 * elapsed, -0.05, 1000);
+  TEST_ASSERT_FLOAT_WITHIN(0.005, -0.05, estimator->rate_.get());
+  float level = estimator->get();
+  TEST_ASSERT_FLOAT_WITHIN(0.01, 0.8 - 0.05 * (millis() - start) / 1000.f,
+                           level);
+  TEST_ASSERT_FLOAT_WITHIN(0.1 * level / 0.05, level / 0.05,
+                           estimator->time_to_empty_.get());
+}
+
+void test_single_outlier_is_ignored() {
+  TankLevelEstimator* estimator = CreateEstimator(1);
+  Feed(estimator, 0.5, 0, 500);
+  estimator->set(0.9);
+  TEST_ASSERT_FLOAT_WITHIN(0.01, 0.5, estimator->get());
+  Feed(estimator, 0.5, 0, 100);
+  TEST_ASSERT_FLOAT_WITHIN(0.01, 0.5, estimator->get());
+}
+
+void test_level_jump_restarts_the_estimate() {
+  TankLevelEstimator* estimator = CreateEstimator(1);
+  Feed(estimator, 0.5, 0, 1500);
+  TEST_ASSERT_FALSE(std::isnan(estimator->rate_.get()));
+
+  // Refuelling: the new level persists
+  for (unsigned int i = 0; i < kMaxOutliers; i++) {
+    estimator->set(0.9);
+    delay(20);
+  }
+  TEST_ASSERT_EQUAL_FLOAT(0.9, estimator->get());
+  TEST_ASSERT_TRUE(std::isnan(estimator->rate_.get()));
+  TEST_ASSERT_TRUE(std::isnan(estimator->time_to_empty_.get()));
+}
+
+void test_rising_level_has_no_time_to_empty() {
+  TankLevelEstimator* estimator = CreateEstimator(1);
+  Feed(estimator, 0.2, 0.05, 1500);
+  TEST_ASSERT_FLOAT_WITHIN(0.005, 0.05, estimator->rate_.get());
+  TEST_ASSERT_TRUE(std::isnan(estimator->time_to_empty_.get()));
+}
+
+}  // namespace
+
+void setup() {
+  // Wait for the serial monitor of the test runner
+  delay(2000);
+
+  UNITY_BEGIN();
+  RUN_TEST(test_rate_waits_for_the_response_time);
+  RUN_TEST(test_single_outlier_is_ignored);
+  RUN_TEST(test_level_jump_restarts_the_estimate);
+  RUN_TEST(test_rising_level_has_no_time_to_empty);
+  UNITY_END();
+}
+
+void loop() {}
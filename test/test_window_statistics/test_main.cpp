@@ -0,0 +1,77 @@
+#include <Arduino.h>
+#include <unity.h>
+
+#include <cmath>
+
+#include "window_statistics.h"
+
+using namespace halmet;
+
+namespace {
+
+// Feed a value every 5 ms for the given time (ms)
+void Feed(WindowStatistics& statistics, float value, uint32_t duration) {
+  uint32_t start = millis();
+  while (millis() - start < duration) {
+    statistics.set(value);
+    delay(5);
+  }
+}
+
+void test_ramp() {
+  // 3 s window with 50 ms slots
+  WindowStatistics statistics(3);
+  // The value is the time, so the expected statistics don't depend on the
+  // exact sample instants
+  uint32_t start = millis();
+  while (millis() - start < 4000) {
+    statistics.set((millis() - start) / 1000.f);
+    delay(10);
+  }
+  float now = (millis() - start) / 1000.f;
+
+  TEST_ASSERT_FLOAT_WITHIN(0.02, 1, statistics.rate_.get());
+  TEST_ASSERT_FLOAT_WITHIN(0.1, 3,
+                           statistics.max_.get() - statistics.min_.get());
+  TEST_ASSERT_FLOAT_WITHIN(0.1, now - 1.5, statistics.mean_.get());
+  // Standard deviation of a uniform distribution over the window
+  TEST_ASSERT_FLOAT_WITHIN(0.05, 3 / sqrtf(12), statistics.stddev_.get());
+}
+
+void test_extremes_leave_the_window() {
+  WindowStatistics statistics(1);
+  Feed(statistics, 5, 200);
+  statistics.set(9);
+  Feed(statistics, 5, 100);
+  TEST_ASSERT_EQUAL_FLOAT(9, statistics.max_.get());
+
+  Feed(statistics, 5, 1500);
+  TEST_ASSERT_EQUAL_FLOAT(5, statistics.max_.get());
+  TEST_ASSERT_EQUAL_FLOAT(5, statistics.min_.get());
+  TEST_ASSERT_FLOAT_WITHIN(1e-3, 0, statistics.stddev_.get());
+  TEST_ASSERT_FLOAT_WITHIN(1e-3, 0, statistics.rate_.get());
+}
+
+void test_gap_longer_than_window_starts_over() {
+  WindowStatistics statistics(1);
+  Feed(statistics, 1, 500);
+  delay(1200);
+  Feed(statistics, 3, 300);
+  TEST_ASSERT_EQUAL_FLOAT(3, statistics.min_.get());
+  TEST_ASSERT_EQUAL_FLOAT(3, statistics.mean_.get());
+}
+
+}  // namespace
+
+void setup() {
+  // Wait for the serial monitor of the test runner
+  delay(2000);
+
+  UNITY_BEGIN();
+  RUN_TEST(test_ramp);
+  RUN_TEST(test_extremes_leave_the_window);
+  RUN_TEST(test_gap_longer_than_window_starts_over);
+  UNITY_END();
+}
+
+void loop() {}
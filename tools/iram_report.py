@@ -0,0 +1,158 @@
+#!/usr/bin/env python3
+"""Report where the HALMET code and data were placed by the linker.
+
+Reads the linker map written by the firmware build (see the -Wl,-Map flag
+in platformio.ini) and prints the IRAM, DRAM and flash usage, the firmware's
+own input sections in IRAM and DRAM, and the memory region of each of the
+hot paths listed in HOT_PATHS. Code in flash stalls while the flash is
+being written; only code in IRAM keeps running.
+"""
+
+import argparse
+import os
+import re
+import shutil
+import subprocess
+
+# Functions on the sample and interrupt paths, as demangled name fragments
+HOT_PATHS = [
+    ("tacho edge handler", "halmet::PulseCounter::isr"),
+    ("tacho count read", "halmet::PulseCounter::read"),
+    ("latency monitor IRAM handler",
+     "halmet::IsrLatencyMonitor::iram_handler"),
+    ("latency monitor flash handler",
+     "halmet::IsrLatencyMonitor::flash_handler"),
+    ("ADC completion handler", "halmet::ADS1115Scanner::poll"),
+    ("ADC conversion start", "halmet::ADS1115Scanner::start_next"),
+    ("alarm input poll", "sensesp::DigitalInputState"),
+    ("N2k send path", "tNMEA2000::SendMsg"),
+    ("CAN frame send", "tNMEA2000_esp32::CANSendFrame"),
+]
+
+REGIONS = [
+    ("IRAM", (".iram0",)),
+    ("DRAM", (".dram0",)),
+    ("flash code", (".flash.text",)),
+    ("flash data", (".flash.rodata", ".flash.appdesc")),
+]
+
+OUTPUT_SECTION = re.compile(r"^(\.\S+)(?:\s+0x[0-9a-f]+\s+0x[0-9a-f]+)?")
+INPUT_SECTION = re.compile(
+    r"^ (\.\S+|COMMON)(?:\s+(0x[0-9a-f]+)\s+(0x[0-9a-f]+)\s+(\S.*))?$")
+CONTINUATION = re.compile(r"^\s+(0x[0-9a-f]+)\s+(0x[0-9a-f]+)\s+(\S.*)$")
+SYMBOL = re.compile(r"^\s+(0x[0-9a-f]+)\s+([^\s=][^=]*)$")
+
+
+def region_of(output_section):
+    for region, prefixes in REGIONS:
+        if output_section.startswith(prefixes):
+            return region
+    return None
+
+
+def parse(path):
+    """Return the input sections as dicts with region, name, size, file and
+    symbols."""
+    sections = []
+    output = None
+    pending = None
+    current = None
+    in_map = False
+    with open(path, errors="replace") as f:
+        for line in f:
+            line = line.rstrip("\n")
+            if not in_map:
+                in_map = line.startswith("Linker script and memory map")
+                continue
+            if pending is not None:
+                match = CONTINUATION.match(line)
+                if match:
+                    current = add(sections, output, pending, *match.groups())
+                pending = None
+                continue
+            match = OUTPUT_SECTION.match(line)
+            if match:
+                output = match.group(1)
+                current = None
+                continue
+            match = INPUT_SECTION.match(line)
+            if match:
+                name, address, size, file = match.groups()
+                if address is None:
+                    pending = name
+                else:
+                    current = add(sections, output, name, address, size, file)
+                continue
+            match = SYMBOL.match(line)
+            if match and current is not None:
+                current["symbols"].append(match.group(2).strip())
+    return sections
+
+
+def add(sections, output, name, address, size, file):
+    section = {
+        "region": region_of(output or ""),
+        "name": name,
+        "size": int(size, 16),
+        "file": file,
+        "symbols": [],
+    }
+    sections.append(section)
+    return section
+
+
+def is_own(section):
+    return "/src/" in section["file"].replace("\\", "/")
+
+
+def demangle_all(sections):
+    names = sorted({s for section in sections for s in section["symbols"]
+                    if s.startswith("_Z")})
+    tool = shutil.which("xtensa-esp32-elf-c++filt") or shutil.which("c++filt")
+    if not names or tool is None:
+        return
+    result = subprocess.run([tool], input="\n".join(names), text=True,
+                            capture_output=True)
+    demangled = dict(zip(names, result.stdout.splitlines()))
+    for section in sections:
+        section["symbols"] = [demangled.get(s, s) for s in section["symbols"]]
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument("map", nargs="?",
+                        default=".pio/build/esp32dev/firmware.map",
+                        help="linker map file")
+    parser.add_argument("--flash", action="store_true",
+                        help="also list the firmware's own code in flash")
+    args = parser.parse_args()
+
+    sections = [s for s in parse(args.map) if s["region"] and s["size"]]
+    demangle_all(sections)
+
+    print("%-12s %10s %10s" % ("region", "total", "firmware"))
+    for region, _ in REGIONS:
+        in_region = [s for s in sections if s["region"] == region]
+        print("%-12s %10d %10d" % (
+            region, sum(s["size"] for s in in_region),
+            sum(s["size"] for s in in_region if is_own(s))))
+
+    listed = ["IRAM", "DRAM"] + (["flash code"] if args.flash else [])
+    for region in listed:
+        print("\nFirmware sections in %s:" % region)
+        for s in sorted((s for s in sections
+                         if s["region"] == region and is_own(s)),
+                        key=lambda s: -s["size"]):
+            print("  %6d  %-24s %s" % (s["size"], os.path.basename(s["file"]),
+                                       ", ".join(s["symbols"]) or s["name"]))
+
+    print("\nHot paths:")
+    for label, fragment in HOT_PATHS:
+        found = [s for s in sections
+                 if any(fragment in symbol for symbol in s["symbols"])]
+        where = ", ".join(sorted({s["region"] for s in found}))
+        print("  %-30s %s" % (label, where or "not found (inlined?)"))
+
+
+if __name__ == "__main__":
+    main()
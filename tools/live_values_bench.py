@@ -0,0 +1,84 @@
+#!/usr/bin/env python3
+"""Benchmark the HALMET live values endpoint.
+
+Requests /api/values repeatedly for the given duration and prints the
+request rate and latency percentiles. If the pipeline profiler is enabled,
+the free heap reported at /api/profile before and after the run is printed
+as well.
+"""
+
+import argparse
+import json
+import time
+import urllib.request
+from concurrent.futures import ThreadPoolExecutor
+
+
+def get(url, timeout=5):
+    with urllib.request.urlopen(url, timeout=timeout) as response:
+        return response.read()
+
+
+def free_heap(base_url):
+    try:
+        report = json.loads(get(base_url + "/api/profile"))
+        return report["heap"]["free"], report["heap"]["min_free"]
+    except Exception:
+        return None
+
+
+def worker(url, deadline):
+    latencies = []
+    errors = 0
+    while time.monotonic() < deadline:
+        start = time.monotonic()
+        try:
+            json.loads(get(url))
+            latencies.append(time.monotonic() - start)
+        except Exception:
+            errors += 1
+    return latencies, errors
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument("--host", default="halmet.local")
+    parser.add_argument("--duration", type=float, default=30,
+                        help="run time in seconds")
+    parser.add_argument("--concurrency", type=int, default=1,
+                        help="number of parallel clients")
+    args = parser.parse_args()
+
+    base_url = "http://" + args.host
+    heap_before = free_heap(base_url)
+
+    deadline = time.monotonic() + args.duration
+    with ThreadPoolExecutor(args.concurrency) as executor:
+        results = list(executor.map(
+            lambda _: worker(base_url + "/api/values", deadline),
+            range(args.concurrency)))
+
+    latencies = sorted(l for result in results for l in result[0])
+    errors = sum(result[1] for result in results)
+    if not latencies:
+        print("No successful requests, %d errors" % errors)
+        return
+
+    def percentile(p):
+        return 1000 * latencies[min(len(latencies) - 1,
+                                    int(p / 100 * len(latencies)))]
+
+    print("requests: %d, errors: %d" % (len(latencies), errors))
+    print("rate: %.1f requests/s" % (len(latencies) / args.duration))
+    print("latency: p50 %.1f ms, p90 %.1f ms, p99 %.1f ms, max %.1f ms" %
+          (percentile(50), percentile(90), percentile(99),
+           1000 * latencies[-1]))
+
+    heap_after = free_heap(base_url)
+    if heap_before and heap_after:
+        print("free heap: %d before, %d after, minimum %d" %
+              (heap_before[0], heap_after[0], heap_after[1]))
+
+
+if __name__ == "__main__":
+    main()
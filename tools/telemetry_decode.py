@@ -0,0 +1,53 @@
+#!/usr/bin/env python3
+"""Decode the HALMET binary telemetry stream.
+
+Joins the multicast group and prints the received samples as CSV lines:
+
+    sequence,sender_time_ms,channel,age_ms,dropped,value
+
+Each sample is received once. dropped is 1 if earlier samples of the
+channel were dropped on the sender because its queue was full.
+
+The datagram layout is described in src/telemetry_stream.h.
+"""
+
+import argparse
+import socket
+import struct
+
+HEADER = struct.Struct("<2sBBII")
+SAMPLE = struct.Struct("<BBHf")
+
+
+def decode(datagram):
+    magic, version, count, sequence, time_ms = HEADER.unpack_from(datagram)
+    if magic != b"HT" or version != 2:
+        return
+    for i in range(count):
+        channel, flags, age, value = SAMPLE.unpack_from(
+            datagram, HEADER.size + i * SAMPLE.size)
+        yield sequence, time_ms, channel, age, flags & 1, value
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument("--group", default="239.255.72.77")
+    parser.add_argument("--port", type=int, default=7277)
+    args = parser.parse_args()
+
+    sock = socket.socket(socket.AF_INET, socket.SOCK_DGRAM, socket.IPPROTO_UDP)
+    sock.setsockopt(socket.SOL_SOCKET, socket.SO_REUSEADDR, 1)
+    sock.bind(("", args.port))
+    membership = struct.pack("4sl", socket.inet_aton(args.group),
+                             socket.INADDR_ANY)
+    sock.setsockopt(socket.IPPROTO_IP, socket.IP_ADD_MEMBERSHIP, membership)
+
+    print("sequence,sender_time_ms,channel,age_ms,dropped,value")
+    while True:
+        datagram, _ = sock.recvfrom(1500)
+        for sample in decode(datagram):
+            print("%d,%d,%d,%d,%d,%g" % sample, flush=True)
+
+
+if __name__ == "__main__":
+    main()